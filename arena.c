@@ -0,0 +1,202 @@
+/**************************************************************
+ *
+ *                         arena.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the arena class.
+ *
+ **************************************************************/
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+/* Blocks up to SMALL_LIMIT bytes are sized in GRANULE steps, each step
+ * a class of its own; the rest are sized in powers of 2 */
+#define GRANULE 16
+#define SMALL_LIMIT 4096
+#define NUM_SMALL_CLASSES (SMALL_LIMIT / GRANULE)
+#define NUM_CLASSES (NUM_SMALL_CLASSES + 6)     /* 8 KB to 256 KB */
+
+/* A released block, linked through its first bytes */
+typedef struct Free_block {
+    struct Free_block *next;
+} Free_block;
+
+/* The start of every chunk; blocks follow it */
+typedef struct Chunk {
+    struct Chunk *next;
+    char pad[GRANULE - sizeof(struct Chunk *)];
+} Chunk;
+
+struct Arena {
+    Chunk *chunks;              /* most recent first */
+    char *next;                 /* the next free byte of the newest chunk */
+    char *end;                  /* one past its last byte */
+    Free_block *free_lists[NUM_CLASSES];
+};
+
+/* size_class
+ * Purpose: finds the class a block size falls in
+ * Parameters: a size_t and a size_t pointer
+ * Returns: the class's index in free_lists
+ *
+ * Expected input: a size of at most ARENA_MAX_BYTES, and where to store
+                   the size blocks of the class have
+ * Success output: the index, with the rounded-up size stored
+ * Failure output: none
+ */
+static size_t size_class(size_t bytes, size_t *rounded)
+{
+    if (bytes <= SMALL_LIMIT) {
+        *rounded = bytes == 0 ? GRANULE
+                              : (bytes + GRANULE - 1) & ~(size_t)(GRANULE - 1);
+        return *rounded / GRANULE - 1;
+    }
+
+    size_t size = 2 * SMALL_LIMIT;
+    size_t index = NUM_SMALL_CLASSES;
+
+    while (size < bytes) {
+        size *= 2;
+        index++;
+    }
+
+    *rounded = size;
+    return index;
+}
+
+/* arena_new
+ * Purpose: makes an empty arena
+ * Parameters: none
+ * Returns: the new Arena
+ *
+ * Expected input: none
+ * Success output: an Arena with no chunks yet
+ * Failure output: exits the program if memory runs out
+ */
+Arena arena_new()
+{
+    Arena arena = calloc(1, sizeof(*arena));
+
+    if (arena == NULL) {
+        exit(1);
+    }
+
+    return arena;
+}
+
+/* add_chunk
+ * Purpose: starts carving blocks from a new chunk
+ * Parameters: an Arena
+ * Returns: Nothing
+ *
+ * Expected input: an arena whose newest chunk is too full for the next
+                   block; what is left of that chunk goes unused
+ * Success output: none (next and end span the new chunk's free space)
+ * Failure output: exits the program if memory runs out
+ */
+static void add_chunk(Arena arena)
+{
+    /* Not calloc: once malloc reuses freed chunks, zeroing the whole
+     * chunk costs more than a short-lived UM spends on its segments, so
+     * blocks are zeroed as they are handed out instead */
+    Chunk *chunk = malloc(ARENA_CHUNK_BYTES);
+
+    if (chunk == NULL) {
+        exit(1);
+    }
+
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+    arena->next = (char *)(chunk + 1);
+    arena->end = (char *)chunk + ARENA_CHUNK_BYTES;
+}
+
+/* arena_alloc
+ * Purpose: allocates a zero-filled block
+ * Parameters: an Arena and a size_t
+ * Returns: a pointer to the block
+ *
+ * Expected input: an arena, and the block's size in bytes, at most
+                   ARENA_MAX_BYTES
+ * Success output: a block of at least that many zeroed bytes, aligned
+                   for any type, that lives until it is released or the
+                   arena is freed
+ * Failure output: exits the program if memory runs out
+ */
+void *arena_alloc(Arena arena, size_t bytes)
+{
+    size_t rounded;
+    size_t index = size_class(bytes, &rounded);
+    Free_block *block = arena->free_lists[index];
+
+    assert(bytes <= ARENA_MAX_BYTES);
+
+    if (block != NULL) {
+        arena->free_lists[index] = block->next;
+    } else {
+        if ((size_t)(arena->end - arena->next) < rounded) {
+            add_chunk(arena);
+        }
+        block = (Free_block *)arena->next;
+        arena->next += rounded;
+    }
+
+    memset(block, 0, rounded);
+    return block;
+}
+
+/* arena_release
+ * Purpose: gives a block back to the arena for reuse
+ * Parameters: an Arena, a pointer and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: a block from arena_alloc on the same arena, and the
+                   size it was allocated with
+ * Success output: none (the block is on its class's free list)
+ * Failure output: none
+ */
+void arena_release(Arena arena, void *block, size_t bytes)
+{
+    size_t rounded;
+    size_t index = size_class(bytes, &rounded);
+    Free_block *released = block;
+
+    released->next = arena->free_lists[index];
+    arena->free_lists[index] = released;
+}
+
+/* arena_free
+ * Purpose: frees an arena and every block allocated from it
+ * Parameters: a pointer to an Arena
+ * Returns: Nothing
+ *
+ * Expected input: a pointer to an arena, which may be NULL
+ * Success output: none (the chunks are freed, and the Arena is NULL)
+ * Failure output: none
+ */
+void arena_free(Arena *arena)
+{
+    if (*arena == NULL) {
+        return;
+    }
+
+    Chunk *chunk = (*arena)->chunks;
+
+    while (chunk != NULL) {
+        Chunk *next = chunk->next;
+
+        free(chunk);
+        chunk = next;
+    }
+
+    free(*arena);
+    *arena = NULL;
+}
@@ -0,0 +1,86 @@
+/**************************************************************
+ *
+ *                         arena.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class is a region allocator for the memory of one UM. Blocks
+ *     are carved from ARENA_CHUNK_BYTES chunks by bumping a pointer, so
+ *     allocating is a few instructions. A released block goes on a free
+ *     list for its size class and is handed out again, zeroed, by the
+ *     next allocation of that class; nothing is returned to the system
+ *     until the whole arena is freed, which takes one free per chunk
+ *     however many blocks were allocated.
+ *
+ *     Sizes up to 4 KB are rounded up to a multiple of 16 bytes and each
+ *     has a class of its own; larger ones are rounded up to a power of
+ *     2. Blocks of more than ARENA_MAX_BYTES are not served: the caller
+ *     should allocate those some other way.
+ *
+ *     An arena is not thread-safe; each UM uses its own.
+ *
+ **************************************************************/
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+#include <stddef.h>
+
+/* Bytes in each chunk the arena carves blocks from */
+#define ARENA_CHUNK_BYTES ((size_t)1 << 20)
+
+/* The largest block an arena allocates */
+#define ARENA_MAX_BYTES ((size_t)1 << 18)
+
+typedef struct Arena *Arena;
+
+/* arena_new
+ * Purpose: makes an empty arena
+ * Parameters: none
+ * Returns: the new Arena
+ *
+ * Expected input: none
+ * Success output: an Arena with no chunks yet
+ * Failure output: exits the program if memory runs out
+ */
+Arena arena_new();
+
+/* arena_alloc
+ * Purpose: allocates a zero-filled block
+ * Parameters: an Arena and a size_t
+ * Returns: a pointer to the block
+ *
+ * Expected input: an arena, and the block's size in bytes, at most
+                   ARENA_MAX_BYTES
+ * Success output: a block of at least that many zeroed bytes, aligned
+                   for any type, that lives until it is released or the
+                   arena is freed
+ * Failure output: exits the program if memory runs out
+ */
+void *arena_alloc(Arena arena, size_t bytes);
+
+/* arena_release
+ * Purpose: gives a block back to the arena for reuse
+ * Parameters: an Arena, a pointer and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: a block from arena_alloc on the same arena, and the
+                   size it was allocated with
+ * Success output: none (the block is on its class's free list)
+ * Failure output: none
+ */
+void arena_release(Arena arena, void *block, size_t bytes);
+
+/* arena_free
+ * Purpose: frees an arena and every block allocated from it
+ * Parameters: a pointer to an Arena
+ * Returns: Nothing
+ *
+ * Expected input: a pointer to an arena, which may be NULL
+ * Success output: none (the chunks are freed, and the Arena is NULL)
+ * Failure output: none
+ */
+void arena_free(Arena *arena);
+
+#endif
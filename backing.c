@@ -0,0 +1,465 @@
+/**************************************************************
+ *
+ *                         backing.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the backing class.
+ *
+ **************************************************************/
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "backing.h"
+
+#define HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+static Backing_mode backing_mode = BACKING_HEAP;
+static size_t backing_threshold = BACKING_DEFAULT_THRESHOLD;
+static bool backing_first_touch = false;
+
+/* A mapping waiting for the reclaimer */
+typedef struct Reclaim {
+        void *region;
+        size_t bytes;
+        struct Reclaim *next;
+} Reclaim;
+
+/* Any UM thread pushes onto pending without a lock; the reclaimer takes
+ * the whole list at once. The lock and condition variable are only used
+ * to put the reclaimer to sleep and wake it. */
+static Reclaim *pending;
+static bool reclaiming = false;
+static bool reclaim_stopping = false;
+static pthread_t reclaimer;
+static pthread_mutex_t reclaim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reclaim_wake = PTHREAD_COND_INITIALIZER;
+
+/* backing_configure
+ * Purpose: selects where large segments are placed
+ * Parameters: a Backing_mode, a threshold in words, and a bool
+ * Returns: Nothing
+ *
+ * Expected input: the mode to use for large segments, the smallest
+                   segment size (in words) that counts as large, and
+                   whether huge mappings should be first-touched by the
+                   calling thread so that their pages land on its NUMA
+                   node
+ * Success output: none
+ * Failure output: none
+ */
+void backing_configure(Backing_mode mode, size_t threshold,
+                       bool first_touch)
+{
+    backing_mode = mode;
+    backing_threshold = threshold;
+    backing_first_touch = first_touch;
+}
+
+/* mapping_size
+ * Purpose: rounds a word count up to a whole number of pages
+ * Parameters: a size_t and a bool
+ * Returns: the size of the mapping in bytes
+ *
+ * Expected input: a number of words, and whether the mapping is made
+                   of huge pages
+ * Success output: the byte size of the mapping holding that many words,
+                   a multiple of HUGE_PAGE_SIZE for huge pages and of
+                   the system's page size otherwise
+ * Failure output: none
+ */
+static size_t mapping_size(size_t num_words, bool huge)
+{
+    size_t page_size = huge ? HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+    size_t bytes = num_words * sizeof(uint32_t);
+
+    if (bytes == 0) {
+        bytes = 1;
+    }
+
+    return (bytes + page_size - 1) & ~(page_size - 1);
+}
+
+/* map_thp
+ * Purpose: maps a huge-page aligned region and asks the kernel to back
+            it with transparent huge pages
+ * Parameters: a size_t
+ * Returns: a pointer to the region, or NULL if mmap fails
+ *
+ * Expected input: a size that is a multiple of HUGE_PAGE_SIZE
+ * Success output: a zero-filled, HUGE_PAGE_SIZE aligned region
+ * Failure output: NULL
+ */
+static void *map_thp(size_t bytes)
+{
+    /* Over-map by one huge page so the region can be trimmed to an
+     * aligned start; THP only covers fully aligned 2 MB ranges */
+    size_t padded = bytes + HUGE_PAGE_SIZE;
+    char *raw = mmap(NULL, padded, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+
+    uintptr_t start = ((uintptr_t)raw + HUGE_PAGE_SIZE - 1)
+                      & ~(HUGE_PAGE_SIZE - 1);
+    size_t head = start - (uintptr_t)raw;
+
+    if (head > 0) {
+        munmap(raw, head);
+    }
+    munmap((char *)start + bytes, padded - head - bytes);
+
+#ifdef MADV_HUGEPAGE
+    madvise((void *)start, bytes, MADV_HUGEPAGE);
+#endif
+
+    return (void *)start;
+}
+
+/* map_hugetlb
+ * Purpose: maps a region backed by hugetlbfs pages
+ * Parameters: a size_t
+ * Returns: a pointer to the region, or NULL if no huge pages are
+            available
+ *
+ * Expected input: a size that is a multiple of HUGE_PAGE_SIZE
+ * Success output: a zero-filled region of huge pages
+ * Failure output: NULL
+ */
+static void *map_hugetlb(size_t bytes)
+{
+#ifdef MAP_HUGETLB
+    void *region = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+    if (region != MAP_FAILED) {
+        return region;
+    }
+#else
+    (void)bytes;
+#endif
+    return NULL;
+}
+
+/* map_lazy
+ * Purpose: maps a region of ordinary pages that are committed only when
+            first written
+ * Parameters: a size_t
+ * Returns: a pointer to the region, or NULL if mmap fails
+ *
+ * Expected input: a size that is a multiple of the page size
+ * Success output: a zero-filled region; until a page is written, reads
+                   of it see the kernel's shared zero page, so mapping a
+                   region of any size takes constant time and memory
+ * Failure output: NULL
+ */
+static void *map_lazy(size_t bytes)
+{
+    /* MAP_NORESERVE so a huge segment that is mostly never touched is
+     * not refused by overcommit accounting */
+    void *region = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    return region == MAP_FAILED ? NULL : region;
+}
+
+/* first_touch
+ * Purpose: writes one word in every page of a fresh mapping so that
+            the kernel allocates each page on the calling thread's node
+ * Parameters: a pointer and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: a zero-filled mapping and its size in bytes
+ * Success output: none (every page of the mapping is resident)
+ * Failure output: none
+ */
+static void first_touch(void *region, size_t bytes)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    volatile char *p = region;
+
+    for (size_t offset = 0; offset < bytes; offset += page_size) {
+        p[offset] = 0;
+    }
+}
+
+/* backing_alloc
+ * Purpose: allocates zero-filled memory for a segment
+ * Parameters: a size_t, a bool, and a Backing_source pointer
+ * Returns: a pointer to the first word of the memory
+ *
+ * Expected input: the number of words to allocate, whether the segment
+                   should be treated as large regardless of its size (as
+                   segment 0 is), and a pointer that is set to where the
+                   memory came from
+ * Success output: a pointer to num_words zeroed words
+ * Failure output: exits the program if no memory is available
+ */
+uint32_t *backing_alloc(size_t num_words, bool always_large,
+                        Backing_source *source)
+{
+    bool large = always_large || num_words >= backing_threshold;
+
+    if (backing_mode != BACKING_HEAP && large) {
+        size_t bytes = mapping_size(num_words, true);
+        void *region = NULL;
+
+        if (backing_mode == BACKING_HUGETLB) {
+            region = map_hugetlb(bytes);
+        }
+        if (region == NULL) {
+            region = map_thp(bytes);
+        }
+
+        if (region != NULL) {
+            if (backing_first_touch) {
+                first_touch(region, bytes);
+            }
+            *source = SOURCE_HUGE_PAGES;
+            return region;
+        }
+    }
+
+    if (num_words >= BACKING_LAZY_WORDS) {
+        void *region = map_lazy(mapping_size(num_words, false));
+
+        if (region != NULL) {
+            *source = SOURCE_PAGES;
+            return region;
+        }
+    }
+
+    uint32_t *words = calloc(num_words > 0 ? num_words : 1,
+                             sizeof(uint32_t));
+    if (words == NULL) {
+        exit(1);
+    }
+
+    *source = SOURCE_HEAP;
+    return words;
+}
+
+/* backing_reserve
+ * Purpose: maps memory for a segment whose pages the caller fills in
+            later, one at a time
+ * Parameters: a size_t
+ * Returns: a pointer to the first word of the memory, or NULL
+ *
+ * Expected input: the number of words to reserve
+ * Success output: a page-aligned mapping of num_words words that cannot
+                   be read or written until the caller mprotects its
+                   pages; it is released with backing_free as
+                   SOURCE_PAGES
+ * Failure output: NULL
+ */
+uint32_t *backing_reserve(size_t num_words)
+{
+    /* Released as SOURCE_PAGES, so sized as map_lazy's are;
+     * MAP_NORESERVE because most of it may never be made accessible */
+    void *region = mmap(NULL, mapping_size(num_words, false), PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    return region == MAP_FAILED ? NULL : region;
+}
+
+/* unmap_batch
+ * Purpose: unmaps every mapping in a list and frees the list
+ * Parameters: a Reclaim pointer
+ * Returns: Nothing
+ *
+ * Expected input: a list taken from pending, or NULL
+ * Success output: none
+ * Failure output: none
+ */
+static void unmap_batch(Reclaim *batch)
+{
+    while (batch != NULL) {
+        Reclaim *next = batch->next;
+
+        munmap(batch->region, batch->bytes);
+        free(batch);
+        batch = next;
+    }
+}
+
+/* reclaimer_main
+ * Purpose: the body of the reclaimer thread
+ * Parameters: a void pointer
+ * Returns: NULL
+ *
+ * Expected input: an unused argument
+ * Success output: none (sleeps until mappings are pending, unmaps all of
+                   them as one batch, and repeats until stopped with
+                   nothing left pending)
+ * Failure output: none
+ */
+static void *reclaimer_main(void *unused)
+{
+    (void)unused;
+
+    pthread_mutex_lock(&reclaim_lock);
+    for (;;) {
+        while (__atomic_load_n(&pending, __ATOMIC_ACQUIRE) == NULL
+               && !reclaim_stopping) {
+            pthread_cond_wait(&reclaim_wake, &reclaim_lock);
+        }
+        if (__atomic_load_n(&pending, __ATOMIC_ACQUIRE) == NULL) {
+            break;
+        }
+        pthread_mutex_unlock(&reclaim_lock);
+
+        unmap_batch(__atomic_exchange_n(&pending, NULL, __ATOMIC_ACQUIRE));
+
+        pthread_mutex_lock(&reclaim_lock);
+    }
+    pthread_mutex_unlock(&reclaim_lock);
+
+    return NULL;
+}
+
+/* defer_unmap
+ * Purpose: hands a mapping to the reclaimer
+ * Parameters: a pointer and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: a mapping that is no longer used, and its size
+ * Success output: none (the mapping is unmapped soon on the reclaimer
+                   thread; the caller only pays for one push, plus a
+                   wake-up if the reclaimer was idle)
+ * Failure output: none
+ */
+static void defer_unmap(void *region, size_t bytes)
+{
+    Reclaim *node = malloc(sizeof(*node));
+
+    if (node == NULL) {
+        munmap(region, bytes);
+        return;
+    }
+
+    node->region = region;
+    node->bytes = bytes;
+    node->next = __atomic_load_n(&pending, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&pending, &node->next, node, true,
+                                        __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+    }
+
+    /* Only the push that made the list non-empty needs to wake it */
+    if (node->next == NULL) {
+        pthread_mutex_lock(&reclaim_lock);
+        pthread_cond_signal(&reclaim_wake);
+        pthread_mutex_unlock(&reclaim_lock);
+    }
+}
+
+/* reclaim_in_child
+ * Purpose: goes back to unmapping synchronously in a forked child
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: called by fork in the child, which has no reclaimer
+                   thread
+ * Success output: none (mappings still pending are unmapped now)
+ * Failure output: none
+ */
+static void reclaim_in_child()
+{
+    pthread_mutex_t unlocked = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t idle = PTHREAD_COND_INITIALIZER;
+
+    reclaim_lock = unlocked;
+    reclaim_wake = idle;
+    reclaiming = false;
+    unmap_batch(__atomic_exchange_n(&pending, NULL, __ATOMIC_ACQUIRE));
+}
+
+/* backing_reclaim_start
+ * Purpose: moves the unmapping of freed segments onto a background
+            thread
+ * Parameters: none
+ * Returns: true if the reclaimer thread is running
+ *
+ * Expected input: called once, before any UM runs
+ * Success output: true; from now on backing_free queues mapped memory
+                   for the reclaimer instead of unmapping it, and the
+                   reclaimer is stopped (after unmapping everything
+                   queued) at exit
+ * Failure output: false, with a message on stderr, if the thread cannot
+                   be started (memory is then unmapped as before)
+ */
+bool backing_reclaim_start()
+{
+    if (pthread_create(&reclaimer, NULL, reclaimer_main, NULL) != 0) {
+        fprintf(stderr, "um: cannot start the reclaimer thread\n");
+        return false;
+    }
+
+    __atomic_store_n(&reclaiming, true, __ATOMIC_RELAXED);
+    pthread_atfork(NULL, NULL, reclaim_in_child);
+    atexit(backing_reclaim_stop);
+
+    return true;
+}
+
+/* backing_reclaim_stop
+ * Purpose: stops the reclaimer thread
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none; called at exit by backing_reclaim_start, and
+                   harmless if no reclaimer is running
+ * Success output: none (everything queued has been unmapped, and memory
+                   is unmapped synchronously from now on)
+ * Failure output: none
+ */
+void backing_reclaim_stop()
+{
+    if (!reclaiming) {
+        return;
+    }
+
+    __atomic_store_n(&reclaiming, false, __ATOMIC_RELAXED);
+    pthread_mutex_lock(&reclaim_lock);
+    reclaim_stopping = true;
+    pthread_cond_signal(&reclaim_wake);
+    pthread_mutex_unlock(&reclaim_lock);
+
+    pthread_join(reclaimer, NULL);
+}
+
+/* backing_free
+ * Purpose: releases memory returned by backing_alloc or backing_reserve
+ * Parameters: a uint32_t pointer, a size_t, and a Backing_source
+ * Returns: Nothing
+ *
+ * Expected input: a pointer, word count, and source exactly as they
+                   were passed to or returned from backing_alloc
+                   (SOURCE_PAGES for backing_reserve)
+ * Success output: none (a mapping is unmapped with the size it was
+                   mapped with)
+ * Failure output: none
+ */
+void backing_free(uint32_t *words, size_t num_words, Backing_source source)
+{
+    if (source == SOURCE_HEAP) {
+        free(words);
+        return;
+    }
+
+    size_t bytes = mapping_size(num_words, source == SOURCE_HUGE_PAGES);
+
+    if (__atomic_load_n(&reclaiming, __ATOMIC_RELAXED)) {
+        defer_unmap(words, bytes);
+    } else {
+        munmap(words, bytes);
+    }
+}
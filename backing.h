@@ -0,0 +1,143 @@
+/**************************************************************
+ *
+ *                         backing.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class provides the raw memory that segments are stored in.
+ *     Small segments come from the C heap. Segment 0 and segments above
+ *     a configurable size threshold can instead be placed in 2 MB huge
+ *     pages, either transparent huge pages (madvise(MADV_HUGEPAGE)) or
+ *     hugetlbfs pages (MAP_HUGETLB). If the kernel refuses a huge page
+ *     request, the allocation silently falls back to ordinary pages.
+ *     All memory handed out by this class is zero-filled.
+ *
+ *     Any segment of BACKING_LAZY_WORDS or more is a fresh anonymous
+ *     mapping, never recycled heap memory, so it is zeroed by the kernel
+ *     a page at a time as the program first writes it. Pages the
+ *     program never writes cost no memory and read as zero, which makes
+ *     mapping even a 2^30-word segment take constant time. Freeing such
+ *     a segment returns its pages to the kernel at once, or, once
+ *     backing_reclaim_start has been called, soon after on a reclaimer
+ *     thread, so that the munmap and the TLB shootdown it causes are
+ *     off the interpreter's path and unmapping a segment of any size
+ *     costs the interpreter the same.
+ *
+ **************************************************************/
+#ifndef BACKING_INCLUDED
+#define BACKING_INCLUDED
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum Backing_mode {
+        BACKING_HEAP = 0, BACKING_THP, BACKING_HUGETLB
+} Backing_mode;
+
+/* Where a segment's memory came from, which decides how it is freed */
+typedef enum Backing_source {
+        SOURCE_HEAP = 0,        /* malloc'd */
+        SOURCE_PAGES,           /* mapped, in whole ordinary pages */
+        SOURCE_HUGE_PAGES       /* mapped, in whole 2 MB huge pages */
+} Backing_source;
+
+/* Segments of at least this many words go in huge pages by default */
+#define BACKING_DEFAULT_THRESHOLD (1 << 18)
+
+/* Segments of at least this many words that are not put in huge pages
+ * are mapped directly rather than taken from the heap */
+#define BACKING_LAZY_WORDS (1 << 16)
+
+/* backing_configure
+ * Purpose: selects where large segments are placed
+ * Parameters: a Backing_mode, a threshold in words, and a bool
+ * Returns: Nothing
+ *
+ * Expected input: the mode to use for large segments, the smallest
+                   segment size (in words) that counts as large, and
+                   whether huge mappings should be first-touched by the
+                   calling thread so that their pages land on its NUMA
+                   node
+ * Success output: none
+ * Failure output: none
+ */
+void backing_configure(Backing_mode mode, size_t threshold,
+                       bool first_touch);
+
+/* backing_alloc
+ * Purpose: allocates zero-filled memory for a segment
+ * Parameters: a size_t, a bool, and a Backing_source pointer
+ * Returns: a pointer to the first word of the memory
+ *
+ * Expected input: the number of words to allocate, whether the segment
+                   should be treated as large regardless of its size (as
+                   segment 0 is), and a pointer that is set to where the
+                   memory came from
+ * Success output: a pointer to num_words zeroed words
+ * Failure output: exits the program if no memory is available
+ */
+uint32_t *backing_alloc(size_t num_words, bool always_large,
+                        Backing_source *source);
+
+/* backing_reserve
+ * Purpose: maps memory for a segment whose pages the caller fills in
+            later, one at a time
+ * Parameters: a size_t
+ * Returns: a pointer to the first word of the memory, or NULL
+ *
+ * Expected input: the number of words to reserve
+ * Success output: a page-aligned mapping of num_words words that cannot
+                   be read or written until the caller mprotects its
+                   pages; it is released with backing_free as
+                   SOURCE_PAGES
+ * Failure output: NULL
+ */
+uint32_t *backing_reserve(size_t num_words);
+
+/* backing_reclaim_start
+ * Purpose: moves the unmapping of freed segments onto a background
+            thread
+ * Parameters: none
+ * Returns: true if the reclaimer thread is running
+ *
+ * Expected input: called once, before any UM runs
+ * Success output: true; from now on backing_free queues mapped memory
+                   for the reclaimer instead of unmapping it, and the
+                   reclaimer is stopped (after unmapping everything
+                   queued) at exit
+ * Failure output: false, with a message on stderr, if the thread cannot
+                   be started (memory is then unmapped as before)
+ */
+bool backing_reclaim_start();
+
+/* backing_reclaim_stop
+ * Purpose: stops the reclaimer thread
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none; called at exit by backing_reclaim_start, and
+                   harmless if no reclaimer is running
+ * Success output: none (everything queued has been unmapped, and memory
+                   is unmapped synchronously from now on)
+ * Failure output: none
+ */
+void backing_reclaim_stop();
+
+/* backing_free
+ * Purpose: releases memory returned by backing_alloc or backing_reserve
+ * Parameters: a uint32_t pointer, a size_t, and a Backing_source
+ * Returns: Nothing
+ *
+ * Expected input: a pointer, word count, and source exactly as they
+                   were passed to or returned from backing_alloc
+                   (SOURCE_PAGES for backing_reserve)
+ * Success output: none (a mapping is unmapped with the size it was
+                   mapped with)
+ * Failure output: none
+ */
+void backing_free(uint32_t *words, size_t num_words, Backing_source source);
+
+#endif
@@ -1,9 +1,9 @@
+#include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include "bitpack.h"
-#include "except.h"
-#include "assert.h"
 
 /* 
  * What makes things hellish is that C does not define the effects of
@@ -13,7 +13,14 @@
  * that can shift by 64 bits.
  */
 
-Except_T Bitpack_Overflow = { "Overflow packing bits" };
+/*
+ * Stands in for RAISE(Bitpack_Overflow), which nothing here catches
+ */
+static void overflow(void)
+{
+        fprintf(stderr, "Overflow packing bits\n");
+        abort();
+}
 
 static inline uint64_t shl(uint64_t word, unsigned bits)
 {
@@ -99,7 +106,7 @@ uint64_t Bitpack_newu(uint64_t word, unsigned width, unsigned lsb,
         unsigned hi = lsb + width; /* one beyond the most significant bit */
         assert(hi <= 64);
         if (!Bitpack_fitsu(value, width))
-                RAISE(Bitpack_Overflow);
+                overflow();
         return shl(shr(word, hi), hi)                 /* high part */
                 | shr(shl(word, 64 - lsb), 64 - lsb)  /* low part  */
                 | (value << lsb);                     /* new part  */
@@ -110,7 +117,7 @@ uint64_t Bitpack_news(uint64_t word, unsigned width, unsigned lsb,
 {
         assert(width <= 64);
         if (!Bitpack_fitss(value, width))
-                RAISE(Bitpack_Overflow);
+                overflow();
         /* thanks to Michael Sackman and Gilad Gray */
         return Bitpack_newu(word, width, lsb, Bitpack_getu(value, width, 0));
 }
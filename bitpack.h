@@ -0,0 +1,33 @@
+/**************************************************************
+ *
+ *                         bitpack.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     The Bitpack interface from the course, so that the UM builds
+ *     without the course's include directory: functions that test
+ *     whether values fit in a field, and read and write fields of a
+ *     64-bit word. A value too wide for its field is a checked runtime
+ *     error; where the course's version raises Bitpack_Overflow, this
+ *     one prints its message and aborts, as an uncaught exception
+ *     would.
+ *
+ **************************************************************/
+#ifndef BITPACK_INCLUDED
+#define BITPACK_INCLUDED
+#include <stdbool.h>
+#include <stdint.h>
+
+bool Bitpack_fitsu(uint64_t n, unsigned width);
+bool Bitpack_fitss(int64_t n, unsigned width);
+uint64_t Bitpack_getu(uint64_t word, unsigned width, unsigned lsb);
+int64_t Bitpack_gets(uint64_t word, unsigned width, unsigned lsb);
+uint64_t Bitpack_newu(uint64_t word, unsigned width, unsigned lsb,
+                      uint64_t value);
+uint64_t Bitpack_news(uint64_t word, unsigned width, unsigned lsb,
+                      int64_t value);
+
+#endif
@@ -0,0 +1,288 @@
+/**************************************************************
+ *
+ *                         clone.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the clone class.
+ *
+ **************************************************************/
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "clone.h"
+#include "device.h"
+#include "instruction.h"
+
+#define OUTPUT_SUFFIX ".out"
+
+static int fan_out_inputs = 0;
+static char **fan_out_paths = NULL;
+static int fan_out_jobs = 1;
+static Device prefix_output = NULL;     /* output before the first IN */
+static bool is_clone = false;
+
+static Device clone_input = NULL;
+static Device clone_output = NULL;
+
+/* clone_vm
+ * Purpose: clones the running UM
+ * Parameters: none
+ * Returns: the clone's process id in the original, 0 in the clone,
+            or -1
+ *
+ * Expected input: a process whose only thread is running the UM
+ * Success output: as for fork(); buffered stdio output is written
+                   first so that neither process repeats it
+ * Failure output: -1 with errno set if the process cannot be forked
+ */
+pid_t clone_vm()
+{
+    fflush(NULL);
+    return fork();
+}
+
+/* output_path
+ * Purpose: names the output file for an input file
+ * Parameters: a string
+ * Returns: a newly allocated string
+ *
+ * Expected input: the path of an input file
+ * Success output: the path with OUTPUT_SUFFIX appended; the caller
+                   frees it
+ * Failure output: none
+ */
+static char *output_path(const char *input_path)
+{
+    char *path = malloc(strlen(input_path) + sizeof(OUTPUT_SUFFIX));
+    assert(path != NULL);
+
+    strcpy(path, input_path);
+    strcat(path, OUTPUT_SUFFIX);
+    return path;
+}
+
+/* open_output
+ * Purpose: creates an output file holding the output written so far
+ * Parameters: a string
+ * Returns: the output file's Device, or NULL
+ *
+ * Expected input: the path of an input file
+ * Success output: a Device for the matching output file, which already
+                   holds everything in prefix_output
+ * Failure output: NULL, with a message on stderr
+ */
+static Device open_output(const char *input_path)
+{
+    char *path = output_path(input_path);
+    Device output = device_output_file(path);
+    free(path);
+
+    if (output != NULL) {
+        size_t length;
+        const unsigned char *prefix = device_contents(prefix_output,
+                                                      &length);
+        device_write(output, prefix, length);
+    }
+
+    return output;
+}
+
+/* clone_close
+ * Purpose: releases a clone's devices as it exits
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: registered with atexit in a clone
+ * Success output: none (the output file is cut to the length written)
+ * Failure output: none
+ */
+static void clone_close()
+{
+    bind_devices(NULL, NULL);
+
+    if (clone_output != NULL) {
+        device_free(&clone_output);
+    }
+    if (clone_input != NULL) {
+        device_free(&clone_input);
+    }
+}
+
+/* become_clone
+ * Purpose: gives a newly forked clone its own input and output
+ * Parameters: a string
+ * Returns: Nothing
+ *
+ * Expected input: the input file for this clone, in the clone
+ * Success output: none (the UM reads the file and writes its output
+                   file from now on)
+ * Failure output: exits the clone if either file cannot be opened
+ */
+static void become_clone(const char *input_path)
+{
+    is_clone = true;
+
+    clone_input = device_input_file(input_path);
+    clone_output = clone_input != NULL ? open_output(input_path) : NULL;
+    device_free(&prefix_output);
+
+    if (clone_input == NULL || clone_output == NULL) {
+        exit(1);
+    }
+
+    bind_devices(clone_input, clone_output);
+    atexit(clone_close);
+}
+
+/* reap
+ * Purpose: waits for a clone to finish and reports it if it failed
+ * Parameters: an array of pids and an int
+ * Returns: true if the clone exited with status 0
+ *
+ * Expected input: the pid of each clone started, indexed like
+                   fan_out_paths, and how many were started
+ * Success output: true
+ * Failure output: false, with the clone's input file on stderr
+ */
+static bool reap(pid_t *pids, int started)
+{
+    int status;
+    pid_t pid;
+
+    do {
+        pid = wait(&status);
+    } while (pid < 0 && errno == EINTR);
+
+    for (int i = 0; i < started; i++) {
+        if (pids[i] == pid) {
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+                return true;
+            }
+            fprintf(stderr, "um: %s: UM failed\n", fan_out_paths[i]);
+            return false;
+        }
+    }
+
+    return false;
+}
+
+/* fan_out
+ * Purpose: clones the UM once per input file and waits for the clones
+ * Parameters: a uint32_t
+ * Returns: Nothing in a clone; never returns in the original
+ *
+ * Expected input: the address of the UM's first IN, just before it runs
+ * Success output: in a clone, none (it carries on with its own input);
+                   the original exits with status 0 if every clone did
+ * Failure output: the original exits with status 1 if any clone failed
+                   or could not be started
+ */
+static void fan_out(uint32_t prog_counter)
+{
+    pid_t *pids = calloc(fan_out_inputs, sizeof(pid_t));
+    int running = 0;
+    bool all_ok = true;
+
+    assert(pids != NULL);
+    (void)prog_counter;
+
+    for (int i = 0; i < fan_out_inputs; i++) {
+        if (running == fan_out_jobs) {
+            all_ok = reap(pids, i) && all_ok;
+            running--;
+        }
+
+        pids[i] = clone_vm();
+
+        if (pids[i] == 0) {
+            free(pids);
+            become_clone(fan_out_paths[i]);
+            return;
+        }
+        if (pids[i] < 0) {
+            fprintf(stderr, "um: %s: cannot clone UM: %s\n",
+                    fan_out_paths[i], strerror(errno));
+            all_ok = false;
+            continue;
+        }
+        running++;
+    }
+
+    while (running > 0) {
+        all_ok = reap(pids, fan_out_inputs) && all_ok;
+        running--;
+    }
+
+    free(pids);
+    exit(all_ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/* clone_fan_out
+ * Purpose: arranges for the calling thread's UM to be cloned once per
+            input file when it first executes IN
+ * Parameters: an int, an array of strings, and an int
+ * Returns: Nothing
+ *
+ * Expected input: the number of input files, their paths, and the most
+                   clones to run at once; called before the program runs
+ * Success output: none (output from now on is held in memory; at the
+                   first IN the original waits for the clones and exits
+                   with status 1 if any failed, 0 otherwise, while each
+                   clone carries on reading its own input file)
+ * Failure output: none
+ */
+void clone_fan_out(int num_inputs, char *input_paths[], int jobs)
+{
+    fan_out_inputs = num_inputs;
+    fan_out_paths = input_paths;
+    fan_out_jobs = jobs > 0 ? jobs : 1;
+
+    prefix_output = device_memory(NULL, 0);
+    bind_devices(NULL, prefix_output);
+    hook_input(fan_out);
+}
+
+/* clone_finish
+ * Purpose: completes a fan-out for a program that halted without
+            reading any input
+ * Parameters: none
+ * Returns: true if every output file could be written
+ *
+ * Expected input: called after the program halts
+ * Success output: true; if the program never executed IN, every output
+                   file holds everything the program wrote; a clone does
+                   nothing here
+ * Failure output: false, with a message on stderr
+ */
+bool clone_finish()
+{
+    bool all_ok = true;
+
+    if (is_clone || prefix_output == NULL) {
+        return true;
+    }
+
+    bind_devices(NULL, NULL);
+
+    for (int i = 0; i < fan_out_inputs; i++) {
+        Device output = open_output(fan_out_paths[i]);
+
+        if (output == NULL) {
+            all_ok = false;
+        } else {
+            device_free(&output);
+        }
+    }
+
+    device_free(&prefix_output);
+    return all_ok;
+}
@@ -0,0 +1,71 @@
+/**************************************************************
+ *
+ *                         clone.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class clones a running UM with fork(), so the clone starts
+ *     with the same registers, program counter, segments and decoded
+ *     stream, and the kernel shares their pages copy-on-write until one
+ *     side writes to them. Its driver runs a program once up to its
+ *     first IN and then fans it out: one clone per input file, each
+ *     reading that file and writing what the program outputs to the
+ *     file's name with ".out" appended. Output the program wrote before
+ *     its first IN is held in memory and starts every clone's output.
+ *
+ *     Cloning is only safe while the UM is the process's only thread,
+ *     so it cannot be combined with --async-io or --pipeline.
+ *
+ **************************************************************/
+#ifndef CLONE_INCLUDED
+#define CLONE_INCLUDED
+#include <stdbool.h>
+#include <sys/types.h>
+
+/* clone_vm
+ * Purpose: clones the running UM
+ * Parameters: none
+ * Returns: the clone's process id in the original, 0 in the clone,
+            or -1
+ *
+ * Expected input: a process whose only thread is running the UM
+ * Success output: as for fork(); buffered stdio output is written
+                   first so that neither process repeats it
+ * Failure output: -1 with errno set if the process cannot be forked
+ */
+pid_t clone_vm();
+
+/* clone_fan_out
+ * Purpose: arranges for the calling thread's UM to be cloned once per
+            input file when it first executes IN
+ * Parameters: an int, an array of strings, and an int
+ * Returns: Nothing
+ *
+ * Expected input: the number of input files, their paths, and the most
+                   clones to run at once; called before the program runs
+ * Success output: none (output from now on is held in memory; at the
+                   first IN the original waits for the clones and exits
+                   with status 1 if any failed, 0 otherwise, while each
+                   clone carries on reading its own input file)
+ * Failure output: none
+ */
+void clone_fan_out(int num_inputs, char *input_paths[], int jobs);
+
+/* clone_finish
+ * Purpose: completes a fan-out for a program that halted without
+            reading any input
+ * Parameters: none
+ * Returns: true if every output file could be written
+ *
+ * Expected input: called after the program halts
+ * Success output: true; if the program never executed IN, every output
+                   file holds everything the program wrote; a clone does
+                   nothing here
+ * Failure output: false, with a message on stderr
+ */
+bool clone_finish();
+
+#endif
@@ -0,0 +1,512 @@
+/**************************************************************
+ *
+ *                         console.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the console class.
+ *
+ **************************************************************/
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "console.h"
+#include "device.h"
+#include "ring.h"
+
+#define REPLAY_MAGIC "UMREPLAY 1\n"
+#define REPLAY_ESCAPE 0xff
+#define REPLAY_EOF 0x00
+
+#define RING_SIZE (1 << 16)
+#define RING_MASK (RING_SIZE - 1)
+
+static Ring out_ring = RING_INITIALIZER;
+static unsigned char out_data[RING_SIZE];
+static pthread_t writer;
+static bool async_output = false;
+
+static Ring in_ring = RING_INITIALIZER;
+static int16_t in_data[RING_SIZE];      /* bytes, or EOF */
+static bool async_input = false;
+
+static Device input_device = NULL;     /* stdin unless bound */
+static Device output_device = NULL;    /* stdout unless bound */
+static bool input_bound = false;
+
+static FILE *record_log = NULL;
+
+static const unsigned char *replay_base = NULL;
+static const unsigned char *replay_next = NULL;
+static const unsigned char *replay_end = NULL;
+static size_t replay_size = 0;
+
+/* console_record
+ * Purpose: starts logging every input byte the program consumes
+ * Parameters: a string
+ * Returns: true if the log could be created
+ *
+ * Expected input: the path of the log to write
+ * Success output: true
+ * Failure output: false, with a message on stderr
+ */
+bool console_record(const char *path)
+{
+    record_log = fopen(path, "wb");
+    if (record_log == NULL) {
+        fprintf(stderr, "um: cannot create replay log %s\n", path);
+        return false;
+    }
+
+    fputs(REPLAY_MAGIC, record_log);
+    return true;
+}
+
+/* console_replay
+ * Purpose: makes input come from a replay log instead of stdin
+ * Parameters: a string
+ * Returns: true if the log could be mapped
+ *
+ * Expected input: the path of a log written by console_record
+ * Success output: true; the log is memory mapped, so replaying it does
+                   no I/O
+ * Failure output: false, with a message on stderr
+ */
+bool console_replay(const char *path)
+{
+    size_t magic_length = strlen(REPLAY_MAGIC);
+    struct stat buf;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &buf) != 0
+        || (size_t)buf.st_size < magic_length) {
+        fprintf(stderr, "um: cannot read replay log %s\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    replay_size = buf.st_size;
+    void *base = mmap(NULL, replay_size, PROT_READ, MAP_PRIVATE
+#ifdef MAP_POPULATE
+                      | MAP_POPULATE
+#endif
+                      , fd, 0);
+    close(fd);
+
+    if (base == MAP_FAILED
+        || memcmp(base, REPLAY_MAGIC, magic_length) != 0) {
+        fprintf(stderr, "um: %s is not a replay log\n", path);
+        if (base != MAP_FAILED) {
+            munmap(base, replay_size);
+        }
+        return false;
+    }
+
+    replay_base = base;
+    replay_next = replay_base + magic_length;
+    replay_end = replay_base + replay_size;
+    return true;
+}
+
+/* replay_getc
+ * Purpose: reads the next input event from the replay log
+ * Parameters: none
+ * Returns: the byte, or EOF
+ *
+ * Expected input: a mapped replay log
+ * Success output: the next logged byte or end of file
+ * Failure output: EOF once the log is used up
+ */
+static int replay_getc()
+{
+    if (replay_next >= replay_end) {
+        return EOF;
+    }
+
+    int c = *replay_next++;
+    if (c != REPLAY_ESCAPE) {
+        return c;
+    }
+
+    if (replay_next >= replay_end) {
+        return EOF;
+    }
+    return *replay_next++ == REPLAY_EOF ? EOF : REPLAY_ESCAPE;
+}
+
+/* console_input
+ * Purpose: gives the device that input comes from
+ * Parameters: none
+ * Returns: a Device
+ *
+ * Expected input: none
+ * Success output: the bound input device, or one reading stdin
+ * Failure output: none
+ */
+static inline Device console_input()
+{
+    if (input_device == NULL) {
+        input_device = device_stdio(stdin);
+    }
+    return input_device;
+}
+
+/* console_output
+ * Purpose: gives the device that output goes to
+ * Parameters: none
+ * Returns: a Device
+ *
+ * Expected input: none
+ * Success output: the bound output device, or one writing stdout
+ * Failure output: none
+ */
+static inline Device console_output()
+{
+    if (output_device == NULL) {
+        output_device = device_stdio(stdout);
+    }
+    return output_device;
+}
+
+/* console_bind
+ * Purpose: connects IN and OUT to devices other than stdin and stdout
+ * Parameters: two Devices
+ * Returns: Nothing
+ *
+ * Expected input: the device to read input from and the device to write
+                   output to, either of which may be NULL to keep the
+                   default; called before console_async and before the
+                   program runs
+ * Success output: none (the console owns the devices from now on and
+                   frees them in console_close, which also runs at exit)
+ * Failure output: none
+ */
+void console_bind(Device input, Device output)
+{
+    if (input != NULL) {
+        input_device = input;
+        input_bound = true;
+    }
+    if (output != NULL) {
+        output_device = output;
+    }
+
+    /* The UM fails with exit(1); an output file must still be cut to
+     * the length written */
+    atexit(console_close);
+}
+
+/* writer_main
+ * Purpose: drains the output ring to the output device until it is
+            closed and empty
+ * Parameters: an unused pointer
+ * Returns: NULL
+ *
+ * Expected input: none
+ * Success output: none (all output is written)
+ * Failure output: output is discarded if the device stops accepting it
+ */
+static void *writer_main(void *unused)
+{
+    Device output = console_output();
+    bool unflushed = false;
+
+    (void)unused;
+
+    for (;;) {
+        uint32_t head = out_ring.head;
+        uint32_t tail = __atomic_load_n(&out_ring.tail, __ATOMIC_ACQUIRE);
+
+        if (head == tail) {
+            if (unflushed) {
+                device_flush(output);
+                unflushed = false;
+            }
+            if (__atomic_load_n(&out_ring.closed, __ATOMIC_ACQUIRE)
+                && head == __atomic_load_n(&out_ring.tail,
+                                           __ATOMIC_ACQUIRE)) {
+                return NULL;
+            }
+            ring_wait(&out_ring, &out_ring.tail, tail);
+            continue;
+        }
+
+        /* Write everything up to the tail or the end of the buffer */
+        uint32_t start = head & RING_MASK;
+        uint32_t length = tail - head;
+        if (start + length > RING_SIZE) {
+            length = RING_SIZE - start;
+        }
+
+        device_write(output, out_data + start, length);
+        unflushed = true;
+
+        __atomic_store_n(&out_ring.head, head + length, __ATOMIC_RELEASE);
+        ring_wake(&out_ring);
+    }
+}
+
+/* in_push
+ * Purpose: adds a byte or EOF to the input ring, waiting for space
+ * Parameters: an int
+ * Returns: Nothing
+ *
+ * Expected input: a byte or EOF, on the reader thread
+ * Success output: none
+ * Failure output: none
+ */
+static void in_push(int c)
+{
+    uint32_t tail = in_ring.tail;
+    uint32_t head;
+
+    while (tail - (head = __atomic_load_n(&in_ring.head,
+                                          __ATOMIC_ACQUIRE)) == RING_SIZE) {
+        ring_wait(&in_ring, &in_ring.head, head);
+    }
+
+    in_data[tail & RING_MASK] = c;
+    __atomic_store_n(&in_ring.tail, tail + 1, __ATOMIC_RELEASE);
+    ring_wake(&in_ring);
+}
+
+/* reader_main
+ * Purpose: keeps the input ring filled from stdin
+ * Parameters: an unused pointer
+ * Returns: NULL
+ *
+ * Expected input: none
+ * Success output: none (each end of file read from stdin is passed on
+                   as EOF; at the end of a pipe or file the ring is
+                   closed, while a terminal is read again)
+ * Failure output: a read error is treated as end of file
+ */
+static void *reader_main(void *unused)
+{
+    unsigned char buffer[4096];
+    Device input = console_input();
+    bool terminal = !input_bound && isatty(STDIN_FILENO);
+
+    (void)unused;
+
+    for (;;) {
+        size_t length = device_read(input, buffer, sizeof(buffer));
+
+        if (length == 0) {
+            in_push(EOF);
+            if (!terminal) {
+                break;
+            }
+            continue;
+        }
+
+        for (size_t i = 0; i < length; i++) {
+            in_push(buffer[i]);
+        }
+    }
+
+    ring_close(&in_ring);
+    return NULL;
+}
+
+/* ring_getc
+ * Purpose: takes the next byte or EOF from the input ring
+ * Parameters: none
+ * Returns: the byte, or EOF
+ *
+ * Expected input: a running reader thread
+ * Success output: the next input event; EOF forever once the reader
+                   has closed the ring and it is empty
+ * Failure output: none
+ */
+static int ring_getc()
+{
+    uint32_t head = in_ring.head;
+    uint32_t tail;
+
+    while (head == (tail = __atomic_load_n(&in_ring.tail,
+                                           __ATOMIC_ACQUIRE))) {
+        if (__atomic_load_n(&in_ring.closed, __ATOMIC_ACQUIRE)
+            && head == __atomic_load_n(&in_ring.tail, __ATOMIC_ACQUIRE)) {
+            return EOF;
+        }
+        ring_wait(&in_ring, &in_ring.tail, tail);
+    }
+
+    int c = in_data[head & RING_MASK];
+    __atomic_store_n(&in_ring.head, head + 1, __ATOMIC_RELEASE);
+    ring_wake(&in_ring);
+
+    return c;
+}
+
+/* ring_putc
+ * Purpose: adds a byte to the output ring, waiting for space
+ * Parameters: an int
+ * Returns: Nothing
+ *
+ * Expected input: a byte, on the interpreter thread
+ * Success output: none
+ * Failure output: none
+ */
+static inline void ring_putc(int c)
+{
+    uint32_t tail = out_ring.tail;
+    uint32_t head;
+
+    while (tail - (head = __atomic_load_n(&out_ring.head,
+                                          __ATOMIC_ACQUIRE)) == RING_SIZE) {
+        ring_wait(&out_ring, &out_ring.head, head);
+    }
+
+    out_data[tail & RING_MASK] = c;
+    __atomic_store_n(&out_ring.tail, tail + 1, __ATOMIC_RELEASE);
+    ring_wake(&out_ring);
+}
+
+/* console_async
+ * Purpose: moves console I/O onto a writer thread and a reader thread
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: called once, before the program runs and after any
+                   console_replay
+ * Success output: none (output is written, and unless a log is being
+                   replayed stdin is read, by background threads; output
+                   still pending at exit is written before the process
+                   ends)
+ * Failure output: exits the program if the threads cannot be started
+ */
+void console_async()
+{
+    pthread_t reader;
+
+    device_flush(console_output());
+
+    if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    async_output = true;
+
+    /* The UM fails with exit(1); output it wrote must still appear */
+    atexit(console_close);
+
+    if (replay_base == NULL) {
+        if (pthread_create(&reader, NULL, reader_main, NULL) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        pthread_detach(reader);
+        async_input = true;
+    }
+}
+
+/* console_getc
+ * Purpose: reads the next input byte
+ * Parameters: none
+ * Returns: the byte, or EOF
+ *
+ * Expected input: none
+ * Success output: the next byte from the input device (stdin unless
+                   one is bound) or the replay log; a replay
+                   that runs past the end of its log reads EOF
+ * Failure output: none
+ */
+int console_getc()
+{
+    if (replay_base != NULL) {
+        return replay_getc();
+    }
+
+    int c = async_input ? ring_getc() : device_getc(console_input());
+
+    if (record_log != NULL) {
+        if (c == EOF) {
+            putc(REPLAY_ESCAPE, record_log);
+            putc(REPLAY_EOF, record_log);
+        } else {
+            putc(c, record_log);
+            if (c == REPLAY_ESCAPE) {
+                putc(REPLAY_ESCAPE, record_log);
+            }
+        }
+
+        /* A session killed by a signal (Ctrl-C at the terminal, or
+         * abort on a failed assertion) never flushes stdio; flushing at
+         * line ends keeps all but the last partial line of the log */
+        if (c == EOF || c == '\n') {
+            fflush(record_log);
+        }
+    }
+
+    return c;
+}
+
+/* console_putc
+ * Purpose: writes an output byte
+ * Parameters: an int
+ * Returns: Nothing
+ *
+ * Expected input: a value between 0 and 255
+ * Success output: none (the byte is written to the output device,
+                   stdout unless one is bound)
+ * Failure output: none
+ */
+void console_putc(int c)
+{
+    if (async_output) {
+        ring_putc(c);
+    } else {
+        device_putc(console_output(), c);
+    }
+}
+
+/* console_close
+ * Purpose: writes any output still queued, frees the devices, flushes
+            the log and releases the replay mapping
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none
+ * Success output: none
+ * Failure output: none
+ */
+void console_close()
+{
+    if (async_output) {
+        async_output = false;
+        ring_close(&out_ring);
+        pthread_join(writer, NULL);
+    }
+
+    if (output_device != NULL) {
+        device_free(&output_device);
+    }
+
+    /* The reader thread may still be waiting on the input device, so
+     * that is left for the process's exit to reclaim */
+    if (input_device != NULL && !async_input) {
+        device_free(&input_device);
+    }
+
+    if (record_log != NULL) {
+        fclose(record_log);
+        record_log = NULL;
+    }
+
+    if (replay_base != NULL) {
+        munmap((void *)replay_base, replay_size);
+        replay_base = replay_next = replay_end = NULL;
+        replay_size = 0;
+    }
+}
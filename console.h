@@ -0,0 +1,129 @@
+/**************************************************************
+ *
+ *                         console.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class is the UM's console: every byte read by the IN
+ *     instruction and written by OUT goes through it. By default it
+ *     uses stdin and stdout, but console_bind can connect it to any
+ *     other pair of devices from device.h instead. It can also record
+ *     the input a program consumes, including where it saw end of file,
+ *     into a replay log, and later feed that log back in place of
+ *     stdin, so that a session can be re-run exactly without a terminal
+ *     or pipe.
+ *
+ *     With console_async, output is handed to a writer thread through a
+ *     lock-free single-producer/single-consumer ring and written with
+ *     large write(2) calls, and a reader thread keeps an input ring
+ *     filled from stdin, so the interpreter never blocks on a slow pipe
+ *     or disk unless a ring is full (output) or empty (input).
+ *
+ *     A replay log starts with the line "UMREPLAY 1". Every byte after
+ *     it is an input byte, except that 0xff is an escape: 0xff 0xff is
+ *     the byte 0xff and 0xff 0x00 is an end of file. A program may see
+ *     end of file more than once (a terminal user can type Ctrl-D and
+ *     carry on), so each one is logged where it happened.
+ *
+ **************************************************************/
+#ifndef CONSOLE_INCLUDED
+#define CONSOLE_INCLUDED
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "device.h"
+
+/* console_record
+ * Purpose: starts logging every input byte the program consumes
+ * Parameters: a string
+ * Returns: true if the log could be created
+ *
+ * Expected input: the path of the log to write
+ * Success output: true
+ * Failure output: false, with a message on stderr
+ */
+bool console_record(const char *path);
+
+/* console_replay
+ * Purpose: makes input come from a replay log instead of stdin
+ * Parameters: a string
+ * Returns: true if the log could be mapped
+ *
+ * Expected input: the path of a log written by console_record
+ * Success output: true; the log is memory mapped, so replaying it does
+                   no I/O
+ * Failure output: false, with a message on stderr
+ */
+bool console_replay(const char *path);
+
+/* console_bind
+ * Purpose: connects IN and OUT to devices other than stdin and stdout
+ * Parameters: two Devices
+ * Returns: Nothing
+ *
+ * Expected input: the device to read input from and the device to write
+                   output to, either of which may be NULL to keep the
+                   default; called before console_async and before the
+                   program runs
+ * Success output: none (the console owns the devices from now on and
+                   frees them in console_close, which also runs at exit)
+ * Failure output: none
+ */
+void console_bind(Device input, Device output);
+
+/* console_async
+ * Purpose: moves console I/O onto a writer thread and a reader thread
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: called once, before the program runs and after any
+                   console_replay
+ * Success output: none (output is written, and unless a log is being
+                   replayed stdin is read, by background threads; output
+                   still pending at exit is written before the process
+                   ends)
+ * Failure output: exits the program if the threads cannot be started
+ */
+void console_async();
+
+/* console_getc
+ * Purpose: reads the next input byte
+ * Parameters: none
+ * Returns: the byte, or EOF
+ *
+ * Expected input: none
+ * Success output: the next byte from the input device (stdin unless
+                   one is bound) or the replay log; a replay
+                   that runs past the end of its log reads EOF
+ * Failure output: none
+ */
+int console_getc();
+
+/* console_putc
+ * Purpose: writes an output byte
+ * Parameters: an int
+ * Returns: Nothing
+ *
+ * Expected input: a value between 0 and 255
+ * Success output: none (the byte is written to the output device,
+                   stdout unless one is bound)
+ * Failure output: none
+ */
+void console_putc(int c);
+
+/* console_close
+ * Purpose: writes any output still queued, frees the devices, flushes
+            the log and releases the replay mapping
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none
+ * Success output: none
+ * Failure output: none
+ */
+void console_close();
+
+#endif
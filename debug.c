@@ -0,0 +1,539 @@
+/**************************************************************
+ *
+ *                         debug.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the debug class.
+ *
+ **************************************************************/
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "debug.h"
+#include "decode.h"
+#include "metrics.h"
+#include "segment.h"
+
+/* Most breakpoints, and most watchpoints, at once */
+#define DEBUG_MAX_POINTS 64
+
+/* Longest command line */
+#define DEBUG_LINE 256
+
+typedef struct Watchpoint {
+        uint32_t segment_id;
+        uint32_t word_index;
+} Watchpoint;
+
+/* What the program does once the debugger is done with a stop */
+typedef enum Debug_action { DEBUG_CONTINUE, DEBUG_STEP } Debug_action;
+
+static const char *mnemonics[] = {
+        "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+        "map", "unmap", "out", "in", "loadp", "lv"
+};
+
+static FILE *commands;
+static bool interactive;        /* commands come from a terminal */
+static char last_command[DEBUG_LINE];
+
+static uint32_t breakpoints[DEBUG_MAX_POINTS];
+static int num_breakpoints;
+static Watchpoint watchpoints[DEBUG_MAX_POINTS];
+static int num_watchpoints;
+
+/* The one-off trap planted by step and by watchpoints */
+static bool stepping;
+static uint32_t step_target;
+
+/* find_breakpoint
+ * Purpose: looks up a breakpoint
+ * Parameters: a uint32_t
+ * Returns: its index in breakpoints, or -1
+ *
+ * Expected input: an address in m[0]
+ * Success output: the index, if there is a breakpoint at the address
+ * Failure output: -1 if there is none
+ */
+static int find_breakpoint(uint32_t address)
+{
+    for (int i = 0; i < num_breakpoints; i++) {
+        if (breakpoints[i] == address) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* find_watchpoint
+ * Purpose: looks up a watchpoint
+ * Parameters: 2 uint32_ts
+ * Returns: its index in watchpoints, or -1
+ *
+ * Expected input: a segment ID and a word index
+ * Success output: the index, if the word is watched
+ * Failure output: -1 if it is not
+ */
+static int find_watchpoint(uint32_t segment_id, uint32_t word_index)
+{
+    for (int i = 0; i < num_watchpoints; i++) {
+        if (watchpoints[i].segment_id == segment_id
+            && watchpoints[i].word_index == word_index) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* clear_step
+ * Purpose: removes the one-off trap, if there is one
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none
+ * Success output: none (a breakpoint at the same address stays)
+ * Failure output: none
+ */
+static void clear_step()
+{
+    if (stepping) {
+        stepping = false;
+        if (find_breakpoint(step_target) < 0) {
+            decode_trap(step_target, false);
+        }
+    }
+}
+
+/* plant_step
+ * Purpose: makes the program stop before the word at an address
+ * Parameters: a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the address
+ * Success output: none (the one-off trap moves there)
+ * Failure output: none
+ */
+static void plant_step(uint32_t address)
+{
+    clear_step();
+    stepping = true;
+    step_target = address;
+    decode_trap(address, true);
+}
+
+/* print_instruction
+ * Purpose: prints one word of m[0] in assembler syntax, as umdis does
+ * Parameters: a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: an address, which may be past the end of m[0]
+ * Success output: none (one line on stderr)
+ * Failure output: none
+ */
+static void print_instruction(uint32_t address)
+{
+    uint32_t word;
+    Um_decoded inst;
+
+    if (!segment_zero_peek(address, &word)) {
+        fprintf(stderr, "%08" PRIx32 ":  past the end of m[0]\n", address);
+        return;
+    }
+
+    decode_word(word, &inst);
+    if (inst.op > LV) {
+        fprintf(stderr, "%08" PRIx32 ":  .word 0x%08" PRIx32
+                "    ; invalid opcode\n", address, word);
+        return;
+    }
+
+    fprintf(stderr, "%08" PRIx32 ":  %-6s ", address, mnemonics[inst.op]);
+    switch (inst.op) {
+        case HALT:
+            break;
+        case LV:
+            fprintf(stderr, "r%d, %" PRIu32, inst.a, inst.value);
+            break;
+        case ACTIVATE:
+        case LOADP:
+            fprintf(stderr, "r%d, r%d", inst.b, inst.c);
+            break;
+        case INACTIVATE:
+        case OUT:
+        case IN:
+            fprintf(stderr, "r%d", inst.c);
+            break;
+        default:
+            fprintf(stderr, "r%d, r%d, r%d", inst.a, inst.b, inst.c);
+    }
+    fprintf(stderr, "\n");
+}
+
+/* parse_numbers
+ * Purpose: reads the numbers that follow a command
+ * Parameters: a string, a uint32_t array and an int
+ * Returns: how many numbers were read, or -1
+ *
+ * Expected input: the rest of a command line, where to put the numbers,
+                   and at most how many there may be
+ * Success output: the count, with the numbers stored in order
+ * Failure output: -1 if there are too many or one is not a number
+ */
+static int parse_numbers(char *text, uint32_t numbers[], int max)
+{
+    int count = 0;
+
+    for (char *token = strtok(text, " \t\n"); token != NULL;
+         token = strtok(NULL, " \t\n")) {
+        char *end;
+        unsigned long value;
+
+        errno = 0;
+        value = strtoul(token, &end, 0);
+        if (count == max || *end != '\0' || errno != 0
+            || value > UINT32_MAX) {
+            return -1;
+        }
+        numbers[count++] = value;
+    }
+
+    return count;
+}
+
+/* print_help
+ * Purpose: lists the commands
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none
+ * Success output: none (the list, on stderr)
+ * Failure output: none
+ */
+static void print_help()
+{
+    fprintf(stderr,
+            "break ADDR, delete ADDR, watch SEG OFF, unwatch SEG OFF,\n"
+            "continue, step, registers, examine SEG OFF [N],\n"
+            "list [ADDR [N]], info, quit; numbers are decimal or 0x hex\n");
+}
+
+/* print_points
+ * Purpose: lists the breakpoints and watchpoints
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none
+ * Success output: none (the list, on stderr)
+ * Failure output: none
+ */
+static void print_points()
+{
+    if (num_breakpoints == 0 && num_watchpoints == 0) {
+        fprintf(stderr, "no breakpoints or watchpoints\n");
+    }
+    for (int i = 0; i < num_breakpoints; i++) {
+        fprintf(stderr, "breakpoint at ");
+        print_instruction(breakpoints[i]);
+    }
+    for (int i = 0; i < num_watchpoints; i++) {
+        fprintf(stderr, "watchpoint on m[0x%" PRIx32 "][%" PRIu32 "]\n",
+                watchpoints[i].segment_id, watchpoints[i].word_index);
+    }
+}
+
+/* detach
+ * Purpose: lets the program run to the end once the commands run out
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none
+ * Success output: none (every breakpoint and watchpoint is removed)
+ * Failure output: none
+ */
+static void detach()
+{
+    clear_step();
+    for (int i = 0; i < num_breakpoints; i++) {
+        decode_trap(breakpoints[i], false);
+    }
+    num_breakpoints = 0;
+    num_watchpoints = 0;
+    segment_watch(NULL);
+
+    fprintf(stderr, "um: end of debugger commands; running on\n");
+}
+
+/* run_command
+ * Purpose: carries out one command
+ * Parameters: a string, a uint32_t and a Debug_action pointer
+ * Returns: true if the program should go on running
+ *
+ * Expected input: a command line, the address the program stopped at,
+                   and where to store how it should go on
+ * Success output: true, with the action stored, for continue and step;
+                   false for every other command, once it is done
+ * Failure output: false, with a message on stderr, for a command that
+                   is not understood or cannot be carried out
+ */
+static bool run_command(char *line, uint32_t here, Debug_action *action)
+{
+    char *name = strtok(line, " \t\n");
+    char *rest = strtok(NULL, "");
+    uint32_t args[3];
+    int count = parse_numbers(rest != NULL ? rest : (char *)"", args, 3);
+
+    if (name == NULL) {
+        return false;
+    }
+    if (count < 0) {
+        fprintf(stderr, "bad number; type help for the commands\n");
+        return false;
+    }
+
+    if (strcmp(name, "c") == 0 || strcmp(name, "continue") == 0) {
+        *action = DEBUG_CONTINUE;
+        return true;
+    } else if (strcmp(name, "s") == 0 || strcmp(name, "step") == 0) {
+        *action = DEBUG_STEP;
+        return true;
+    } else if ((strcmp(name, "b") == 0 || strcmp(name, "break") == 0)
+               && count == 1) {
+        if (find_breakpoint(args[0]) < 0) {
+            if (num_breakpoints == DEBUG_MAX_POINTS) {
+                fprintf(stderr, "too many breakpoints\n");
+                return false;
+            }
+            breakpoints[num_breakpoints++] = args[0];
+            decode_trap(args[0], true);
+        }
+    } else if ((strcmp(name, "d") == 0 || strcmp(name, "delete") == 0)
+               && count == 1) {
+        int i = find_breakpoint(args[0]);
+
+        if (i < 0) {
+            fprintf(stderr, "no breakpoint at %08" PRIx32 "\n", args[0]);
+            return false;
+        }
+        breakpoints[i] = breakpoints[--num_breakpoints];
+        if (!stepping || step_target != args[0]) {
+            decode_trap(args[0], false);
+        }
+    } else if ((strcmp(name, "w") == 0 || strcmp(name, "watch") == 0)
+               && count == 2) {
+        if (find_watchpoint(args[0], args[1]) < 0) {
+            if (num_watchpoints == DEBUG_MAX_POINTS) {
+                fprintf(stderr, "too many watchpoints\n");
+                return false;
+            }
+            watchpoints[num_watchpoints].segment_id = args[0];
+            watchpoints[num_watchpoints].word_index = args[1];
+            num_watchpoints++;
+        }
+    } else if ((strcmp(name, "u") == 0 || strcmp(name, "unwatch") == 0)
+               && count == 2) {
+        int i = find_watchpoint(args[0], args[1]);
+
+        if (i < 0) {
+            fprintf(stderr, "that word is not watched\n");
+            return false;
+        }
+        watchpoints[i] = watchpoints[--num_watchpoints];
+    } else if ((strcmp(name, "r") == 0 || strcmp(name, "registers") == 0)
+               && count == 0) {
+        uint32_t registers[8];
+
+        get_registers(registers);
+        for (int r = 0; r < 8; r++) {
+            fprintf(stderr, "r%d  0x%08" PRIx32 "  %" PRIu32 "\n", r,
+                    registers[r], registers[r]);
+        }
+    } else if ((strcmp(name, "x") == 0 || strcmp(name, "examine") == 0)
+               && (count == 2 || count == 3)) {
+        uint32_t n = count == 3 ? args[2] : 1;
+
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t word;
+
+            if (!segment_peek(args[0], args[1] + i, &word)) {
+                fprintf(stderr, "m[0x%" PRIx32 "][%" PRIu32 "] is not "
+                        "mapped\n", args[0], args[1] + i);
+                return false;
+            }
+            fprintf(stderr, "m[0x%" PRIx32 "][%" PRIu32 "]  0x%08" PRIx32
+                    "  %" PRIu32 "\n", args[0], args[1] + i, word, word);
+        }
+    } else if ((strcmp(name, "l") == 0 || strcmp(name, "list") == 0)
+               && count <= 2) {
+        uint32_t first = count >= 1 ? args[0] : here;
+        uint32_t n = count == 2 ? args[1] : 10;
+
+        for (uint32_t i = 0; i < n; i++) {
+            print_instruction(first + i);
+        }
+    } else if ((strcmp(name, "i") == 0 || strcmp(name, "info") == 0)
+               && count == 0) {
+        print_points();
+    } else if ((strcmp(name, "q") == 0 || strcmp(name, "quit") == 0)
+               && count == 0) {
+        exit(EXIT_FAILURE);
+    } else if (strcmp(name, "h") == 0 || strcmp(name, "help") == 0) {
+        print_help();
+    } else {
+        fprintf(stderr, "unknown command; type help for the commands\n");
+    }
+
+    return false;
+}
+
+/* command_loop
+ * Purpose: reads and carries out commands until the program should go
+            on running
+ * Parameters: a uint32_t
+ * Returns: how the program should go on
+ *
+ * Expected input: the address the program stopped at
+ * Success output: DEBUG_CONTINUE or DEBUG_STEP
+ * Failure output: DEBUG_CONTINUE, after detaching, when the commands
+                   run out
+ */
+static Debug_action command_loop(uint32_t here)
+{
+    char line[DEBUG_LINE];
+    Debug_action action;
+
+    for (;;) {
+        if (interactive) {
+            fprintf(stderr, "(umdb) ");
+        }
+        if (fgets(line, sizeof(line), commands) == NULL) {
+            detach();
+            return DEBUG_CONTINUE;
+        }
+
+        if (strspn(line, " \t\n") == strlen(line)) {
+            strcpy(line, last_command);
+        } else {
+            strcpy(last_command, line);
+        }
+
+        if (run_command(line, here, &action)) {
+            return action;
+        }
+    }
+}
+
+/* debug_trap
+ * Purpose: the handler of every trap: stops the program, then runs the
+            trapped instruction
+ * Parameters: the handler arguments
+ * Returns: Nothing
+ *
+ * Expected input: a UM_TRAP entry fetched from the decoded stream, with
+                   the program counter already past it
+ * Success output: none (the instruction in m[0] has run, and a one-off
+                   trap waits at the next one if the user stepped)
+ * Failure output: exits the program as the instruction would
+ */
+static void debug_trap(const Um_decoded *instruction,
+                       bool *continue_execution, int *prog_counter)
+{
+    uint32_t here = *prog_counter - 1;
+    bool breakpoint = find_breakpoint(here) >= 0;
+    Debug_action action = DEBUG_CONTINUE;
+    Um_decoded original;
+
+    (void)instruction;
+
+    if (breakpoint || (stepping && step_target == here)) {
+        clear_step();
+        fprintf(stderr, "%s", breakpoint ? "breakpoint: " : "");
+        print_instruction(here);
+        action = command_loop(here);
+    }
+
+    /* The trap took the word's place in the stream, so decode it again
+     * from m[0] to run it */
+    decode_word(get_word(0, here), &original);
+    if (original.handler != NULL) {
+        original.handler(&original, continue_execution, prog_counter);
+    } else {
+        decoded_reader(&original, continue_execution, prog_counter);
+    }
+
+    if (action == DEBUG_STEP) {
+        if (*continue_execution) {
+            plant_step(*prog_counter);
+        } else {
+            fprintf(stderr, "um: program halted\n");
+        }
+    }
+}
+
+/* watch_store
+ * Purpose: the segment watcher: stops the program after a store to a
+            watched word
+ * Parameters: 4 uint32_ts
+ * Returns: Nothing
+ *
+ * Expected input: called by set_word, before the store
+ * Success output: none (the store is reported on stderr, and a one-off
+                   trap waits at the next instruction, if the word is
+                   watched)
+ * Failure output: none
+ */
+static void watch_store(uint32_t segment_id, uint32_t word_index,
+                        uint32_t old_word, uint32_t new_word)
+{
+    if (find_watchpoint(segment_id, word_index) < 0) {
+        return;
+    }
+
+    uint32_t here = __atomic_load_n(&um_metrics.prog_counter,
+                                    __ATOMIC_RELAXED);
+
+    fprintf(stderr, "watchpoint: m[0x%" PRIx32 "][%" PRIu32 "] 0x%08"
+            PRIx32 " -> 0x%08" PRIx32 " by ", segment_id, word_index,
+            old_word, new_word);
+    print_instruction(here);
+    plant_step(here + 1);
+}
+
+/* debug_start
+ * Purpose: puts the UM on the calling thread under the debugger
+ * Parameters: a string and a uint32_t
+ * Returns: true if the debugger is ready
+ *
+ * Expected input: a file to read commands from, or NULL for the
+                   terminal (/dev/tty, since the program's input is
+                   usually on stdin), and the address execution starts
+                   at; called before the decoded stream is loaded
+ * Success output: true; the program stops before its first instruction
+ * Failure output: false, with the reason on stderr, if the commands
+                   cannot be opened
+ */
+bool debug_start(const char *commands_path, uint32_t prog_counter)
+{
+    const char *path = commands_path != NULL ? commands_path : "/dev/tty";
+
+    commands = fopen(path, "r");
+    if (commands == NULL) {
+        fprintf(stderr, "um: cannot read debugger commands from %s: %s\n",
+                path, strerror(errno));
+        return false;
+    }
+    interactive = isatty(fileno(commands));
+
+    decode_trap_handler(debug_trap);
+    segment_watch(watch_store);
+    plant_step(prog_counter);
+
+    return true;
+}
@@ -0,0 +1,59 @@
+/**************************************************************
+ *
+ *                         debug.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class is an interactive debugger for the UM running on the
+ *     calling thread, for the engines that run from the decoded stream
+ *     (predecode and special). It stops before the first instruction
+ *     and then reads commands, one per line:
+ *         break ADDR          stop before the word at ADDR of m[0]
+ *         delete ADDR         remove that breakpoint
+ *         watch SEG OFF       stop after any store to word OFF of SEG
+ *         unwatch SEG OFF     remove that watchpoint
+ *         continue            run until something stops the program
+ *         step                run one instruction
+ *         registers           print r0 to r7
+ *         examine SEG OFF [N] print N words of a segment (default 1)
+ *         list [ADDR [N]]     disassemble N words of m[0] (default 10,
+ *                             from where the program stopped)
+ *         info                list the breakpoints and watchpoints
+ *         quit                stop the program
+ *     Each command may be shortened to its first letter (x for
+ *     examine), numbers may be decimal or 0x hex, and an empty line
+ *     repeats the last command. At the end of the commands every
+ *     breakpoint and watchpoint is removed and the program runs on.
+ *
+ *     A breakpoint is a trap planted in the decoded stream (see
+ *     decode_trap), and single-stepping plants a one-off trap at the
+ *     next address, so the engines check nothing per instruction.
+ *     Watchpoints are told of stores by set_word (see segment_watch),
+ *     and stop the program by planting the same one-off trap after the
+ *     storing instruction.
+ *
+ **************************************************************/
+#ifndef DEBUG_INCLUDED
+#define DEBUG_INCLUDED
+#include <stdbool.h>
+#include <stdint.h>
+
+/* debug_start
+ * Purpose: puts the UM on the calling thread under the debugger
+ * Parameters: a string and a uint32_t
+ * Returns: true if the debugger is ready
+ *
+ * Expected input: a file to read commands from, or NULL for the
+                   terminal (/dev/tty, since the program's input is
+                   usually on stdin), and the address execution starts
+                   at; called before the decoded stream is loaded
+ * Success output: true; the program stops before its first instruction
+ * Failure output: false, with the reason on stderr, if the commands
+                   cannot be opened
+ */
+bool debug_start(const char *commands_path, uint32_t prog_counter);
+
+#endif
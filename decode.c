@@ -0,0 +1,691 @@
+/**************************************************************
+ *
+ *                         decode.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the decode class.
+ *
+ **************************************************************/
+#include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "decode.h"
+
+/* Words in a chunk handed to one worker at a time */
+#define DECODE_CHUNK_WORDS (1 << 16)
+
+/* Most workers one stream is decoded by */
+#define DECODE_MAX_WORKERS 16
+
+/* A stream being decoded in the background; the workers share it with
+ * the UM's thread, so the fields they update are atomic */
+typedef struct Decode_job {
+        Um_decoded *stream;     /* not yet published */
+        const uint32_t *words;
+        uint8_t *code_map;      /* a copy, or NULL */
+        uint32_t length;
+        Um_binder *binder;
+        uint32_t next_chunk;    /* atomic: the next chunk to claim */
+        uint32_t chunks_left;   /* atomic: 0 once every chunk is done */
+        bool cancelled;         /* atomic */
+        int num_workers;
+        pthread_t workers[];
+} Decode_job;
+
+/* Each UM runs on a thread of its own, so its stream is thread-local.
+ * While a job runs, stream is NULL and stream_length is 0, so that
+ * decode_fetch's bounds check sends every fetch to fetch_pending */
+static __thread Um_decoded *stream = NULL;
+static __thread const uint32_t *stream_words = NULL;
+static __thread uint32_t stream_length = 0;
+static __thread uint32_t words_length = 0;      /* of m[0] */
+static __thread Um_binder *binder = NULL;
+static __thread Decode_job *job = NULL;
+static __thread Um_decoded scratch;             /* see fetch_pending */
+
+/* Addresses to trap, one bit each, and the handler their entries get */
+static __thread uint8_t *traps = NULL;
+static __thread uint64_t traps_length = 0;     /* addresses covered */
+static __thread Um_handler *trap_handler = NULL;
+
+/* Words stored to while a job ran, to undecode once it is published */
+static __thread uint32_t *stale = NULL;
+static __thread uint32_t num_stale = 0;
+static __thread uint32_t stale_capacity = 0;
+
+static pthread_once_t fork_handler_once = PTHREAD_ONCE_INIT;
+
+/* decode_entry
+ * Purpose: unpacks an instruction word, binding it with a given binder
+ * Parameters: a Um_instruction, a Um_decoded pointer and a Um_binder
+               pointer
+ * Returns: Nothing
+ *
+ * Expected input: any 32-bit word, a pointer to fill in, and a binder
+                   or NULL; safe to call from any thread
+ * Success output: none (as decode_word)
+ * Failure output: none
+ */
+static void decode_entry(Um_instruction word, Um_decoded *decoded,
+                         Um_binder *bind)
+{
+    decoded->op = Bitpack_getu(word, 4, 28);
+
+    if (decoded->op == LV) {
+        decoded->a = Bitpack_getu(word, 3, 25);
+        decoded->b = 0;
+        decoded->c = 0;
+        decoded->value = Bitpack_getu(word, 25, 0);
+    } else {
+        decoded->a = Bitpack_getu(word, 3, 6);
+        decoded->b = Bitpack_getu(word, 3, 3);
+        decoded->c = Bitpack_getu(word, 3, 0);
+        decoded->value = 0;
+    }
+
+    decoded->handler = bind != NULL ? bind(decoded) : NULL;
+}
+
+/* decode_word
+ * Purpose: unpacks an instruction word into its opcode and operands
+ * Parameters: a Um_instruction and a Um_decoded pointer
+ * Returns: Nothing
+ *
+ * Expected input: any 32-bit word and a pointer to fill in
+ * Success output: none (the pointed-to entry holds the decoded word;
+                   LV fills a and value, every other opcode fills a, b
+                   and c; handler is filled in by the calling thread's
+                   binder, or is NULL without one)
+ * Failure output: none
+ */
+void decode_word(Um_instruction word, Um_decoded *decoded)
+{
+    decode_entry(word, decoded, binder);
+}
+
+/* decode_bind
+ * Purpose: sets how the calling thread's stream picks each entry's
+            handler
+ * Parameters: a Um_binder pointer
+ * Returns: Nothing
+ *
+ * Expected input: a binder such as select_handler, or NULL for none;
+                   called before decode_load
+ * Success output: none (every entry decoded from now on, eagerly or
+                   lazily, has the handler the binder picks for it)
+ * Failure output: none
+ */
+void decode_bind(Um_binder *bind)
+{
+    binder = bind;
+}
+
+/* decode_range
+ * Purpose: decodes part of a stream
+ * Parameters: a Um_decoded pointer, a uint32_t pointer, a uint8_t
+               pointer, a Um_binder pointer, and two uint32_ts
+ * Returns: Nothing
+ *
+ * Expected input: the stream, the words it mirrors, a code map or NULL,
+                   a binder or NULL, and the first word and one past the
+                   last word to decode
+ * Success output: none (words the map marks as data are left to be
+                   decoded when fetched)
+ * Failure output: none
+ */
+static void decode_range(Um_decoded *entries, const uint32_t *words,
+                         const uint8_t *code_map, Um_binder *bind,
+                         uint32_t first, uint32_t last)
+{
+    for (uint32_t i = first; i < last; i++) {
+        if (code_map == NULL || CODEMAP_TEST(code_map, i)) {
+            decode_entry(words[i], &entries[i], bind);
+        } else {
+            entries[i].op = UM_UNDECODED;
+        }
+    }
+}
+
+/* trap_entry
+ * Purpose: turns a stream entry into a trap if its address has one
+ * Parameters: a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: an address within the published stream, whose entry
+                   has been decoded
+ * Success output: none (the entry's opcode is UM_TRAP and its handler
+                   the trap handler, if the address is trapped)
+ * Failure output: none
+ */
+static void trap_entry(uint32_t word_index)
+{
+    if (word_index < traps_length && CODEMAP_TEST(traps, word_index)) {
+        stream[word_index].op = UM_TRAP;
+        stream[word_index].handler = trap_handler;
+    }
+}
+
+/* decode_worker
+ * Purpose: decodes chunks of a job until none are left
+ * Parameters: a void pointer to the Decode_job
+ * Returns: NULL
+ *
+ * Expected input: a job whose workers have been started
+ * Success output: none (each chunk it decodes is counted off
+                   chunks_left, with release ordering, so the thread
+                   that sees 0 sees every entry)
+ * Failure output: none
+ */
+static void *decode_worker(void *cl)
+{
+    Decode_job *job = cl;
+    uint32_t num_chunks = (job->length + DECODE_CHUNK_WORDS - 1)
+                          / DECODE_CHUNK_WORDS;
+
+    while (!__atomic_load_n(&job->cancelled, __ATOMIC_RELAXED)) {
+        uint32_t chunk = __atomic_fetch_add(&job->next_chunk, 1,
+                                            __ATOMIC_RELAXED);
+        if (chunk >= num_chunks) {
+            break;
+        }
+
+        uint32_t first = chunk * DECODE_CHUNK_WORDS;
+        uint32_t last = job->length - first < DECODE_CHUNK_WORDS
+                        ? job->length : first + DECODE_CHUNK_WORDS;
+
+        decode_range(job->stream, job->words, job->code_map, job->binder,
+                     first, last);
+        __atomic_fetch_sub(&job->chunks_left, 1, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+/* job_finish
+ * Purpose: waits for the calling thread's job, if any, and either
+            publishes its stream or throws it away
+ * Parameters: a bool
+ * Returns: Nothing
+ *
+ * Expected input: true to stop the workers early and discard the stream
+                   (m[0] has been replaced or the stream is being freed),
+                   false to wait for them and use it
+ * Success output: none (there is no job; when publishing, the stream
+                   mirrors m[0], including every store made to it while
+                   the workers ran)
+ * Failure output: none
+ */
+static void job_finish(bool cancel)
+{
+    if (job == NULL) {
+        return;
+    }
+
+    if (cancel) {
+        __atomic_store_n(&job->cancelled, true, __ATOMIC_RELAXED);
+    }
+    for (int i = 0; i < job->num_workers; i++) {
+        pthread_join(job->workers[i], NULL);
+    }
+
+    if (cancel) {
+        free(job->stream);
+    } else {
+        stream = job->stream;
+        stream_length = job->length;
+
+        /* A worker may have decoded one of these before it was stored */
+        for (uint32_t i = 0; i < num_stale; i++) {
+            stream[stale[i]].op = UM_UNDECODED;
+        }
+    }
+
+    free(stale);
+    stale = NULL;
+    num_stale = 0;
+    stale_capacity = 0;
+
+    free(job->code_map);
+    free(job);
+    job = NULL;
+}
+
+/* job_start
+ * Purpose: starts decoding a large stream on a pool of worker threads
+ * Parameters: a Um_decoded pointer, a uint32_t pointer, a uint32_t, and
+               a uint8_t pointer
+ * Returns: true if at least one worker is running
+ *
+ * Expected input: the allocated stream, the words of m[0], their number,
+                   and a code map or NULL
+ * Success output: true; the calling thread's job decodes the stream in
+                   DECODE_CHUNK_WORDS chunks, one per CPU at a time
+ * Failure output: false, with nothing started, if there is only one
+                   CPU or no worker could be created
+ */
+static bool job_start(Um_decoded *entries, const uint32_t *words,
+                      uint32_t length, const uint8_t *code_map)
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    /* On one CPU the workers would only take turns with the UM */
+    if (cpus < 2) {
+        return false;
+    }
+
+    uint32_t num_chunks = (length + DECODE_CHUNK_WORDS - 1)
+                          / DECODE_CHUNK_WORDS;
+    int num_workers = cpus > DECODE_MAX_WORKERS ? DECODE_MAX_WORKERS
+                                                : cpus;
+
+    if ((uint32_t)num_workers > num_chunks) {
+        num_workers = num_chunks;
+    }
+
+    Decode_job *new_job = calloc(1, sizeof(*new_job)
+                                    + num_workers * sizeof(pthread_t));
+    if (new_job == NULL) {
+        return false;
+    }
+
+    new_job->stream = entries;
+    new_job->words = words;
+    new_job->length = length;
+    new_job->binder = binder;
+    new_job->chunks_left = num_chunks;
+
+    /* The caller frees its map once decode_load returns */
+    if (code_map != NULL) {
+        new_job->code_map = malloc(CODEMAP_BYTES(length));
+        if (new_job->code_map == NULL) {
+            free(new_job);
+            return false;
+        }
+        memcpy(new_job->code_map, code_map, CODEMAP_BYTES(length));
+    }
+
+    for (int i = 0; i < num_workers; i++) {
+        if (pthread_create(&new_job->workers[i], NULL, decode_worker,
+                           new_job) != 0) {
+            break;
+        }
+        new_job->num_workers++;
+    }
+
+    if (new_job->num_workers == 0) {
+        free(new_job->code_map);
+        free(new_job);
+        return false;
+    }
+
+    job = new_job;
+    return true;
+}
+
+/* settle_before_fork
+ * Purpose: finishes the forking thread's job before fork, since the
+            child would have none of its workers
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: registered with pthread_atfork
+ * Success output: none (the stream, if one was being decoded, is
+                   published)
+ * Failure output: none
+ */
+static void settle_before_fork()
+{
+    job_finish(false);
+}
+
+/* register_fork_handler
+ * Purpose: registers settle_before_fork
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: called through pthread_once
+ * Success output: none
+ * Failure output: none
+ */
+static void register_fork_handler()
+{
+    pthread_atfork(settle_before_fork, NULL, NULL);
+}
+
+/* decode_load
+ * Purpose: builds the decoded stream for a newly loaded m[0]
+ * Parameters: a uint32_t pointer, a uint32_t, and a uint8_t pointer
+ * Returns: Nothing
+ *
+ * Expected input: the words of m[0], its length, and a code map, or
+                   NULL to decode every word eagerly
+ * Success output: none (the stream mirrors m[0]; for an m[0] of
+                   DECODE_PARALLEL_WORDS or more, it is decoded on worker
+                   threads and published when they are all done, and
+                   until then decode_fetch decodes each word it fetches)
+ * Failure output: exits the program if memory runs out
+ */
+void decode_load(const uint32_t *words, uint32_t length,
+                 const uint8_t *code_map)
+{
+    job_finish(true);
+    free(stream);
+    stream = malloc((length > 0 ? length : 1) * sizeof(Um_decoded));
+    if (stream == NULL) {
+        exit(1);
+    }
+
+    stream_words = words;
+    stream_length = length;
+    words_length = length;
+
+    if (length >= DECODE_PARALLEL_WORDS && trap_handler == NULL) {
+        pthread_once(&fork_handler_once, register_fork_handler);
+
+        if (job_start(stream, words, length, code_map)) {
+            stream = NULL;
+            stream_length = 0;
+            return;
+        }
+    }
+
+    decode_range(stream, words, code_map, binder, 0, length);
+
+    for (uint32_t i = 0; i < length && i < traps_length; i++) {
+        if (CODEMAP_TEST(traps, i)) {
+            decode_word(words[i], &stream[i]);
+            trap_entry(i);
+        }
+    }
+}
+
+/* decode_replace
+ * Purpose: rebuilds the decoded stream after m[0] has been replaced, if
+            a stream is in use
+ * Parameters: a uint32_t pointer and a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the words of the new m[0] and its length; called
+                   before the old m[0] is freed, since any workers still
+                   decoding it are stopped here
+ * Success output: none (the stream, if any, mirrors the new m[0])
+ * Failure output: exits the program if memory runs out
+ */
+void decode_replace(const uint32_t *words, uint32_t length)
+{
+    if (stream != NULL || job != NULL) {
+        decode_load(words, length, NULL);
+    }
+}
+
+/* fetch_pending
+ * Purpose: fetches an instruction while the stream is still being
+            decoded by the workers
+ * Parameters: a uint32_t
+ * Returns: a pointer to the decoded instruction
+ *
+ * Expected input: a program counter that decode_fetch found to be past
+                   the end of the published stream
+ * Success output: the instruction from the stream, if the workers have
+                   now finished (which publishes it), or else decoded
+                   into scratch space that is valid until the next fetch
+ * Failure output: exits the program if the index is out of bounds
+ */
+static const Um_decoded *fetch_pending(uint32_t prog_counter)
+{
+    if (job == NULL || prog_counter >= words_length) {
+        exit(1);
+    }
+
+    if (__atomic_load_n(&job->chunks_left, __ATOMIC_ACQUIRE) == 0) {
+        job_finish(false);
+        return decode_fetch(prog_counter);
+    }
+
+    decode_word(stream_words[prog_counter], &scratch);
+    return &scratch;
+}
+
+/* decode_fetch
+ * Purpose: returns the decoded instruction at the given index of m[0]
+ * Parameters: a uint32_t
+ * Returns: a pointer to the decoded instruction
+ *
+ * Expected input: a program counter
+ * Success output: the decoded instruction, decoded now if need be
+ * Failure output: exits the program if the index is out of bounds
+ */
+const Um_decoded *decode_fetch(uint32_t prog_counter)
+{
+    /* stream_length is 0 while workers are decoding */
+    if (prog_counter >= stream_length) {
+        return fetch_pending(prog_counter);
+    }
+
+    Um_decoded *decoded = &stream[prog_counter];
+
+    if (decoded->op == UM_UNDECODED) {
+        decode_word(stream_words[prog_counter], decoded);
+        trap_entry(prog_counter);
+    }
+
+    return decoded;
+}
+
+/* decode_invalidate
+ * Purpose: tells the stream that a word of m[0] has been overwritten
+ * Parameters: a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the index of the word that changed
+ * Success output: none (the word will be re-decoded when fetched)
+ * Failure output: none
+ */
+void decode_invalidate(uint32_t word_index)
+{
+    if (job != NULL && word_index < words_length) {
+        if (num_stale == stale_capacity) {
+            stale_capacity = stale_capacity == 0 ? 64 : stale_capacity * 2;
+            stale = realloc(stale, stale_capacity * sizeof(uint32_t));
+            if (stale == NULL) {
+                exit(1);
+            }
+        }
+        stale[num_stale++] = word_index;
+    } else if (stream != NULL && word_index < stream_length) {
+        stream[word_index].op = UM_UNDECODED;
+    }
+}
+
+/* decode_trap_handler
+ * Purpose: sets the handler that the calling thread's traps run
+ * Parameters: a Um_handler pointer
+ * Returns: Nothing
+ *
+ * Expected input: the handler, which is passed the trap entry (with the
+                   trapped word's operands) and must run the trapped
+                   instruction itself; called before decode_load
+ * Success output: none (streams are decoded on the calling thread from
+                   now on, so that traps are in place from the start)
+ * Failure output: none
+ */
+void decode_trap_handler(Um_handler *trap)
+{
+    trap_handler = trap;
+}
+
+/* decode_trap
+ * Purpose: plants or removes a trap at an address in m[0]
+ * Parameters: a uint32_t and a bool
+ * Returns: Nothing
+ *
+ * Expected input: any address, which may be past the end of m[0], and
+                   whether it should trap; decode_trap_handler must have
+                   been called
+ * Success output: none (fetching the address gives a UM_TRAP entry, in
+                   this m[0] and any that replaces it, until the trap is
+                   removed)
+ * Failure output: exits the program if memory runs out
+ */
+void decode_trap(uint32_t word_index, bool on)
+{
+    if (word_index >= traps_length) {
+        if (!on) {
+            return;
+        }
+
+        uint64_t length = traps_length == 0 ? 1024 : traps_length;
+
+        while (length <= word_index) {
+            length *= 2;
+        }
+
+        traps = realloc(traps, CODEMAP_BYTES(length));
+        if (traps == NULL) {
+            exit(1);
+        }
+        memset(traps + CODEMAP_BYTES(traps_length), 0,
+               CODEMAP_BYTES(length) - CODEMAP_BYTES(traps_length));
+        traps_length = length;
+    }
+
+    if (on) {
+        CODEMAP_SET(traps, word_index);
+    } else {
+        traps[word_index / 8] &= ~(1 << (word_index % 8));
+    }
+
+    /* Re-decoding the word when it is next fetched applies the change */
+    if (stream != NULL && word_index < stream_length) {
+        stream[word_index].op = UM_UNDECODED;
+    }
+}
+
+/* decode_free
+ * Purpose: frees the decoded stream and forgets the binder
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none
+ * Success output: none (the traps and their handler are forgotten too)
+ * Failure output: none
+ */
+void decode_free()
+{
+    job_finish(true);
+    free(stream);
+    stream = NULL;
+    stream_words = NULL;
+    stream_length = 0;
+    words_length = 0;
+    binder = NULL;
+
+    free(traps);
+    traps = NULL;
+    traps_length = 0;
+    trap_handler = NULL;
+}
+
+/* decode_image_hash
+ * Purpose: computes the 64-bit FNV-1a hash of a program image
+ * Parameters: a uint32_t pointer and a uint32_t
+ * Returns: the hash
+ *
+ * Expected input: the words of a program and their number
+ * Success output: a hash that identifies the image
+ * Failure output: none
+ */
+uint64_t decode_image_hash(const uint32_t *words, uint32_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+
+    for (uint32_t i = 0; i < length; i++) {
+        for (int j = 24; j >= 0; j -= 8) {
+            hash ^= (words[i] >> j) & 0xff;
+            hash *= 0x100000001b3ULL;
+        }
+    }
+
+    return hash;
+}
+
+/* codemap_write
+ * Purpose: writes a code map in the format described in decode.h
+ * Parameters: a FILE pointer, a uint8_t pointer, a uint32_t pointer,
+               and a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: an open file, a code map, and the image it describes
+ * Success output: none (the map is written to the file)
+ * Failure output: none
+ */
+void codemap_write(FILE *fp, const uint8_t *code_map,
+                   const uint32_t *words, uint32_t length)
+{
+    fprintf(fp, "umdis-map 1 %" PRIu32 " %016" PRIx64 "\n", length,
+            decode_image_hash(words, length));
+
+    uint32_t i = 0;
+    while (i < length) {
+        if (!CODEMAP_TEST(code_map, i)) {
+            i++;
+            continue;
+        }
+
+        uint32_t start = i;
+        while (i < length && CODEMAP_TEST(code_map, i)) {
+            i++;
+        }
+        fprintf(fp, "code %" PRIu32 " %" PRIu32 "\n", start, i);
+    }
+}
+
+/* codemap_read
+ * Purpose: reads a code map written by codemap_write
+ * Parameters: a string, a uint32_t pointer, and a uint32_t
+ * Returns: a newly allocated code map, or NULL
+ *
+ * Expected input: the path of a map file and the image it should match
+ * Success output: the code map; the caller frees it
+ * Failure output: NULL (with a message on stderr) if the file cannot
+                   be read or was made for a different image
+ */
+uint8_t *codemap_read(const char *path, const uint32_t *words,
+                      uint32_t length)
+{
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        fprintf(stderr, "um: cannot open code map %s\n", path);
+        return NULL;
+    }
+
+    uint32_t map_length;
+    uint64_t map_hash;
+    if (fscanf(fp, "umdis-map 1 %" SCNu32 " %" SCNx64, &map_length,
+               &map_hash) != 2
+        || map_length != length
+        || map_hash != decode_image_hash(words, length)) {
+        fprintf(stderr, "um: code map %s does not match program\n", path);
+        fclose(fp);
+        return NULL;
+    }
+
+    uint8_t *code_map = calloc(CODEMAP_BYTES(length) + 1, 1);
+    assert(code_map != NULL);
+
+    uint32_t start, end;
+    while (fscanf(fp, " code %" SCNu32 " %" SCNu32, &start, &end) == 2) {
+        for (uint32_t i = start; i < end && i < length; i++) {
+            CODEMAP_SET(code_map, i);
+        }
+    }
+
+    fclose(fp);
+    return code_map;
+}
@@ -0,0 +1,226 @@
+/**************************************************************
+ *
+ *                         decode.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class keeps a pre-decoded copy of m[0] so that an engine can
+ *     fetch an instruction's opcode and operands without unpacking the
+ *     word every time it runs. Words are decoded eagerly when a program
+ *     is loaded, except for words that a code map (written by umdis)
+ *     marks as data; those, and any word overwritten by a segmented
+ *     store, are decoded lazily the first time they are fetched. Like
+ *     m[0] itself, the stream belongs to the thread running the UM.
+ *
+ *     A large m[0], whether loaded or swapped in by LOADP, is decoded in
+ *     chunks by a pool of worker threads, one per CPU. The UM starts
+ *     running at once, decoding each word it fetches on the spot, and
+ *     switches to the stream when the last chunk is done. Stores made to
+ *     m[0] meanwhile are remembered and applied to the stream as it is
+ *     published. A LOADP that replaces m[0] stops the old workers.
+ *
+ *     A debugger can plant traps in the stream: an entry whose opcode is
+ *     UM_TRAP and whose handler is the debugger's. Traps are kept by
+ *     address, so they survive stores to m[0] and LOADP, and an engine
+ *     pays nothing for them until one is hit.
+ *
+ *     The class also owns the code map file format, so that umdis and
+ *     the UM agree on it:
+ *         umdis-map 1 <number of words> <image hash in hex>
+ *         code <first word> <one past the last word>
+ *         ...
+ *
+ **************************************************************/
+#ifndef DECODE_INCLUDED
+#define DECODE_INCLUDED
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "instruction.h"
+
+/* m[0]s of this many words or more are decoded on worker threads */
+#define DECODE_PARALLEL_WORDS (1 << 20)
+
+/* Opcode of a stream entry that has not been decoded yet */
+#define UM_UNDECODED 0xff
+
+/* Opcode of a stream entry replaced by a trap (see decode_trap) */
+#define UM_TRAP 0xfe
+
+typedef struct Um_decoded {
+        uint8_t op;
+        uint8_t a, b, c;
+        uint32_t value;         /* the 25-bit value of an LV */
+        Um_handler *handler;    /* set when a binder is in use */
+} Um_decoded;
+
+/* Picks the handler for an entry once decode_word has unpacked it */
+typedef Um_handler *Um_binder(const Um_decoded *decoded);
+
+/* Code maps are bitmaps with one bit per word of m[0] */
+#define CODEMAP_BYTES(length) (((length) + 7) / 8)
+#define CODEMAP_TEST(map, i) (((map)[(i) / 8] >> ((i) % 8)) & 1)
+#define CODEMAP_SET(map, i) ((map)[(i) / 8] |= 1 << ((i) % 8))
+
+/* decode_word
+ * Purpose: unpacks an instruction word into its opcode and operands
+ * Parameters: a Um_instruction and a Um_decoded pointer
+ * Returns: Nothing
+ *
+ * Expected input: any 32-bit word and a pointer to fill in
+ * Success output: none (the pointed-to entry holds the decoded word;
+                   LV fills a and value, every other opcode fills a, b
+                   and c; handler is filled in by the calling thread's
+                   binder, or is NULL without one)
+ * Failure output: none
+ */
+void decode_word(Um_instruction word, Um_decoded *decoded);
+
+/* decode_bind
+ * Purpose: sets how the calling thread's stream picks each entry's
+            handler
+ * Parameters: a Um_binder pointer
+ * Returns: Nothing
+ *
+ * Expected input: a binder such as select_handler, or NULL for none;
+                   called before decode_load
+ * Success output: none (every entry decoded from now on, eagerly or
+                   lazily, has the handler the binder picks for it)
+ * Failure output: none
+ */
+void decode_bind(Um_binder *bind);
+
+/* decode_load
+ * Purpose: builds the decoded stream for a newly loaded m[0]
+ * Parameters: a uint32_t pointer, a uint32_t, and a uint8_t pointer
+ * Returns: Nothing
+ *
+ * Expected input: the words of m[0], its length, and a code map, or
+                   NULL to decode every word eagerly
+ * Success output: none (the stream mirrors m[0]; for an m[0] of
+                   DECODE_PARALLEL_WORDS or more, it is decoded on worker
+                   threads and published when they are all done, and
+                   until then decode_fetch decodes each word it fetches)
+ * Failure output: exits the program if memory runs out
+ */
+void decode_load(const uint32_t *words, uint32_t length,
+                 const uint8_t *code_map);
+
+/* decode_replace
+ * Purpose: rebuilds the decoded stream after m[0] has been replaced, if
+            a stream is in use
+ * Parameters: a uint32_t pointer and a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the words of the new m[0] and its length; called
+                   before the old m[0] is freed, since any workers still
+                   decoding it are stopped here
+ * Success output: none (the stream, if any, mirrors the new m[0])
+ * Failure output: exits the program if memory runs out
+ */
+void decode_replace(const uint32_t *words, uint32_t length);
+
+/* decode_fetch
+ * Purpose: returns the decoded instruction at the given index of m[0]
+ * Parameters: a uint32_t
+ * Returns: a pointer to the decoded instruction
+ *
+ * Expected input: a program counter
+ * Success output: the decoded instruction, decoded now if need be
+ * Failure output: exits the program if the index is out of bounds
+ */
+const Um_decoded *decode_fetch(uint32_t prog_counter);
+
+/* decode_invalidate
+ * Purpose: tells the stream that a word of m[0] has been overwritten
+ * Parameters: a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the index of the word that changed
+ * Success output: none (the word will be re-decoded when fetched)
+ * Failure output: none
+ */
+void decode_invalidate(uint32_t word_index);
+
+/* decode_trap_handler
+ * Purpose: sets the handler that the calling thread's traps run
+ * Parameters: a Um_handler pointer
+ * Returns: Nothing
+ *
+ * Expected input: the handler, which is passed the trap entry (with the
+                   trapped word's operands) and must run the trapped
+                   instruction itself; called before decode_load
+ * Success output: none (streams are decoded on the calling thread from
+                   now on, so that traps are in place from the start)
+ * Failure output: none
+ */
+void decode_trap_handler(Um_handler *trap);
+
+/* decode_trap
+ * Purpose: plants or removes a trap at an address in m[0]
+ * Parameters: a uint32_t and a bool
+ * Returns: Nothing
+ *
+ * Expected input: any address, which may be past the end of m[0], and
+                   whether it should trap; decode_trap_handler must have
+                   been called
+ * Success output: none (fetching the address gives a UM_TRAP entry, in
+                   this m[0] and any that replaces it, until the trap is
+                   removed)
+ * Failure output: exits the program if memory runs out
+ */
+void decode_trap(uint32_t word_index, bool on);
+
+/* decode_free
+ * Purpose: frees the decoded stream and forgets the binder
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none
+ * Success output: none (the traps and their handler are forgotten too)
+ * Failure output: none
+ */
+void decode_free();
+
+/* decode_image_hash
+ * Purpose: computes the 64-bit FNV-1a hash of a program image
+ * Parameters: a uint32_t pointer and a uint32_t
+ * Returns: the hash
+ *
+ * Expected input: the words of a program and their number
+ * Success output: a hash that identifies the image
+ * Failure output: none
+ */
+uint64_t decode_image_hash(const uint32_t *words, uint32_t length);
+
+/* codemap_write
+ * Purpose: writes a code map in the format described above
+ * Parameters: a FILE pointer, a uint8_t pointer, a uint32_t pointer,
+               and a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: an open file, a code map, and the image it describes
+ * Success output: none (the map is written to the file)
+ * Failure output: none
+ */
+void codemap_write(FILE *fp, const uint8_t *code_map,
+                   const uint32_t *words, uint32_t length);
+
+/* codemap_read
+ * Purpose: reads a code map written by codemap_write
+ * Parameters: a string, a uint32_t pointer, and a uint32_t
+ * Returns: a newly allocated code map, or NULL
+ *
+ * Expected input: the path of a map file and the image it should match
+ * Success output: the code map; the caller frees it
+ * Failure output: NULL (with a message on stderr) if the file cannot
+                   be read or was made for a different image
+ */
+uint8_t *codemap_read(const char *path, const uint32_t *words,
+                      uint32_t length);
+
+#endif
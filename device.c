@@ -0,0 +1,849 @@
+/**************************************************************
+ *
+ *                         device.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the device class.
+ *
+ **************************************************************/
+#define _GNU_SOURCE             /* for splice */
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "device.h"
+#include "ring.h"
+
+#define FD_BUFFER_SIZE (1 << 16)
+#define MEMORY_INITIAL_SIZE (1 << 12)
+#define FILE_INITIAL_SIZE (1 << 20)
+
+typedef enum Device_kind {
+        DEVICE_STDIO = 0, DEVICE_FD, DEVICE_MEMORY, DEVICE_OUTPUT_FILE,
+        DEVICE_QUEUE
+} Device_kind;
+
+/* The shared part of a queue: a ring of bytes, freed with the last end */
+typedef struct Queue {
+        Ring ring;
+        unsigned char *data;
+        uint32_t mask;                  /* size of data - 1 */
+        int ends;                       /* ends not yet freed */
+} *Queue;
+
+struct Device {
+        Device_kind kind;
+        FILE *fp;                       /* DEVICE_STDIO */
+        int fd;                         /* -1 if there is none */
+        bool owns_fd;
+        bool line_buffered;             /* flush output at newlines */
+
+        const unsigned char *in_next;   /* input not yet read */
+        const unsigned char *in_end;
+        unsigned char *in_buffer;       /* read buffer of a descriptor or
+                                         * the read end of a queue */
+        void *in_mapping;               /* device_input_file's mapping */
+        size_t in_mapping_size;
+
+        unsigned char *out_buffer;      /* heap, or a shared mapping */
+        size_t out_length;
+        size_t out_capacity;
+
+        Queue queue;                    /* DEVICE_QUEUE */
+};
+
+/* device_new
+ * Purpose: allocates a device with no input and no output
+ * Parameters: a Device_kind and an int
+ * Returns: the new Device
+ *
+ * Expected input: the kind of device and its file descriptor (or -1)
+ * Success output: a zeroed Device of that kind
+ * Failure output: none
+ */
+static Device device_new(Device_kind kind, int fd)
+{
+    Device device = calloc(1, sizeof(*device));
+    assert(device != NULL);
+
+    device->kind = kind;
+    device->fd = fd;
+    return device;
+}
+
+/* write_all
+ * Purpose: writes a whole buffer to a file descriptor
+ * Parameters: an int, a pointer and a size_t
+ * Returns: true if every byte was written
+ *
+ * Expected input: an open file descriptor and the bytes to write
+ * Success output: true
+ * Failure output: false if the descriptor stops accepting output
+ */
+static bool write_all(int fd, const unsigned char *bytes, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+
+        bytes += written;
+        size -= written;
+    }
+
+    return true;
+}
+
+/* read_some
+ * Purpose: reads from a file descriptor, retrying if interrupted
+ * Parameters: an int, a pointer and a size_t
+ * Returns: the number of bytes read, or 0
+ *
+ * Expected input: an open file descriptor and a buffer
+ * Success output: the number of bytes read
+ * Failure output: 0 at end of file or on an error
+ */
+static size_t read_some(int fd, void *buffer, size_t size)
+{
+    ssize_t length;
+
+    do {
+        length = read(fd, buffer, size);
+    } while (length < 0 && errno == EINTR);
+
+    return length > 0 ? (size_t)length : 0;
+}
+
+/* device_stdio
+ * Purpose: makes a device that reads and writes a stdio stream
+ * Parameters: a FILE pointer
+ * Returns: the new Device
+ *
+ * Expected input: an open stream (such as stdin or stdout), which the
+                   device does not close
+ * Success output: a Device that keeps the stream's own buffering
+ * Failure output: none
+ */
+Device device_stdio(FILE *fp)
+{
+    Device device = device_new(DEVICE_STDIO, fileno(fp));
+
+    device->fp = fp;
+    return device;
+}
+
+/* device_fd
+ * Purpose: makes a buffered device over a file descriptor
+ * Parameters: an int and a bool
+ * Returns: the new Device
+ *
+ * Expected input: an open file descriptor, and whether device_free
+                   should close it
+ * Success output: a Device that reads and writes the descriptor in
+                   large blocks; output to a terminal is written at every
+                   newline
+ * Failure output: none
+ */
+Device device_fd(int fd, bool owns_fd)
+{
+    Device device = device_new(DEVICE_FD, fd);
+
+    device->owns_fd = owns_fd;
+    device->line_buffered = isatty(fd);
+    return device;
+}
+
+/* device_memory
+ * Purpose: makes a device that reads from and writes to memory
+ * Parameters: a pointer and a size_t
+ * Returns: the new Device
+ *
+ * Expected input: the bytes to be read (which must outlive the device
+                   and may be NULL if length is 0) and how many there are
+ * Success output: a Device that reads the given bytes and then EOF, and
+                   collects what is written in a growing buffer
+ * Failure output: none
+ */
+Device device_memory(const void *input, size_t length)
+{
+    Device device = device_new(DEVICE_MEMORY, -1);
+
+    device->in_next = input;
+    device->in_end = device->in_next + (input != NULL ? length : 0);
+    return device;
+}
+
+/* device_input_file
+ * Purpose: makes a device that reads a memory-mapped file
+ * Parameters: a string
+ * Returns: the new Device, or NULL
+ *
+ * Expected input: the path of a regular file
+ * Success output: a Device that reads the file's bytes and then EOF
+ * Failure output: NULL, with a message on stderr
+ */
+Device device_input_file(const char *path)
+{
+    struct stat buf;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &buf) != 0) {
+        fprintf(stderr, "um: cannot read input file %s\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    Device device = device_memory(NULL, 0);
+
+    /* mmap refuses empty files; an empty device reads EOF anyway */
+    if (buf.st_size > 0) {
+        void *base = mmap(NULL, buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (base == MAP_FAILED) {
+            fprintf(stderr, "um: cannot map input file %s\n", path);
+            close(fd);
+            device_free(&device);
+            return NULL;
+        }
+
+        madvise(base, buf.st_size, MADV_SEQUENTIAL);
+        device->in_mapping = base;
+        device->in_mapping_size = buf.st_size;
+        device->in_next = base;
+        device->in_end = device->in_next + buf.st_size;
+    }
+
+    close(fd);
+    return device;
+}
+
+/* map_output
+ * Purpose: resizes an output file and maps all of it
+ * Parameters: a Device and a size_t
+ * Returns: true if the file was resized and mapped
+ *
+ * Expected input: an output-file device and its new capacity in bytes
+ * Success output: true; the device's buffer is the new mapping, which
+                   holds everything written so far
+ * Failure output: false, leaving the device as it was
+ */
+static bool map_output(Device device, size_t capacity)
+{
+    if (ftruncate(device->fd, capacity) != 0) {
+        return false;
+    }
+
+    void *base = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED,
+                      device->fd, 0);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    if (device->out_buffer != NULL) {
+        munmap(device->out_buffer, device->out_capacity);
+    }
+    device->out_buffer = base;
+    device->out_capacity = capacity;
+    return true;
+}
+
+/* device_output_file
+ * Purpose: makes a device that writes into a memory-mapped file
+ * Parameters: a string
+ * Returns: the new Device, or NULL
+ *
+ * Expected input: the path of the file to create or truncate
+ * Success output: a Device whose output is stored directly in a shared
+                   mapping of the file; the file is grown as needed and
+                   cut to the length written when the device is freed
+ * Failure output: NULL, with a message on stderr
+ */
+Device device_output_file(const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+
+    if (fd < 0) {
+        fprintf(stderr, "um: cannot create output file %s\n", path);
+        return NULL;
+    }
+
+    Device device = device_new(DEVICE_OUTPUT_FILE, fd);
+    device->owns_fd = true;
+
+    if (!map_output(device, FILE_INITIAL_SIZE)) {
+        fprintf(stderr, "um: cannot map output file %s\n", path);
+        device_free(&device);
+        return NULL;
+    }
+
+    return device;
+}
+
+/* device_socketpair
+ * Purpose: makes two devices joined by a Unix socketpair
+ * Parameters: an array of two Devices
+ * Returns: true if the socketpair could be created
+ *
+ * Expected input: where to store the two ends
+ * Success output: true; what is written to either end is read from the
+                   other, and freeing one end makes the other read EOF
+ * Failure output: false, with a message on stderr
+ */
+bool device_socketpair(Device ends[2])
+{
+    int fds[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        fprintf(stderr, "um: cannot create socketpair: %s\n",
+                strerror(errno));
+        return false;
+    }
+
+    ends[0] = device_fd(fds[0], true);
+    ends[1] = device_fd(fds[1], true);
+    return true;
+}
+
+/* device_pipe
+ * Purpose: makes two devices joined by a pipe
+ * Parameters: two Device pointers
+ * Returns: true if the pipe could be created
+ *
+ * Expected input: where to store the read end and the write end
+ * Success output: true; freeing the write end makes the read end read
+                   EOF
+ * Failure output: false, with a message on stderr
+ */
+bool device_pipe(Device *read_end, Device *write_end)
+{
+    int fds[2];
+
+    if (pipe(fds) != 0) {
+        fprintf(stderr, "um: cannot create pipe: %s\n", strerror(errno));
+        return false;
+    }
+
+    *read_end = device_fd(fds[0], true);
+    *write_end = device_fd(fds[1], true);
+    return true;
+}
+
+/* device_queue
+ * Purpose: makes two devices joined by a bounded in-process queue
+ * Parameters: a size_t and two Device pointers
+ * Returns: true
+ *
+ * Expected input: the most bytes the queue should hold, and where to
+                   store the read end and the write end
+ * Success output: true; the queue holds capacity bytes rounded up to a
+                   power of two
+ * Failure output: none
+ */
+bool device_queue(size_t capacity, Device *read_end, Device *write_end)
+{
+    Queue queue = malloc(sizeof(*queue));
+    assert(queue != NULL);
+
+    size_t size = 64;
+    while (size < capacity && size < ((size_t)1 << 31)) {
+        size *= 2;
+    }
+
+    ring_init(&queue->ring);
+    queue->data = malloc(size);
+    assert(queue->data != NULL);
+    queue->mask = size - 1;
+    queue->ends = 2;
+
+    *read_end = device_new(DEVICE_QUEUE, -1);
+    (*read_end)->queue = queue;
+    *write_end = device_new(DEVICE_QUEUE, -1);
+    (*write_end)->queue = queue;
+    return true;
+}
+
+/* queue_push
+ * Purpose: adds bytes to a queue, waiting while it is full
+ * Parameters: a Queue, a pointer and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: a queue, on its writer's thread, and the bytes to add
+ * Success output: none (the bytes are visible to the reader)
+ * Failure output: none (bytes are dropped once the reader is gone)
+ */
+static void queue_push(Queue queue, const unsigned char *bytes, size_t size)
+{
+    uint32_t tail = queue->ring.tail;
+
+    while (size > 0) {
+        uint32_t head = __atomic_load_n(&queue->ring.head, __ATOMIC_ACQUIRE);
+        uint32_t space = queue->mask + 1 - (tail - head);
+
+        if (space == 0) {
+            /* Closed by the reader: nothing will make room */
+            if (__atomic_load_n(&queue->ring.closed, __ATOMIC_ACQUIRE)) {
+                return;
+            }
+            ring_wait(&queue->ring, &queue->ring.head, head);
+            continue;
+        }
+
+        /* Copy as much as fits before the end of the array */
+        uint32_t start = tail & queue->mask;
+        size_t chunk = queue->mask + 1 - start;
+        if (chunk > space) {
+            chunk = space;
+        }
+        if (chunk > size) {
+            chunk = size;
+        }
+
+        memcpy(queue->data + start, bytes, chunk);
+        tail += chunk;
+        bytes += chunk;
+        size -= chunk;
+
+        __atomic_store_n(&queue->ring.tail, tail, __ATOMIC_RELEASE);
+        ring_wake(&queue->ring);
+    }
+}
+
+/* queue_pop
+ * Purpose: takes bytes from a queue, waiting while it is empty
+ * Parameters: a Queue, a buffer and a size_t
+ * Returns: the number of bytes taken
+ *
+ * Expected input: a queue, on its reader's thread, and a buffer
+ * Success output: between 1 and size bytes
+ * Failure output: 0 once the writer is gone and the queue is empty
+ */
+static size_t queue_pop(Queue queue, unsigned char *buffer, size_t size)
+{
+    uint32_t head = queue->ring.head;
+    uint32_t tail;
+
+    while (head == (tail = __atomic_load_n(&queue->ring.tail,
+                                           __ATOMIC_ACQUIRE))) {
+        if (__atomic_load_n(&queue->ring.closed, __ATOMIC_ACQUIRE)
+            && head == __atomic_load_n(&queue->ring.tail,
+                                       __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+        ring_wait(&queue->ring, &queue->ring.tail, tail);
+    }
+
+    uint32_t start = head & queue->mask;
+    size_t chunk = queue->mask + 1 - start;
+    if (chunk > tail - head) {
+        chunk = tail - head;
+    }
+    if (chunk > size) {
+        chunk = size;
+    }
+
+    memcpy(buffer, queue->data + start, chunk);
+    __atomic_store_n(&queue->ring.head, head + chunk, __ATOMIC_RELEASE);
+    ring_wake(&queue->ring);
+
+    return chunk;
+}
+
+/* queue_release
+ * Purpose: lets go of one end of a queue
+ * Parameters: a Device
+ * Returns: Nothing
+ *
+ * Expected input: either end of a queue, which will not be used again
+ * Success output: none (freeing the write end makes the reader see EOF
+                   once it has read everything; freeing the read end
+                   makes later output be dropped; the queue is freed
+                   with its second end)
+ * Failure output: none
+ */
+static void queue_release(Device device)
+{
+    Queue queue = device->queue;
+
+    ring_close(&queue->ring);
+
+    if (__atomic_sub_fetch(&queue->ends, 1, __ATOMIC_ACQ_REL) == 0) {
+        ring_destroy(&queue->ring);
+        free(queue->data);
+        free(queue);
+    }
+}
+
+/* fill_input
+ * Purpose: refills the read buffer of a descriptor or queue device
+ * Parameters: a Device
+ * Returns: true if any bytes were read
+ *
+ * Expected input: a DEVICE_FD or the read end of a DEVICE_QUEUE whose
+                   buffered input has all been read
+ * Success output: true, with the new bytes between in_next and in_end
+ * Failure output: false at end of file or on an error
+ */
+static bool fill_input(Device device)
+{
+    if (device->in_buffer == NULL) {
+        device->in_buffer = malloc(FD_BUFFER_SIZE);
+        assert(device->in_buffer != NULL);
+    }
+
+    size_t length = device->kind == DEVICE_QUEUE
+                    ? queue_pop(device->queue, device->in_buffer,
+                                FD_BUFFER_SIZE)
+                    : read_some(device->fd, device->in_buffer,
+                                FD_BUFFER_SIZE);
+
+    device->in_next = device->in_buffer;
+    device->in_end = device->in_buffer + length;
+    return length > 0;
+}
+
+/* device_getc
+ * Purpose: reads the next byte from a device
+ * Parameters: a Device
+ * Returns: the byte, or EOF
+ *
+ * Expected input: a device made by this class
+ * Success output: the next byte
+ * Failure output: EOF at the end of the input or on a read error
+ */
+int device_getc(Device device)
+{
+    if (device->in_next < device->in_end) {
+        return *device->in_next++;
+    }
+
+    switch (device->kind) {
+        case DEVICE_STDIO:
+            return getc(device->fp);
+        case DEVICE_FD:
+        case DEVICE_QUEUE:
+            return fill_input(device) ? *device->in_next++ : EOF;
+        default:
+            return EOF;
+    }
+}
+
+/* make_room
+ * Purpose: ensures there is room in a device's output buffer
+ * Parameters: a Device and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: a device other than DEVICE_STDIO, and the number of
+                   bytes about to be added
+ * Success output: none (a descriptor device's buffer is flushed; memory
+                   and file buffers are grown to fit)
+ * Failure output: exits the program if an output file cannot grow
+ */
+static void make_room(Device device, size_t size)
+{
+    if (device->kind == DEVICE_FD) {
+        if (device->out_buffer == NULL) {
+            device->out_buffer = malloc(FD_BUFFER_SIZE);
+            assert(device->out_buffer != NULL);
+            device->out_capacity = FD_BUFFER_SIZE;
+        }
+        if (device->out_capacity - device->out_length < size) {
+            device_flush(device);
+        }
+        return;
+    }
+
+    size_t needed = device->out_length + size;
+    size_t capacity = device->out_capacity;
+
+    if (needed <= capacity) {
+        return;
+    }
+    if (capacity == 0) {
+        capacity = MEMORY_INITIAL_SIZE;
+    }
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+
+    if (device->kind == DEVICE_MEMORY) {
+        device->out_buffer = realloc(device->out_buffer, capacity);
+        assert(device->out_buffer != NULL);
+        device->out_capacity = capacity;
+    } else if (!map_output(device, capacity)) {
+        fprintf(stderr, "um: cannot grow output file: %s\n",
+                strerror(errno));
+        exit(1);
+    }
+}
+
+/* device_putc
+ * Purpose: writes a byte to a device
+ * Parameters: a Device and an int
+ * Returns: Nothing
+ *
+ * Expected input: a device made by this class and a value from 0 to 255
+ * Success output: none
+ * Failure output: none (output a descriptor will not take is dropped)
+ */
+void device_putc(Device device, int c)
+{
+    if (device->kind == DEVICE_STDIO) {
+        putc(c, device->fp);
+        return;
+    }
+
+    /* Queue output is passed on at once, so the reader never waits on
+     * bytes held back in a buffer */
+    if (device->kind == DEVICE_QUEUE) {
+        unsigned char byte = c;
+        queue_push(device->queue, &byte, 1);
+        return;
+    }
+
+    if (device->out_length == device->out_capacity) {
+        make_room(device, 1);
+    }
+    device->out_buffer[device->out_length++] = c;
+
+    if (device->line_buffered && c == '\n') {
+        device_flush(device);
+    }
+}
+
+/* device_read
+ * Purpose: reads a block of bytes from a device
+ * Parameters: a Device, a buffer and a size_t
+ * Returns: the number of bytes read
+ *
+ * Expected input: a device, and a buffer of the given size; a stdio
+                   device read this way must not also be read with
+                   device_getc, since its stream buffer is bypassed
+ * Success output: between 1 and size bytes, waiting only until some are
+                   available
+ * Failure output: 0 at the end of the input or on a read error
+ */
+size_t device_read(Device device, void *buffer, size_t size)
+{
+    size_t buffered = device->in_end - device->in_next;
+
+    if (buffered > 0) {
+        if (buffered > size) {
+            buffered = size;
+        }
+        memcpy(buffer, device->in_next, buffered);
+        device->in_next += buffered;
+        return buffered;
+    }
+
+    if (device->kind == DEVICE_QUEUE) {
+        return queue_pop(device->queue, buffer, size);
+    }
+    if (device->fd < 0 || device->kind == DEVICE_OUTPUT_FILE) {
+        return 0;
+    }
+
+    /* Read the descriptor directly, so a reader never waits for more
+     * than is available */
+    return read_some(device->fd, buffer, size);
+}
+
+/* device_write
+ * Purpose: writes a block of bytes to a device
+ * Parameters: a Device, a buffer and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: a device, and the bytes to write
+ * Success output: none
+ * Failure output: none (output a descriptor will not take is dropped)
+ */
+void device_write(Device device, const void *buffer, size_t size)
+{
+    if (device->kind == DEVICE_STDIO) {
+        fwrite(buffer, 1, size, device->fp);
+        return;
+    }
+
+    if (device->kind == DEVICE_QUEUE) {
+        queue_push(device->queue, buffer, size);
+        return;
+    }
+
+    if (device->kind == DEVICE_FD && size >= FD_BUFFER_SIZE) {
+        device_flush(device);
+        write_all(device->fd, buffer, size);
+        return;
+    }
+
+    make_room(device, size);
+    memcpy(device->out_buffer + device->out_length, buffer, size);
+    device->out_length += size;
+
+    if (device->line_buffered && memchr(buffer, '\n', size) != NULL) {
+        device_flush(device);
+    }
+}
+
+/* device_flush
+ * Purpose: passes any buffered output on to the device's destination
+ * Parameters: a Device
+ * Returns: Nothing
+ *
+ * Expected input: a device made by this class
+ * Success output: none
+ * Failure output: none
+ */
+void device_flush(Device device)
+{
+    switch (device->kind) {
+        case DEVICE_STDIO:
+            fflush(device->fp);
+            break;
+        case DEVICE_FD:
+            /* Output the descriptor will not take is dropped, as
+             * putchar's would be */
+            write_all(device->fd, device->out_buffer, device->out_length);
+            device->out_length = 0;
+            break;
+        default:
+            break;
+    }
+}
+
+/* device_contents
+ * Purpose: gives the host direct access to what a device has collected
+ * Parameters: a Device and a size_t pointer
+ * Returns: a pointer to the bytes written so far, or NULL
+ *
+ * Expected input: a memory or output-file device, and where to store
+                   the number of bytes
+ * Success output: the device's own buffer, valid until the next write
+                   to or free of the device
+ * Failure output: NULL (with a length of 0) for other kinds of device
+ */
+const unsigned char *device_contents(Device device, size_t *length)
+{
+    if (device->kind != DEVICE_MEMORY
+        && device->kind != DEVICE_OUTPUT_FILE) {
+        *length = 0;
+        return NULL;
+    }
+
+    *length = device->out_length;
+    return device->out_buffer;
+}
+
+/* device_splice
+ * Purpose: moves input from the read end of a pipe to a file descriptor
+ * Parameters: a Device, an int and a size_t
+ * Returns: the number of bytes moved, or -1
+ *
+ * Expected input: a device made by device_pipe or device_fd, an output
+                   file descriptor, and the most bytes to move
+ * Success output: the bytes moved, 0 at the end of the input; bytes the
+                   device had already buffered are written first, and
+                   the rest are moved by splice(2) without being copied
+                   into user space when the kernel allows it
+ * Failure output: -1 with errno set
+ */
+ssize_t device_splice(Device device, int fd, size_t length)
+{
+    size_t buffered = device->in_end - device->in_next;
+
+    if (buffered > 0) {
+        if (buffered > length) {
+            buffered = length;
+        }
+        if (!write_all(fd, device->in_next, buffered)) {
+            return -1;
+        }
+        device->in_next += buffered;
+        return buffered;
+    }
+
+    if (device->kind != DEVICE_FD) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    ssize_t moved;
+    do {
+        moved = splice(device->fd, NULL, fd, NULL, length, SPLICE_F_MOVE);
+    } while (moved < 0 && errno == EINTR);
+
+    /* Neither end is a pipe: copy through the read buffer instead */
+    if (moved < 0 && errno == EINVAL) {
+        if (!fill_input(device)) {
+            return 0;
+        }
+        return device_splice(device, fd, length);
+    }
+
+    return moved;
+}
+
+/* device_free
+ * Purpose: flushes a device and releases it
+ * Parameters: a pointer to a Device
+ * Returns: Nothing
+ *
+ * Expected input: a pointer to a device made by this class
+ * Success output: none (an output file is cut to the length written,
+                   owned descriptors are closed, and the Device is set
+                   to NULL)
+ * Failure output: none
+ */
+void device_free(Device *device)
+{
+    Device d = *device;
+
+    switch (d->kind) {
+        case DEVICE_STDIO:
+        case DEVICE_FD:
+            device_flush(d);
+            free(d->out_buffer);
+            break;
+        case DEVICE_MEMORY:
+            free(d->out_buffer);
+            break;
+        case DEVICE_OUTPUT_FILE:
+            if (d->out_buffer != NULL) {
+                munmap(d->out_buffer, d->out_capacity);
+            }
+            if (ftruncate(d->fd, d->out_length) != 0) {
+                fprintf(stderr, "um: cannot truncate output file\n");
+            }
+            break;
+        case DEVICE_QUEUE:
+            queue_release(d);
+            break;
+    }
+
+    if (d->in_mapping != NULL) {
+        munmap(d->in_mapping, d->in_mapping_size);
+    }
+    if (d->owns_fd && d->fd >= 0) {
+        close(d->fd);
+    }
+
+    free(d->in_buffer);
+    free(d);
+    *device = NULL;
+}
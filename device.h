@@ -0,0 +1,238 @@
+/**************************************************************
+ *
+ *                         device.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class provides the byte streams that the UM's IN and OUT
+ *     instructions are bound to. A Device can be a stdio stream, a
+ *     file descriptor, a memory buffer, a memory-mapped input or output
+ *     file, one end of a Unix socketpair or pipe, or one end of a
+ *     bounded in-process queue. Every kind is read with device_getc and
+ *     written with device_putc, so the console (and anything embedding
+ *     the UM) can swap one for another without the instructions knowing.
+ *
+ *     Memory and mapped-file devices never copy through the kernel:
+ *     input is read straight out of the buffer or mapping, and output is
+ *     written straight into one that the host can inspect with
+ *     device_contents. Queue, socketpair and pipe ends let one UM feed
+ *     another in the same process; a queue is a lock-free ring that
+ *     only enters the kernel when one side has to wait for the other
+ *     (the writer when it is full, the reader when it is empty). The
+ *     read end of a pipe can also be drained into another file
+ *     descriptor with device_splice, which moves the bytes inside the
+ *     kernel.
+ *
+ **************************************************************/
+#ifndef DEVICE_INCLUDED
+#define DEVICE_INCLUDED
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+typedef struct Device *Device;
+
+/* device_stdio
+ * Purpose: makes a device that reads and writes a stdio stream
+ * Parameters: a FILE pointer
+ * Returns: the new Device
+ *
+ * Expected input: an open stream (such as stdin or stdout), which the
+                   device does not close
+ * Success output: a Device that keeps the stream's own buffering
+ * Failure output: none
+ */
+Device device_stdio(FILE *fp);
+
+/* device_fd
+ * Purpose: makes a buffered device over a file descriptor
+ * Parameters: an int and a bool
+ * Returns: the new Device
+ *
+ * Expected input: an open file descriptor, and whether device_free
+                   should close it
+ * Success output: a Device that reads and writes the descriptor in
+                   large blocks; output to a terminal is written at every
+                   newline
+ * Failure output: none
+ */
+Device device_fd(int fd, bool owns_fd);
+
+/* device_memory
+ * Purpose: makes a device that reads from and writes to memory
+ * Parameters: a pointer and a size_t
+ * Returns: the new Device
+ *
+ * Expected input: the bytes to be read (which must outlive the device
+                   and may be NULL if length is 0) and how many there are
+ * Success output: a Device that reads the given bytes and then EOF, and
+                   collects what is written in a growing buffer
+ * Failure output: none
+ */
+Device device_memory(const void *input, size_t length);
+
+/* device_input_file
+ * Purpose: makes a device that reads a memory-mapped file
+ * Parameters: a string
+ * Returns: the new Device, or NULL
+ *
+ * Expected input: the path of a regular file
+ * Success output: a Device that reads the file's bytes and then EOF
+ * Failure output: NULL, with a message on stderr
+ */
+Device device_input_file(const char *path);
+
+/* device_output_file
+ * Purpose: makes a device that writes into a memory-mapped file
+ * Parameters: a string
+ * Returns: the new Device, or NULL
+ *
+ * Expected input: the path of the file to create or truncate
+ * Success output: a Device whose output is stored directly in a shared
+                   mapping of the file; the file is grown as needed and
+                   cut to the length written when the device is freed
+ * Failure output: NULL, with a message on stderr
+ */
+Device device_output_file(const char *path);
+
+/* device_socketpair
+ * Purpose: makes two devices joined by a Unix socketpair
+ * Parameters: an array of two Devices
+ * Returns: true if the socketpair could be created
+ *
+ * Expected input: where to store the two ends
+ * Success output: true; what is written to either end is read from the
+                   other, and freeing one end makes the other read EOF
+ * Failure output: false, with a message on stderr
+ */
+bool device_socketpair(Device ends[2]);
+
+/* device_pipe
+ * Purpose: makes two devices joined by a pipe
+ * Parameters: two Device pointers
+ * Returns: true if the pipe could be created
+ *
+ * Expected input: where to store the read end and the write end
+ * Success output: true; freeing the write end makes the read end read
+                   EOF
+ * Failure output: false, with a message on stderr
+ */
+bool device_pipe(Device *read_end, Device *write_end);
+
+/* device_queue
+ * Purpose: makes two devices joined by a bounded in-process queue
+ * Parameters: a size_t and two Device pointers
+ * Returns: true
+ *
+ * Expected input: the most bytes the queue should hold, and where to
+                   store the read end and the write end
+ * Success output: true; the queue holds capacity bytes rounded up to a
+                   power of two
+ * Failure output: none
+ */
+bool device_queue(size_t capacity, Device *read_end, Device *write_end);
+
+/* device_getc
+ * Purpose: reads the next byte from a device
+ * Parameters: a Device
+ * Returns: the byte, or EOF
+ *
+ * Expected input: a device made by this class
+ * Success output: the next byte
+ * Failure output: EOF at the end of the input or on a read error
+ */
+int device_getc(Device device);
+
+/* device_putc
+ * Purpose: writes a byte to a device
+ * Parameters: a Device and an int
+ * Returns: Nothing
+ *
+ * Expected input: a device made by this class and a value from 0 to 255
+ * Success output: none
+ * Failure output: none (output a descriptor will not take is dropped)
+ */
+void device_putc(Device device, int c);
+
+/* device_read
+ * Purpose: reads a block of bytes from a device
+ * Parameters: a Device, a buffer and a size_t
+ * Returns: the number of bytes read
+ *
+ * Expected input: a device, and a buffer of the given size; a stdio
+                   device read this way must not also be read with
+                   device_getc, since its stream buffer is bypassed
+ * Success output: between 1 and size bytes, waiting only until some are
+                   available
+ * Failure output: 0 at the end of the input or on a read error
+ */
+size_t device_read(Device device, void *buffer, size_t size);
+
+/* device_write
+ * Purpose: writes a block of bytes to a device
+ * Parameters: a Device, a buffer and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: a device, and the bytes to write
+ * Success output: none
+ * Failure output: none (output a descriptor will not take is dropped)
+ */
+void device_write(Device device, const void *buffer, size_t size);
+
+/* device_flush
+ * Purpose: passes any buffered output on to the device's destination
+ * Parameters: a Device
+ * Returns: Nothing
+ *
+ * Expected input: a device made by this class
+ * Success output: none
+ * Failure output: none
+ */
+void device_flush(Device device);
+
+/* device_contents
+ * Purpose: gives the host direct access to what a device has collected
+ * Parameters: a Device and a size_t pointer
+ * Returns: a pointer to the bytes written so far, or NULL
+ *
+ * Expected input: a memory or output-file device, and where to store
+                   the number of bytes
+ * Success output: the device's own buffer, valid until the next write
+                   to or free of the device
+ * Failure output: NULL (with a length of 0) for other kinds of device
+ */
+const unsigned char *device_contents(Device device, size_t *length);
+
+/* device_splice
+ * Purpose: moves input from the read end of a pipe to a file descriptor
+ * Parameters: a Device, an int and a size_t
+ * Returns: the number of bytes moved, or -1
+ *
+ * Expected input: a device made by device_pipe or device_fd, an output
+                   file descriptor, and the most bytes to move
+ * Success output: the bytes moved, 0 at the end of the input; bytes the
+                   device had already buffered are written first, and
+                   the rest are moved by splice(2) without being copied
+                   into user space when the kernel allows it
+ * Failure output: -1 with errno set
+ */
+ssize_t device_splice(Device device, int fd, size_t length);
+
+/* device_free
+ * Purpose: flushes a device and releases it
+ * Parameters: a pointer to a Device
+ * Returns: Nothing
+ *
+ * Expected input: a pointer to a device made by this class
+ * Success output: none (an output file is cut to the length written,
+                   owned descriptors are closed, and the Device is set
+                   to NULL)
+ * Failure output: none
+ */
+void device_free(Device *device);
+
+#endif
@@ -0,0 +1,79 @@
+/**************************************************************
+ *
+ *                         genspecial.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Writes special.inc, the specialised handlers that instruction.c
+ *     includes. There is one handler for every register triple of each
+ *     of the hot three-register opcodes (CMOV, SLOAD, SSTORE, ADD and
+ *     NAND), with its registers written in as constants, plus a second
+ *     set of CMOV handlers that move without a branch. Each set ends
+ *     with a table of its 512 handlers, indexed by a << 6 | b << 3 | c.
+ *
+ *     Usage: genspecial > special.inc
+ *
+ **************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct Special {
+        const char *name;
+        const char *body;       /* printf format taking a, b and c */
+} Special;
+
+static const Special specials[] = {
+    { "cmov",
+      "    if (registers[%3$d] != 0) {\n"
+      "        registers[%1$d] = registers[%2$d];\n"
+      "    }\n" },
+    { "cmov_branchless",
+      "    uint32_t mask = -(uint32_t)(registers[%3$d] != 0);\n\n"
+      "    registers[%1$d] = (registers[%2$d] & mask)"
+      " | (registers[%1$d] & ~mask);\n" },
+    { "sload",
+      "    registers[%1$d] = get_word(registers[%2$d], registers[%3$d]);\n" },
+    { "sstore",
+      "    set_word(registers[%1$d], registers[%2$d], registers[%3$d]);\n" },
+    { "add",
+      "    registers[%1$d] = registers[%2$d] + registers[%3$d];\n" },
+    { "nand",
+      "    registers[%1$d] = ~(registers[%2$d] & registers[%3$d]);\n" },
+};
+
+#define NUM_SPECIALS (sizeof(specials) / sizeof(specials[0]))
+
+int main()
+{
+    printf("/* Generated by genspecial; do not edit */\n\n");
+    printf("#define SPECIAL_UNUSED __attribute__((unused))\n");
+
+    for (size_t i = 0; i < NUM_SPECIALS; i++) {
+        for (int triple = 0; triple < 512; triple++) {
+            int a = triple >> 6, b = (triple >> 3) & 7, c = triple & 7;
+
+            printf("\nstatic void special_%s_%d%d%d("
+                   "const struct Um_decoded *instruction SPECIAL_UNUSED,\n"
+                   "        bool *continue_execution SPECIAL_UNUSED, "
+                   "int *prog_counter SPECIAL_UNUSED)\n{\n",
+                   specials[i].name, a, b, c);
+            printf(specials[i].body, a, b, c);
+            printf("}\n");
+        }
+
+        printf("\nstatic Um_handler *const special_%s[512] = {\n",
+               specials[i].name);
+        for (int triple = 0; triple < 512; triple++) {
+            printf("    special_%s_%d%d%d,\n", specials[i].name,
+                   triple >> 6, (triple >> 3) & 7, triple & 7);
+        }
+        printf("};\n");
+    }
+
+    printf("\n#undef SPECIAL_UNUSED\n");
+
+    return ferror(stdout) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
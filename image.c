@@ -0,0 +1,606 @@
+/**************************************************************
+ *
+ *                         image.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the image class.
+ *
+ **************************************************************/
+#include <assert.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "image.h"
+#include "decode.h"
+
+#define HEADER_BYTES 28
+#define ENTRY_BYTES 12      /* a chunk's size and hash in the chunk table */
+#define VERSION 2
+
+#define MIN_MATCH 4         /* shorter repeats are sent as literals */
+#define LAST_LITERALS 5     /* a chunk always ends with this many literals */
+#define MAX_DISTANCE 65535
+#define HASH_BITS 12
+
+static const unsigned char magic[4] = { 0xf0, 'U', 'M', 'Z' };
+
+struct Image {
+        const unsigned char *file;      /* the whole file, mapped */
+        size_t file_size;
+        uint32_t num_words;
+        uint32_t chunk_words;
+        uint32_t num_chunks;
+        uint64_t hash;
+        size_t *offsets;        /* num_chunks + 1 chunk starts in file */
+};
+
+/* get_be32
+ * Purpose: reads a big-endian 32-bit integer
+ * Parameters: a byte pointer
+ * Returns: the integer
+ *
+ * Expected input: four readable bytes
+ * Success output: the integer they hold
+ * Failure output: none
+ */
+static uint32_t get_be32(const unsigned char *bytes)
+{
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16
+           | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+/* put_be32
+ * Purpose: writes a big-endian 32-bit integer to a stream
+ * Parameters: a FILE pointer and a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: a stream open for writing
+ * Success output: none
+ * Failure output: none (errors are left for ferror)
+ */
+static void put_be32(FILE *fp, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        putc((value >> shift) & 0xff, fp);
+    }
+}
+
+/* damaged
+ * Purpose: reports a damaged image and stops the program
+ * Parameters: a string
+ * Returns: does not return
+ *
+ * Expected input: the path of the image
+ * Success output: none
+ * Failure output: exits the program with a message on stderr
+ */
+static void damaged(const char *path)
+{
+    fprintf(stderr, "um: %s: damaged compressed image\n", path);
+    exit(1);
+}
+
+/* image_open
+ * Purpose: opens a compressed program image
+ * Parameters: a string
+ * Returns: the Image, or NULL if the file is not a compressed image
+ *
+ * Expected input: the path of a program file
+ * Success output: an Image whose file is memory mapped; no chunk is
+                   expanded until image_unpack is called
+ * Failure output: NULL if the file cannot be read or does not start
+                   with the magic; exits the program, with a message on
+                   stderr, if it does but is of another format version
+                   or its header or chunk table is damaged
+ */
+Image image_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat buf;
+
+    if (fd < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &buf) < 0 || buf.st_size < HEADER_BYTES) {
+        close(fd);
+        return NULL;
+    }
+
+    const unsigned char *file = mmap(NULL, buf.st_size, PROT_READ,
+                                     MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        return NULL;
+    }
+    if (memcmp(file, magic, sizeof(magic)) != 0) {
+        munmap((void *)file, buf.st_size);
+        return NULL;
+    }
+
+    Image image = malloc(sizeof(*image));
+    assert(image != NULL);
+
+    image->file = file;
+    image->file_size = buf.st_size;
+    image->num_words = get_be32(file + 8);
+    image->chunk_words = get_be32(file + 12);
+    image->hash = (uint64_t)get_be32(file + 16) << 32 | get_be32(file + 20);
+    image->num_chunks = get_be32(file + 24);
+
+    /* The chunk count must match the length, so every chunk is full
+     * except perhaps the last */
+    uint64_t expected_chunks = image->chunk_words == 0 ? 0
+            : ((uint64_t)image->num_words + image->chunk_words - 1)
+              / image->chunk_words;
+
+    if (get_be32(file + 4) != VERSION) {
+        fprintf(stderr, "um: %s: compressed image is version %u, not %u; "
+                "compress the program again with umz\n", path,
+                get_be32(file + 4), VERSION);
+        exit(1);
+    }
+    if (image->chunk_words == 0
+        || image->chunk_words > (1u << 28)
+        || image->num_chunks != expected_chunks
+        || (image->file_size - HEADER_BYTES) / ENTRY_BYTES
+           < image->num_chunks) {
+        damaged(path);
+    }
+
+    image->offsets = malloc((image->num_chunks + 1) * sizeof(size_t));
+    assert(image->offsets != NULL);
+
+    size_t offset = HEADER_BYTES + (size_t)image->num_chunks * ENTRY_BYTES;
+
+    for (uint32_t i = 0; i < image->num_chunks; i++) {
+        uint32_t size = get_be32(file + HEADER_BYTES
+                                 + (size_t)i * ENTRY_BYTES);
+        uint32_t words = image->num_words - i * image->chunk_words;
+        uint64_t raw_bytes = (uint64_t)(words < image->chunk_words
+                                        ? words : image->chunk_words) * 4;
+
+        if (size > raw_bytes || size > image->file_size - offset) {
+            damaged(path);
+        }
+        image->offsets[i] = offset;
+        offset += size;
+    }
+    image->offsets[image->num_chunks] = offset;
+
+    return image;
+}
+
+/* image_length
+ * Purpose: gives the number of words in an image's program
+ * Parameters: an Image
+ * Returns: the number of words
+ *
+ * Expected input: an open Image
+ * Success output: the length segment 0 should have
+ * Failure output: none
+ */
+uint32_t image_length(Image image)
+{
+    return image->num_words;
+}
+
+/* image_chunk_words
+ * Purpose: gives the number of words in each of an image's chunks
+ * Parameters: an Image
+ * Returns: the number of words
+ *
+ * Expected input: an open Image
+ * Success output: the chunk size (chunk i starts at word i times it)
+ * Failure output: none
+ */
+uint32_t image_chunk_words(Image image)
+{
+    return image->chunk_words;
+}
+
+/* image_hash
+ * Purpose: gives the hash stored in an image's header
+ * Parameters: an Image
+ * Returns: the hash
+ *
+ * Expected input: an open Image
+ * Success output: the decode_image_hash the program's words should have
+ * Failure output: none
+ */
+uint64_t image_hash(Image image)
+{
+    return image->hash;
+}
+
+/* get_length
+ * Purpose: reads the extra bytes of a literal count or match length
+ * Parameters: a pointer to a byte pointer, a byte pointer and a size_t
+               pointer
+ * Returns: true if the bytes were all there
+ *
+ * Expected input: where the bytes start (advanced past them), the end
+                   of the chunk, and the length to add them to
+ * Success output: true
+ * Failure output: false if the chunk ends first
+ */
+static bool get_length(const unsigned char **in, const unsigned char *end,
+                       size_t *length)
+{
+    unsigned char byte;
+
+    do {
+        if (*in == end) {
+            return false;
+        }
+        byte = *(*in)++;
+        *length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+/* expand
+ * Purpose: decompresses one chunk
+ * Parameters: a byte pointer, a size_t, a byte pointer and a size_t
+ * Returns: true if the chunk decompressed to exactly raw_size bytes
+ *
+ * Expected input: the compressed chunk and its size, and where to put
+                   the bytes and how many there should be
+ * Success output: true
+ * Failure output: false if a length or distance points outside the
+                   chunk or the output
+ */
+static bool expand(const unsigned char *in, size_t size,
+                   unsigned char *out, size_t raw_size)
+{
+    const unsigned char *end = in + size;
+    size_t pos = 0;
+
+    while (in < end) {
+        unsigned token = *in++;
+        size_t literals = token >> 4;
+
+        if (literals == 15 && !get_length(&in, end, &literals)) {
+            return false;
+        }
+        if (literals > (size_t)(end - in) || literals > raw_size - pos) {
+            return false;
+        }
+        for (size_t i = 0; i < literals; i++) {
+            out[pos++] = *in++;
+        }
+
+        if (in == end) {
+            break;
+        }
+        if (end - in < 2) {
+            return false;
+        }
+
+        size_t distance = in[0] | (size_t)in[1] << 8;
+        size_t match = token & 15;
+
+        in += 2;
+        if (match == 15 && !get_length(&in, end, &match)) {
+            return false;
+        }
+        match += MIN_MATCH;
+        if (distance == 0 || distance > pos || match > raw_size - pos) {
+            return false;
+        }
+
+        /* Byte by byte, since a match may overlap its own output */
+        for (size_t i = 0; i < match; i++, pos++) {
+            out[pos] = out[pos - distance];
+        }
+    }
+
+    return pos == raw_size;
+}
+
+/* image_unpack
+ * Purpose: expands one chunk of an image
+ * Parameters: an Image, a uint32_t and a uint32_t pointer
+ * Returns: true if the chunk was expanded
+ *
+ * Expected input: an open Image, a chunk number, and where the chunk's
+                   first word goes (with room for the whole chunk)
+ * Success output: true, with the chunk's words stored in host order;
+                   it only reads and writes memory, so it is safe to
+                   call from a signal handler
+ * Failure output: false if the chunk number is out of range or the
+                   chunk's data is damaged
+ */
+bool image_unpack(Image image, uint32_t chunk, uint32_t *words)
+{
+    if (chunk >= image->num_chunks) {
+        return false;
+    }
+
+    uint32_t num_words = image->num_words - chunk * image->chunk_words;
+
+    if (num_words > image->chunk_words) {
+        num_words = image->chunk_words;
+    }
+
+    const unsigned char *in = image->file + image->offsets[chunk];
+    size_t size = image->offsets[chunk + 1] - image->offsets[chunk];
+    size_t raw_size = (size_t)num_words * 4;
+    unsigned char *out = (unsigned char *)words;
+
+    if (size == raw_size) {
+        for (size_t i = 0; i < raw_size; i++) {
+            out[i] = in[i];
+        }
+    } else if (!expand(in, size, out, raw_size)) {
+        return false;
+    }
+
+    /* The bytes are in .um order; turn each word around in place */
+    for (uint32_t i = 0; i < num_words; i++) {
+        words[i] = get_be32(out + (size_t)i * 4);
+    }
+
+    return true;
+}
+
+/* image_check
+ * Purpose: checks an expanded chunk against the hash in the chunk table
+ * Parameters: an Image, a uint32_t and a uint32_t pointer
+ * Returns: true if the chunk's words match its hash
+ *
+ * Expected input: an open Image, a chunk number, and the chunk's words
+                   as image_unpack left them
+ * Success output: true; like image_unpack, it only reads memory, so it
+                   is safe to call from a signal handler
+ * Failure output: false if the chunk number is out of range or the
+                   words differ from the ones the image was written with
+ */
+bool image_check(Image image, uint32_t chunk, const uint32_t *words)
+{
+    if (chunk >= image->num_chunks) {
+        return false;
+    }
+
+    uint32_t num_words = image->num_words - chunk * image->chunk_words;
+
+    if (num_words > image->chunk_words) {
+        num_words = image->chunk_words;
+    }
+
+    const unsigned char *entry = image->file + HEADER_BYTES
+                                 + (size_t)chunk * ENTRY_BYTES;
+    uint64_t hash = (uint64_t)get_be32(entry + 4) << 32
+                    | get_be32(entry + 8);
+
+    return decode_image_hash(words, num_words) == hash;
+}
+
+/* put_length
+ * Purpose: appends the extra bytes of a literal count or match length
+ * Parameters: a byte pointer and a size_t
+ * Returns: the byte after the last one written
+ *
+ * Expected input: where to write, and a length of at least 15
+ * Success output: the position after the length bytes
+ * Failure output: none
+ */
+static unsigned char *put_length(unsigned char *out, size_t length)
+{
+    for (length -= 15; length >= 255; length -= 255) {
+        *out++ = 255;
+    }
+    *out++ = length;
+
+    return out;
+}
+
+/* put_sequence
+ * Purpose: appends one sequence of literals and a match
+ * Parameters: a byte pointer, a byte pointer, three size_ts
+ * Returns: the byte after the last one written
+ *
+ * Expected input: where to write, the literals and their number, and
+                   the match's distance and length (a length of 0 for the
+                   last sequence, which has no match)
+ * Success output: the position after the sequence
+ * Failure output: none
+ */
+static unsigned char *put_sequence(unsigned char *out,
+                                   const unsigned char *literals,
+                                   size_t num_literals, size_t distance,
+                                   size_t match)
+{
+    unsigned char *token = out++;
+
+    *token = (num_literals < 15 ? num_literals : 15) << 4;
+    if (num_literals >= 15) {
+        out = put_length(out, num_literals);
+    }
+    memcpy(out, literals, num_literals);
+    out += num_literals;
+
+    if (match == 0) {
+        return out;
+    }
+
+    *out++ = distance & 0xff;
+    *out++ = distance >> 8;
+
+    match -= MIN_MATCH;
+    *token |= match < 15 ? match : 15;
+    if (match >= 15) {
+        out = put_length(out, match);
+    }
+
+    return out;
+}
+
+/* get_le32
+ * Purpose: reads four bytes as one integer, for hashing and comparing
+ * Parameters: a byte pointer
+ * Returns: the integer
+ *
+ * Expected input: four readable bytes
+ * Success output: the bytes as a little-endian integer
+ * Failure output: none
+ */
+static uint32_t get_le32(const unsigned char *bytes)
+{
+    return bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16
+           | (uint32_t)bytes[3] << 24;
+}
+
+/* compress
+ * Purpose: compresses one chunk
+ * Parameters: a byte pointer, a size_t and a byte pointer
+ * Returns: the compressed size
+ *
+ * Expected input: the raw chunk and its size, and an output buffer of
+                   at least size + size / 255 + 16 bytes
+ * Success output: the number of bytes written, which may be more than
+                   size for data that does not compress
+ * Failure output: none
+ */
+static size_t compress(const unsigned char *in, size_t size,
+                       unsigned char *out)
+{
+    /* Last position each 4-byte value was seen at, plus one */
+    uint32_t *seen = calloc(1 << HASH_BITS, sizeof(uint32_t));
+    assert(seen != NULL);
+
+    unsigned char *start = out;
+    size_t anchor = 0;
+    size_t pos = 0;
+
+    while (pos + MIN_MATCH + LAST_LITERALS <= size) {
+        uint32_t value = get_le32(in + pos);
+        uint32_t hash = (value * 2654435761u) >> (32 - HASH_BITS);
+        size_t candidate = seen[hash];
+
+        seen[hash] = pos + 1;
+        if (candidate == 0 || pos - (candidate - 1) > MAX_DISTANCE
+            || get_le32(in + candidate - 1) != value) {
+            pos++;
+            continue;
+        }
+
+        size_t ref = candidate - 1;
+        size_t match = MIN_MATCH;
+
+        while (pos + match < size - LAST_LITERALS
+               && in[ref + match] == in[pos + match]) {
+            match++;
+        }
+
+        out = put_sequence(out, in + anchor, pos - anchor, pos - ref, match);
+        pos += match;
+        anchor = pos;
+    }
+
+    out = put_sequence(out, in + anchor, size - anchor, 0, 0);
+    free(seen);
+
+    return out - start;
+}
+
+/* image_write
+ * Purpose: writes a program as a compressed image
+ * Parameters: a FILE pointer, a uint32_t pointer and a uint32_t
+ * Returns: true if the image was written
+ *
+ * Expected input: a stream open for binary writing, and the words of
+                   the program and their number
+ * Success output: true
+ * Failure output: false if the stream reported an error
+ */
+bool image_write(FILE *fp, const uint32_t *words, uint32_t num_words)
+{
+    uint32_t num_chunks = (num_words + (uint64_t)IMAGE_CHUNK_WORDS - 1)
+                          / IMAGE_CHUNK_WORDS;
+    size_t raw_capacity = IMAGE_CHUNK_WORDS * 4;
+    unsigned char *raw = malloc(raw_capacity);
+    unsigned char **chunks = malloc((num_chunks + 1) * sizeof(*chunks));
+    uint32_t *sizes = malloc((num_chunks + 1) * sizeof(*sizes));
+    uint64_t *hashes = malloc((num_chunks + 1) * sizeof(*hashes));
+    assert(raw != NULL && chunks != NULL && sizes != NULL
+           && hashes != NULL);
+
+    for (uint32_t i = 0; i < num_chunks; i++) {
+        uint32_t first = i * IMAGE_CHUNK_WORDS;
+        uint32_t count = num_words - first < IMAGE_CHUNK_WORDS
+                         ? num_words - first : IMAGE_CHUNK_WORDS;
+        size_t raw_size = (size_t)count * 4;
+
+        for (uint32_t j = 0; j < count; j++) {
+            uint32_t word = words[first + j];
+
+            raw[j * 4] = word >> 24;
+            raw[j * 4 + 1] = word >> 16;
+            raw[j * 4 + 2] = word >> 8;
+            raw[j * 4 + 3] = word;
+        }
+
+        hashes[i] = decode_image_hash(words + first, count);
+        chunks[i] = malloc(raw_size + raw_size / 255 + 16);
+        assert(chunks[i] != NULL);
+        sizes[i] = compress(raw, raw_size, chunks[i]);
+
+        /* Store what does not shrink as is, so no chunk grows */
+        if (sizes[i] >= raw_size) {
+            memcpy(chunks[i], raw, raw_size);
+            sizes[i] = raw_size;
+        }
+    }
+
+    uint64_t hash = decode_image_hash(words, num_words);
+
+    fwrite(magic, 1, sizeof(magic), fp);
+    put_be32(fp, VERSION);
+    put_be32(fp, num_words);
+    put_be32(fp, IMAGE_CHUNK_WORDS);
+    put_be32(fp, hash >> 32);
+    put_be32(fp, hash & 0xffffffff);
+    put_be32(fp, num_chunks);
+    for (uint32_t i = 0; i < num_chunks; i++) {
+        put_be32(fp, sizes[i]);
+        put_be32(fp, hashes[i] >> 32);
+        put_be32(fp, hashes[i] & 0xffffffff);
+    }
+    for (uint32_t i = 0; i < num_chunks; i++) {
+        fwrite(chunks[i], 1, sizes[i], fp);
+        free(chunks[i]);
+    }
+
+    free(raw);
+    free(chunks);
+    free(sizes);
+    free(hashes);
+
+    return fflush(fp) == 0 && !ferror(fp);
+}
+
+/* image_close
+ * Purpose: unmaps an image and frees it
+ * Parameters: a pointer to an Image
+ * Returns: Nothing
+ *
+ * Expected input: a pointer to an Image from image_open
+ * Success output: none (the Image is set to NULL)
+ * Failure output: none
+ */
+void image_close(Image *image)
+{
+    munmap((void *)(*image)->file, (*image)->file_size);
+    free((*image)->offsets);
+    free(*image);
+    *image = NULL;
+}
@@ -0,0 +1,152 @@
+/**************************************************************
+ *
+ *                         image.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class reads and writes compressed program images. A
+ *     compressed image holds the same words as a .um file, cut into
+ *     fixed-size chunks that are compressed independently, so that any
+ *     one chunk can be expanded without touching the others. um loads
+ *     either kind of file; pagein.h expands a compressed image's chunks
+ *     only when the program first touches them.
+ *
+ *     All integers are big-endian. The header is
+ *         bytes  0-3   the magic 0xf0 'U' 'M' 'Z'
+ *         bytes  4-7   the format version, 2
+ *         bytes  8-11  the number of words in the program
+ *         bytes 12-15  the number of words in each chunk (the last chunk
+ *                      may be shorter)
+ *         bytes 16-23  the decode_image_hash of the program's words
+ *         bytes 24-27  the number of chunks
+ *     followed by a 12-byte entry for each chunk, its compressed size in
+ *     bytes and then the decode_image_hash of its own words, then the
+ *     chunks themselves, in order. The chunk hashes let a chunk be
+ *     checked on its own when it is expanded lazily. Read as a UM instruction the magic is
+ *     the invalid opcode 15, so no runnable .um file starts with it.
+ *
+ *     A chunk is its words in .um byte order, compressed in an
+ *     LZ4-style block format: a run of sequences, each a token byte
+ *     (literal count in the high nibble, match length less 4 in the
+ *     low), further length bytes for a nibble of 15 (each adds up to
+ *     255; a byte below 255 ends the count), the literal bytes, and a
+ *     2-byte little-endian distance back to the match. The last
+ *     sequence has literals only. A chunk whose compressed size equals
+ *     its raw size is stored as is.
+ *
+ **************************************************************/
+#ifndef IMAGE_INCLUDED
+#define IMAGE_INCLUDED
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* 16 KB chunks: a whole number of pages on every common page size */
+#define IMAGE_CHUNK_WORDS 4096
+
+typedef struct Image *Image;
+
+/* image_open
+ * Purpose: opens a compressed program image
+ * Parameters: a string
+ * Returns: the Image, or NULL if the file is not a compressed image
+ *
+ * Expected input: the path of a program file
+ * Success output: an Image whose file is memory mapped; no chunk is
+                   expanded until image_unpack is called
+ * Failure output: NULL if the file cannot be read or does not start
+                   with the magic; exits the program, with a message on
+                   stderr, if it does but is of another format version
+                   or its header or chunk table is damaged
+ */
+Image image_open(const char *path);
+
+/* image_length
+ * Purpose: gives the number of words in an image's program
+ * Parameters: an Image
+ * Returns: the number of words
+ *
+ * Expected input: an open Image
+ * Success output: the length segment 0 should have
+ * Failure output: none
+ */
+uint32_t image_length(Image image);
+
+/* image_chunk_words
+ * Purpose: gives the number of words in each of an image's chunks
+ * Parameters: an Image
+ * Returns: the number of words
+ *
+ * Expected input: an open Image
+ * Success output: the chunk size (chunk i starts at word i times it)
+ * Failure output: none
+ */
+uint32_t image_chunk_words(Image image);
+
+/* image_hash
+ * Purpose: gives the hash stored in an image's header
+ * Parameters: an Image
+ * Returns: the hash
+ *
+ * Expected input: an open Image
+ * Success output: the decode_image_hash the program's words should have
+ * Failure output: none
+ */
+uint64_t image_hash(Image image);
+
+/* image_unpack
+ * Purpose: expands one chunk of an image
+ * Parameters: an Image, a uint32_t and a uint32_t pointer
+ * Returns: true if the chunk was expanded
+ *
+ * Expected input: an open Image, a chunk number, and where the chunk's
+                   first word goes (with room for the whole chunk)
+ * Success output: true, with the chunk's words stored in host order;
+                   it only reads and writes memory, so it is safe to
+                   call from a signal handler
+ * Failure output: false if the chunk number is out of range or the
+                   chunk's data is damaged
+ */
+bool image_unpack(Image image, uint32_t chunk, uint32_t *words);
+
+/* image_check
+ * Purpose: checks an expanded chunk against the hash in the chunk table
+ * Parameters: an Image, a uint32_t and a uint32_t pointer
+ * Returns: true if the chunk's words match its hash
+ *
+ * Expected input: an open Image, a chunk number, and the chunk's words
+                   as image_unpack left them
+ * Success output: true; like image_unpack, it only reads memory, so it
+                   is safe to call from a signal handler
+ * Failure output: false if the chunk number is out of range or the
+                   words differ from the ones the image was written with
+ */
+bool image_check(Image image, uint32_t chunk, const uint32_t *words);
+
+/* image_write
+ * Purpose: writes a program as a compressed image
+ * Parameters: a FILE pointer, a uint32_t pointer and a uint32_t
+ * Returns: true if the image was written
+ *
+ * Expected input: a stream open for binary writing, and the words of
+                   the program and their number
+ * Success output: true
+ * Failure output: false if the stream reported an error
+ */
+bool image_write(FILE *fp, const uint32_t *words, uint32_t num_words);
+
+/* image_close
+ * Purpose: unmaps an image and frees it
+ * Parameters: a pointer to an Image
+ * Returns: Nothing
+ *
+ * Expected input: a pointer to an Image from image_open
+ * Success output: none (the Image is set to NULL)
+ * Failure output: none
+ */
+void image_close(Image *image);
+
+#endif
@@ -10,14 +10,122 @@
  *     Implementation of the instruction class.
  *     
  **************************************************************/
+#include <string.h>
+
 #include "instruction.h"
+#include "decode.h"
+#include "console.h"
+#include "metrics.h"
+
+/* Each UM runs on a thread of its own, so its state is thread-local */
+static __thread uint32_t registers[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+static __thread Device input_device = NULL;     /* the console if NULL */
+static __thread Device output_device = NULL;    /* the console if NULL */
+static __thread Um_hook input_hook = NULL;
+static __thread Um_hook output_hook = NULL;
+
+/* bind_devices
+ * Purpose: connects the calling thread's UM to devices of its own
+            instead of the console
+ * Parameters: two Devices
+ * Returns: Nothing
+ *
+ * Expected input: the devices for IN and OUT to use, either of which
+                   may be NULL to keep the console; the caller still owns
+                   them
+ * Success output: none
+ * Failure output: none
+ */
+void bind_devices(Device input, Device output)
+{
+    input_device = input;
+    output_device = output;
+}
+
+/* get_registers
+ * Purpose: copies out the calling thread's registers
+ * Parameters: an array of 8 uint32_ts
+ * Returns: Nothing
+ *
+ * Expected input: where to copy the registers
+ * Success output: none (copy holds r0 to r7)
+ * Failure output: none
+ */
+void get_registers(uint32_t copy[8])
+{
+    memcpy(copy, registers, sizeof(registers));
+}
 
-typedef enum Um_opcode {
-        CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
-        NAND, HALT, ACTIVATE, INACTIVATE, OUT, IN, LOADP, LV
-} Um_opcode;
+/* set_registers
+ * Purpose: sets all of the calling thread's registers
+ * Parameters: an array of 8 uint32_ts
+ * Returns: Nothing
+ *
+ * Expected input: the values for r0 to r7
+ * Success output: none
+ * Failure output: none
+ */
+void set_registers(const uint32_t copy[8])
+{
+    memcpy(registers, copy, sizeof(registers));
+}
 
-uint32_t registers[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+/* hook_input
+ * Purpose: arranges for a function to run just before the calling
+            thread's UM next executes IN
+ * Parameters: a Um_hook
+ * Returns: the hook this replaces, or NULL
+ *
+ * Expected input: the function to call, or NULL to cancel
+ * Success output: the previous hook (the new one is called once, with
+                   the address of the IN, before the byte is read, and
+                   may rebind the devices)
+ * Failure output: none
+ */
+Um_hook hook_input(Um_hook hook)
+{
+    Um_hook previous = input_hook;
+
+    input_hook = hook;
+    return previous;
+}
+
+/* hook_output
+ * Purpose: arranges for a function to run just before the calling
+            thread's UM next executes OUT
+ * Parameters: a Um_hook
+ * Returns: the hook this replaces, or NULL
+ *
+ * Expected input: the function to call, or NULL to cancel
+ * Success output: the previous hook (the new one is called once, with
+                   the address of the OUT, before the byte is written)
+ * Failure output: none
+ */
+Um_hook hook_output(Um_hook hook)
+{
+    Um_hook previous = output_hook;
+
+    output_hook = hook;
+    return previous;
+}
+
+/* run_hook
+ * Purpose: disarms a hook and calls it
+ * Parameters: a pointer to a Um_hook and an int
+ * Returns: Nothing
+ *
+ * Expected input: input_hook or output_hook, which is not NULL, and the
+                   program counter after the instruction was fetched
+ * Success output: none
+ * Failure output: none
+ */
+static void run_hook(Um_hook *slot, int prog_counter)
+{
+    Um_hook hook = *slot;
+
+    *slot = NULL;
+    hook(prog_counter - 1);
+}
 
 /* opcode_reader
  * Purpose: Reads in an instruction and calls the appropriate function
@@ -91,9 +199,15 @@ void opcode_reader(Um_instruction instruction, bool *continue_execution,
             unmap_seg(Bitpack_getu(instruction, 3, 0));
             return;
         case OUT:
+            if (output_hook != NULL) {
+                run_hook(&output_hook, *prog_counter);
+            }
             output(Bitpack_getu(instruction, 3, 0));
             return;
         case IN:
+            if (input_hook != NULL) {
+                run_hook(&input_hook, *prog_counter);
+            }
             input(Bitpack_getu(instruction, 3, 0));
             return;
         case LOADP:
@@ -111,6 +225,148 @@ void opcode_reader(Um_instruction instruction, bool *continue_execution,
     }
 }
 
+/* decoded_reader
+ * Purpose: Calls the function for an instruction that has already been
+            unpacked by the decode class
+ * Parameters: a pointer to the decoded instruction, a bool pointer of
+ *             whether to continue running the program, and an int
+ *             pointer representing the program counter
+ * Returns: none
+ *
+ * Expected input: an instruction from decode_fetch, valid bool and int
+                   pointers
+ * Success output: no direct output, but instructions are successfully called
+ * Failure output: exits the program under the same conditions as
+                   opcode_reader
+ */
+void decoded_reader(const struct Um_decoded *instruction,
+                    bool *continue_execution, int *prog_counter)
+{
+    Um_register a = instruction->a;
+    Um_register b = instruction->b;
+    Um_register c = instruction->c;
+
+    switch(instruction->op) {
+        case CMOV:
+            cmov(a, b, c);
+            return;
+        case SLOAD:
+            seg_load(a, b, c);
+            return;
+        case SSTORE:
+            seg_store(a, b, c);
+            return;
+        case ADD:
+            add(a, b, c);
+            return;
+        case MUL:
+            multiply(a, b, c);
+            return;
+        case DIV:
+            divide(a, b, c);
+            return;
+        case NAND:
+            nand(a, b, c);
+            return;
+        case HALT:
+            *continue_execution = false;
+            return;
+        case ACTIVATE:
+            map_seg(b, c);
+            return;
+        case INACTIVATE:
+            unmap_seg(c);
+            return;
+        case OUT:
+            if (output_hook != NULL) {
+                run_hook(&output_hook, *prog_counter);
+            }
+            output(c);
+            return;
+        case IN:
+            if (input_hook != NULL) {
+                run_hook(&input_hook, *prog_counter);
+            }
+            input(c);
+            return;
+        case LOADP:
+            *prog_counter = registers[c];
+            loadprog(b);
+
+            if (*prog_counter >= seg_zero_length()) {
+                exit(1);
+            }
+            return;
+        case LV:
+            loadval(a, instruction->value);
+            return;
+        case UM_TRAP:
+            instruction->handler(instruction, continue_execution,
+                                 prog_counter);
+            return;
+        default:
+            exit(1);
+    }
+}
+
+/* The handlers generated by genspecial: special_cmov, special_sload and
+ * so on, each a table of 512 handlers indexed by register triple */
+#include "special.inc"
+
+/* select_handler
+ * Purpose: picks the handler that runs a decoded instruction
+ * Parameters: a pointer to the decoded instruction
+ * Returns: a pointer to the handler
+ *
+ * Expected input: an instruction unpacked by decode_word
+ * Success output: for CMOV, SLOAD, SSTORE, ADD and NAND, the handler
+                   generated for its register triple, which ignores its
+                   arguments; decoded_reader for every other opcode
+ * Failure output: none
+ */
+Um_handler *select_handler(const struct Um_decoded *instruction)
+{
+    int triple = instruction->a << 6 | instruction->b << 3 | instruction->c;
+
+    switch (instruction->op) {
+        case CMOV:
+            return special_cmov[triple];
+        case SLOAD:
+            return special_sload[triple];
+        case SSTORE:
+            return special_sstore[triple];
+        case ADD:
+            return special_add[triple];
+        case NAND:
+            return special_nand[triple];
+        default:
+            return decoded_reader;
+    }
+}
+
+/* select_handler_branchless
+ * Purpose: picks the handler that runs a decoded instruction, using the
+            branchless CMOV handlers
+ * Parameters: a pointer to the decoded instruction
+ * Returns: a pointer to the handler
+ *
+ * Expected input: an instruction unpacked by decode_word
+ * Success output: as select_handler, except that a CMOV's handler
+                   selects between the two values with a mask instead of
+                   a branch
+ * Failure output: none
+ */
+Um_handler *select_handler_branchless(const struct Um_decoded *instruction)
+{
+    if (instruction->op == CMOV) {
+        return special_cmov_branchless[instruction->a << 6
+                                       | instruction->b << 3
+                                       | instruction->c];
+    }
+
+    return select_handler(instruction);
+}
+
 /* cmov
  * Purpose: moves the value in register a into register b if
             register c does not equal 0
@@ -282,8 +538,13 @@ void output(Um_register c)
     char output_char = registers[c];
 
     assert(registers[c] < 256);
+    METRICS_ADD(output_bytes, 1);
 
-    putchar(output_char);
+    if (output_device != NULL) {
+        device_putc(output_device, (unsigned char)output_char);
+    } else {
+        console_putc((unsigned char)output_char);
+    }
 }
 
 /* input
@@ -298,12 +559,14 @@ void output(Um_register c)
  */
 void input(Um_register c)
 {
-    int character = getchar();
+    int character = input_device != NULL ? device_getc(input_device)
+                                         : console_getc();
 
     if (character == EOF) {
         registers[c] = ~0U;
     } else {
         registers[c] = character;
+        METRICS_ADD(input_bytes, 1);
     }
 }
 
@@ -336,4 +599,417 @@ void loadval(Um_register a, uint32_t value)
 void loadprog(Um_register b)
 {
     replace_segment_zero(registers[b]);
-}
\ No newline at end of file
+}
+
+/*
+ * The tail-call interpreter. Every handler has the same signature: the
+ * registers, the words of m[0], the address and word of the instruction
+ * it runs, the number of instructions run so far (counting this one),
+ * and the few things that rarely change. With a guaranteed tail call
+ * (clang's musttail, GCC 15's too) each handler ends by fetching the
+ * next word and jumping to its handler, so the arguments stay in
+ * machine registers for the whole run and no stack builds up. Without
+ * one, a handler returns the next address to a loop in tail_execute
+ * instead; a plain call there would grow the stack when built without
+ * optimisation.
+ */
+#if defined(__has_attribute)
+#if __has_attribute(musttail)
+#define TAIL_CALLS 1
+#endif
+#endif
+
+#define FIELD_A(word) (((word) >> 6) & 7)
+#define FIELD_B(word) (((word) >> 3) & 7)
+#define FIELD_C(word) ((word) & 7)
+
+/* Returned by HALT; no address in m[0] is this large */
+#define TAIL_HALTED UINT64_MAX
+
+typedef struct Tail_state {
+        uint32_t *m0;           /* changed only by LOADP */
+        uint32_t length;        /* of m[0] */
+        uint64_t count;         /* set by HALT */
+        bool publish;           /* keep um_metrics up to date */
+} Tail_state;
+
+typedef uint64_t Tail_handler(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                              uint32_t word, uint64_t count,
+                              Tail_state *state);
+
+static Tail_handler tail_cmov, tail_sload, tail_sstore, tail_add, tail_mul,
+                    tail_div, tail_nand, tail_halt, tail_map, tail_unmap,
+                    tail_out, tail_in, tail_loadp, tail_lv, tail_invalid;
+
+/* Indexed by the opcode field, so opcodes 14 and 15 need entries too */
+static Tail_handler *const tail_handlers[16] = {
+        tail_cmov, tail_sload, tail_sstore, tail_add, tail_mul, tail_div,
+        tail_nand, tail_halt, tail_map, tail_unmap, tail_out, tail_in,
+        tail_loadp, tail_lv, tail_invalid, tail_invalid
+};
+
+#ifdef TAIL_CALLS
+#define TAIL_NEXT(next_pc) do {                                             \
+        uint32_t pc_ = (next_pc);                                           \
+        if (pc_ >= state->length) {                                         \
+            exit(1);                                                        \
+        }                                                                   \
+        uint32_t word_ = m0[pc_];                                           \
+        if (__builtin_expect(state->publish, false)) {                      \
+            METRICS_SET(prog_counter, pc_);                                 \
+            METRICS_SET(instructions, count + 1);                           \
+        }                                                                   \
+        __attribute__((musttail)) return tail_handlers[word_ >> 28](        \
+                regs, m0, pc_, word_, count + 1, state);                    \
+    } while (0)
+#else
+#define TAIL_NEXT(next_pc) do {                                             \
+        (void)regs;                                                         \
+        (void)m0;                                                           \
+        (void)word;                                                         \
+        (void)count;                                                        \
+        (void)state;                                                        \
+        return (next_pc);                                                   \
+    } while (0)
+#endif
+
+/* tail_cmov
+ * Purpose: runs CMOV, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: a CMOV word at pc
+ * Success output: none (rA is set to rB if rC is not 0)
+ * Failure output: none
+ */
+static uint64_t tail_cmov(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                          uint32_t word, uint64_t count, Tail_state *state)
+{
+    if (regs[FIELD_C(word)] != 0) {
+        regs[FIELD_A(word)] = regs[FIELD_B(word)];
+    }
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_sload
+ * Purpose: runs SLOAD, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: an SLOAD word at pc
+ * Success output: none (rA is set to m[rB][rC])
+ * Failure output: exits the program if the address is out of bounds
+ */
+static uint64_t tail_sload(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                           uint32_t word, uint64_t count, Tail_state *state)
+{
+    regs[FIELD_A(word)] = get_word(regs[FIELD_B(word)],
+                                   regs[FIELD_C(word)]);
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_sstore
+ * Purpose: runs SSTORE, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: an SSTORE word at pc
+ * Success output: none (m[rA][rB] is set to rC; a store into m[0] is
+                   seen by the next fetch, since fetches read m[0])
+ * Failure output: exits the program if the address is out of bounds
+ */
+static uint64_t tail_sstore(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                            uint32_t word, uint64_t count, Tail_state *state)
+{
+    set_word(regs[FIELD_A(word)], regs[FIELD_B(word)], regs[FIELD_C(word)]);
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_add
+ * Purpose: runs ADD, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: an ADD word at pc
+ * Success output: none (rA is set to rB + rC mod 2^32)
+ * Failure output: none
+ */
+static uint64_t tail_add(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                         uint32_t word, uint64_t count, Tail_state *state)
+{
+    regs[FIELD_A(word)] = regs[FIELD_B(word)] + regs[FIELD_C(word)];
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_mul
+ * Purpose: runs MUL, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: a MUL word at pc
+ * Success output: none (rA is set to rB * rC mod 2^32)
+ * Failure output: none
+ */
+static uint64_t tail_mul(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                         uint32_t word, uint64_t count, Tail_state *state)
+{
+    regs[FIELD_A(word)] = regs[FIELD_B(word)] * regs[FIELD_C(word)];
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_div
+ * Purpose: runs DIV, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: a DIV word at pc
+ * Success output: none (rA is set to rB / rC)
+ * Failure output: exits the program if rC is 0
+ */
+static uint64_t tail_div(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                         uint32_t word, uint64_t count, Tail_state *state)
+{
+    if (regs[FIELD_C(word)] == 0) {
+        exit(1);
+    }
+    regs[FIELD_A(word)] = regs[FIELD_B(word)] / regs[FIELD_C(word)];
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_nand
+ * Purpose: runs NAND, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: a NAND word at pc
+ * Success output: none (rA is set to ~(rB & rC))
+ * Failure output: none
+ */
+static uint64_t tail_nand(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                          uint32_t word, uint64_t count, Tail_state *state)
+{
+    regs[FIELD_A(word)] = ~(regs[FIELD_B(word)] & regs[FIELD_C(word)]);
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_halt
+ * Purpose: runs HALT
+ * Parameters: the tail-call handler arguments
+ * Returns: TAIL_HALTED
+ *
+ * Expected input: a HALT word at pc
+ * Success output: TAIL_HALTED, with the instruction count in state
+ * Failure output: none
+ */
+static uint64_t tail_halt(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                          uint32_t word, uint64_t count, Tail_state *state)
+{
+    (void)regs;
+    (void)m0;
+    (void)pc;
+    (void)word;
+
+    state->count = count;
+    return TAIL_HALTED;
+}
+
+/* tail_map
+ * Purpose: runs MAP, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: a MAP word at pc
+ * Success output: none (rB is set to the index of a new segment of rC
+                   words)
+ * Failure output: none
+ */
+static uint64_t tail_map(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                         uint32_t word, uint64_t count, Tail_state *state)
+{
+    map_seg(FIELD_B(word), FIELD_C(word));
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_unmap
+ * Purpose: runs UNMAP, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: an UNMAP word at pc
+ * Success output: none (segment rC is freed)
+ * Failure output: exits the program if rC is not a mapped segment
+ */
+static uint64_t tail_unmap(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                           uint32_t word, uint64_t count, Tail_state *state)
+{
+    unmap_seg(FIELD_C(word));
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_out
+ * Purpose: runs OUT, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: an OUT word at pc
+ * Success output: none (the output hook, if any, is run, and rC is
+                   written)
+ * Failure output: none
+ */
+static uint64_t tail_out(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                         uint32_t word, uint64_t count, Tail_state *state)
+{
+    if (output_hook != NULL) {
+        run_hook(&output_hook, pc + 1);
+    }
+    output(FIELD_C(word));
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_in
+ * Purpose: runs IN, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: an IN word at pc
+ * Success output: none (the input hook, if any, is run, and rC is set
+                   to the next input byte, or all ones at end of file)
+ * Failure output: none
+ */
+static uint64_t tail_in(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                        uint32_t word, uint64_t count, Tail_state *state)
+{
+    if (input_hook != NULL) {
+        run_hook(&input_hook, pc + 1);
+    }
+    input(FIELD_C(word));
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_loadp
+ * Purpose: runs LOADP, then the instruction it jumps to
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: a LOADP word at pc
+ * Success output: none (m[0] is replaced by a copy of segment rB unless
+                   rB is 0, and execution continues at rC)
+ * Failure output: exits the program if rB is not a mapped segment or rC
+                   is past the end of the new m[0]
+ */
+static uint64_t tail_loadp(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                           uint32_t word, uint64_t count, Tail_state *state)
+{
+    uint32_t target = regs[FIELD_C(word)];
+
+    (void)pc;
+    if (regs[FIELD_B(word)] != 0) {
+        loadprog(FIELD_B(word));
+        m0 = segment_words(0, &state->length);
+        state->m0 = m0;
+    }
+    TAIL_NEXT(target);
+}
+
+/* tail_lv
+ * Purpose: runs LV, then the next instruction
+ * Parameters: the tail-call handler arguments
+ * Returns: as tail_execute's handlers do (see above)
+ *
+ * Expected input: an LV word at pc
+ * Success output: none (the register in bits 25 to 27 is set to the
+                   low 25 bits)
+ * Failure output: none
+ */
+static uint64_t tail_lv(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                        uint32_t word, uint64_t count, Tail_state *state)
+{
+    regs[(word >> 25) & 7] = word & 0x1ffffff;
+    TAIL_NEXT(pc + 1);
+}
+
+/* tail_invalid
+ * Purpose: stops on opcodes 14 and 15
+ * Parameters: the tail-call handler arguments
+ * Returns: does not return
+ *
+ * Expected input: an invalid word at pc
+ * Success output: none
+ * Failure output: always exits the program
+ */
+static uint64_t tail_invalid(uint32_t *regs, uint32_t *m0, uint32_t pc,
+                             uint32_t word, uint64_t count,
+                             Tail_state *state)
+{
+    (void)regs;
+    (void)m0;
+    (void)pc;
+    (void)word;
+    (void)count;
+    (void)state;
+
+    exit(1);
+}
+
+/* tail_execute
+ * Purpose: runs the program in m[0] with the tail-call interpreter
+ * Parameters: a uint32_t and a bool
+ * Returns: the number of instructions executed
+ *
+ * Expected input: the address to start at, with m[0] loaded on the
+                   calling thread, and whether to publish the program
+                   counter and instruction count in um_metrics before
+                   each instruction (for --metrics and --profile)
+ * Success output: the instruction count, once the program halts; each
+                   opcode has a handler of its own, and each handler ends
+                   by jumping straight to the handler for the next
+                   instruction (with a guaranteed tail call where the
+                   compiler offers one, and through a loop otherwise)
+ * Failure output: exits the program under the same conditions as
+                   opcode_reader, or if execution runs off the end of m[0]
+ */
+uint64_t tail_execute(uint32_t prog_counter, bool publish)
+{
+    Tail_state state;
+
+    state.m0 = segment_words(0, &state.length);
+    state.count = 0;
+    state.publish = publish;
+
+    if (prog_counter >= state.length) {
+        exit(1);
+    }
+
+#ifdef TAIL_CALLS
+    uint32_t word = state.m0[prog_counter];
+
+    if (publish) {
+        METRICS_SET(prog_counter, prog_counter);
+        METRICS_SET(instructions, 1);
+    }
+
+    tail_handlers[word >> 28](registers, state.m0, prog_counter, word, 1,
+                              &state);
+#else
+    uint64_t pc = prog_counter;
+    uint64_t count = 0;
+
+    do {
+        if (pc >= state.length) {
+            exit(1);
+        }
+
+        uint32_t word = state.m0[pc];
+
+        count++;
+        if (publish) {
+            METRICS_SET(prog_counter, pc);
+            METRICS_SET(instructions, count);
+        }
+        pc = tail_handlers[word >> 28](registers, state.m0, pc, word, count,
+                                       &state);
+    } while (pc != TAIL_HALTED);
+#endif
+
+    return state.count;
+}
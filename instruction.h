@@ -9,7 +9,9 @@
  *     Summary
  *     This class allows the user to execute instructions that are
  *     encoded in the first four bits of a 32-bit instruction word,
- *     performing basic operations on a set of eight registers.
+ *     performing basic operations on a set of eight registers. The
+ *     registers, like the rest of a UM's state, belong to the thread
+ *     running it, so several UMs can run at once on different threads.
  *     
  **************************************************************/
 #ifndef INSTRUCTIONS_INCLUDED
@@ -19,11 +21,89 @@
 #include <stdlib.h>
 
 #include "bitpack.h"
+#include "device.h"
 #include "segment.h"
 
 typedef uint32_t Um_instruction;
+typedef enum Um_opcode {
+        CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
+        NAND, HALT, ACTIVATE, INACTIVATE, OUT, IN, LOADP, LV
+} Um_opcode;
 typedef enum Um_register { r0 = 0, r1, r2, r3, r4, r5, r6, r7 } Um_register;
 
+/* Defined in decode.h */
+struct Um_decoded;
+
+/* Called before an IN or OUT with the instruction's address in m[0] */
+typedef void (*Um_hook)(uint32_t prog_counter);
+
+/* Runs one decoded instruction; decoded_reader is the general one */
+typedef void Um_handler(const struct Um_decoded *instruction,
+                        bool *continue_execution, int *prog_counter);
+
+/* bind_devices
+ * Purpose: connects the calling thread's UM to devices of its own
+            instead of the console
+ * Parameters: two Devices
+ * Returns: Nothing
+ *
+ * Expected input: the devices for IN and OUT to use, either of which
+                   may be NULL to keep the console; the caller still owns
+                   them
+ * Success output: none
+ * Failure output: none
+ */
+void bind_devices(Device input, Device output);
+
+/* get_registers
+ * Purpose: copies out the calling thread's registers
+ * Parameters: an array of 8 uint32_ts
+ * Returns: Nothing
+ *
+ * Expected input: where to copy the registers
+ * Success output: none (copy holds r0 to r7)
+ * Failure output: none
+ */
+void get_registers(uint32_t copy[8]);
+
+/* set_registers
+ * Purpose: sets all of the calling thread's registers
+ * Parameters: an array of 8 uint32_ts
+ * Returns: Nothing
+ *
+ * Expected input: the values for r0 to r7
+ * Success output: none
+ * Failure output: none
+ */
+void set_registers(const uint32_t copy[8]);
+
+/* hook_input
+ * Purpose: arranges for a function to run just before the calling
+            thread's UM next executes IN
+ * Parameters: a Um_hook
+ * Returns: the hook this replaces, or NULL
+ *
+ * Expected input: the function to call, or NULL to cancel
+ * Success output: the previous hook (the new one is called once, with
+                   the address of the IN, before the byte is read, and
+                   may rebind the devices)
+ * Failure output: none
+ */
+Um_hook hook_input(Um_hook hook);
+
+/* hook_output
+ * Purpose: arranges for a function to run just before the calling
+            thread's UM next executes OUT
+ * Parameters: a Um_hook
+ * Returns: the hook this replaces, or NULL
+ *
+ * Expected input: the function to call, or NULL to cancel
+ * Success output: the previous hook (the new one is called once, with
+                   the address of the OUT, before the byte is written)
+ * Failure output: none
+ */
+Um_hook hook_output(Um_hook hook);
+
 /* opcode_reader
  * Purpose: Reads in an instruction and calls the appropriate function
  * Parameters: the instruction as an Um_instruction (uint32_t), a bool
@@ -40,6 +120,69 @@ typedef enum Um_register { r0 = 0, r1, r2, r3, r4, r5, r6, r7 } Um_register;
 void opcode_reader(Um_instruction instruction, bool *continue_execution,
                                                int *prog_counter);
 
+/* decoded_reader
+ * Purpose: Calls the function for an instruction that has already been
+            unpacked by the decode class
+ * Parameters: a pointer to the decoded instruction, a bool pointer of
+ *             whether to continue running the program, and an int
+ *             pointer representing the program counter
+ * Returns: none
+ *
+ * Expected input: an instruction from decode_fetch, valid bool and int
+                   pointers
+ * Success output: no direct output, but instructions are successfully called
+ * Failure output: exits the program under the same conditions as
+                   opcode_reader
+ */
+void decoded_reader(const struct Um_decoded *instruction,
+                    bool *continue_execution, int *prog_counter);
+
+/* select_handler
+ * Purpose: picks the handler that runs a decoded instruction
+ * Parameters: a pointer to the decoded instruction
+ * Returns: a pointer to the handler
+ *
+ * Expected input: an instruction unpacked by decode_word
+ * Success output: for CMOV, SLOAD, SSTORE, ADD and NAND, the handler
+                   generated for its register triple, which ignores its
+                   arguments; decoded_reader for every other opcode
+ * Failure output: none
+ */
+Um_handler *select_handler(const struct Um_decoded *instruction);
+
+/* select_handler_branchless
+ * Purpose: picks the handler that runs a decoded instruction, using the
+            branchless CMOV handlers
+ * Parameters: a pointer to the decoded instruction
+ * Returns: a pointer to the handler
+ *
+ * Expected input: an instruction unpacked by decode_word
+ * Success output: as select_handler, except that a CMOV's handler
+                   selects between the two values with a mask instead of
+                   a branch
+ * Failure output: none
+ */
+Um_handler *select_handler_branchless(const struct Um_decoded *instruction);
+
+/* tail_execute
+ * Purpose: runs the program in m[0] with the tail-call interpreter
+ * Parameters: a uint32_t and a bool
+ * Returns: the number of instructions executed
+ *
+ * Expected input: the address to start at, with m[0] loaded on the
+                   calling thread, and whether to publish the program
+                   counter and instruction count in um_metrics before
+                   each instruction (for --metrics and --profile)
+ * Success output: the instruction count, once the program halts; each
+                   opcode has a handler of its own, and each handler ends
+                   by jumping straight to the handler for the next
+                   instruction (with a guaranteed tail call where the
+                   compiler offers one, and through a loop otherwise)
+ * Failure output: exits the program under the same conditions as
+                   opcode_reader, or if execution runs off the end of m[0]
+ */
+uint64_t tail_execute(uint32_t prog_counter, bool publish);
+
 /* cmov
  * Purpose: moves the value in register a into register b if
             register c does not equal 0
@@ -0,0 +1,79 @@
+/**************************************************************
+ *
+ *                         loader.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the loader class.
+ *
+ **************************************************************/
+#include <sys/stat.h>
+
+#include "loader.h"
+#include "segment.h"
+#include "image.h"
+#include "pagein.h"
+
+/* load_program
+ * Purpose: maps m[0] for the calling thread's UM and reads a program
+            into it
+ * Parameters: a string and an int pointer
+ * Returns: a pointer to the words of m[0]
+ *
+ * Expected input: the path of a UM file, and where to store its length
+                   in words
+ * Success output: m[0], holding the program; for a compressed image
+                   its chunks are expanded on first touch
+ * Failure output: raises an exception if the file cannot be opened
+ */
+uint32_t *load_program(const char *path, int *num_words)
+{
+    struct stat buf;
+
+    Image image = image_open(path);
+    if (image != NULL) {
+        return pagein_load(image, num_words);
+    }
+
+    FILE *fp = fopen(path, "r");
+    assert(fp != NULL);
+
+    stat(path, &buf);
+    *num_words = buf.st_size / 4;
+
+    uint32_t *segment_zero = init_segment(*num_words);
+
+    read_words(fp, segment_zero, *num_words);
+    fclose(fp);
+
+    return segment_zero;
+}
+
+/* read_words
+ * Purpose: Reads the instructions from a file into segment 0
+ * Parameters: a file pointer, a uint32_t pointer, and an integer
+ * Returns: Nothing
+ *
+ * Expected input: A file pointer pointing to a file that is filled with
+                    valid um instructions, the words of segment 0, and
+                    the number of uint32_t words in that fiile
+ * Success output: segment 0 contains all of the instructions in the
+                    supplied file in the proper order
+ * Failure output: none
+ */
+void read_words(FILE *fp, uint32_t *segment_zero, int num_words)
+{
+    for (int i = 0; i < num_words; i++) {
+        uint32_t curr_word = 0;
+
+        for (int j = 24; j >= 0; j -= 8) {
+            uint32_t c = fgetc(fp);
+            curr_word = Bitpack_newu(curr_word, 8, j, c);
+        }
+
+        segment_zero[i] = curr_word;
+    }
+}
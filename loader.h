@@ -0,0 +1,49 @@
+/**************************************************************
+ *
+ *                         loader.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class loads a program file into segment 0 for the calling
+ *     thread's UM. It reads raw .um files word by word, and hands
+ *     compressed images (image.h) to pagein.h to be expanded as they
+ *     are touched.
+ *
+ **************************************************************/
+#ifndef LOADER_INCLUDED
+#define LOADER_INCLUDED
+#include <stdint.h>
+#include <stdio.h>
+
+/* load_program
+ * Purpose: maps m[0] for the calling thread's UM and reads a program
+            into it
+ * Parameters: a string and an int pointer
+ * Returns: a pointer to the words of m[0]
+ *
+ * Expected input: the path of a UM file, and where to store its length
+                   in words
+ * Success output: m[0], holding the program; for a compressed image
+                   its chunks are expanded on first touch
+ * Failure output: raises an exception if the file cannot be opened
+ */
+uint32_t *load_program(const char *path, int *num_words);
+
+/* read_words
+ * Purpose: Reads the instructions from a file into segment 0
+ * Parameters: a file pointer, a uint32_t pointer, and an integer
+ * Returns: Nothing
+ *
+ * Expected input: A file pointer pointing to a file that is filled with
+                    valid um instructions, the words of segment 0, and
+                    the number of uint32_t words in that fiile
+ * Success output: segment 0 contains all of the instructions in the
+                    supplied file in the proper order
+ * Failure output: none
+ */
+void read_words(FILE *fp, uint32_t *segment_zero, int num_words);
+
+#endif
@@ -0,0 +1,266 @@
+/**************************************************************
+ *
+ *                         memo.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the memo class.
+ *
+ **************************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "memo.h"
+#include "decode.h"
+#include "instruction.h"
+#include "segment.h"
+
+#define MEMO_MAGIC "UMMEMO1\n"
+#define HEADER_WORDS 14         /* magic, hash, length, pc, registers */
+
+static char *snapshot_path = NULL;
+static uint64_t image_hash = 0;
+static uint32_t image_length = 0;
+static Um_hook next_input_hook = NULL;
+
+/* make_path
+ * Purpose: names the snapshot for an image
+ * Parameters: a string and a uint64_t
+ * Returns: a newly allocated string
+ *
+ * Expected input: the cache directory and the image's hash
+ * Success output: "<cache_dir>/<hash in hex>.snap"; the caller frees it
+ * Failure output: none
+ */
+static char *make_path(const char *cache_dir, uint64_t hash)
+{
+    size_t size = strlen(cache_dir) + 32;
+    char *path = malloc(size);
+    assert(path != NULL);
+
+    snprintf(path, size, "%s/%016" PRIx64 ".snap", cache_dir, hash);
+    return path;
+}
+
+/* memo_resume
+ * Purpose: restores the registers and segments from a snapshot
+ * Parameters: a string, a uint32_t pointer pointer, and two int pointers
+ * Returns: true if the snapshot was read and restored
+ *
+ * Expected input: the snapshot's path, and where to store m0, its
+                   length and the program counter
+ * Success output: true
+ * Failure output: false, leaving everything as it was, if there is no
+                   snapshot or it does not match the image
+ */
+static bool memo_resume(const char *path, uint32_t **segment_zero,
+                        int *num_words, int *prog_counter)
+{
+    struct stat buf;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0 || fstat(fd, &buf) != 0
+        || (size_t)buf.st_size < HEADER_WORDS * sizeof(uint32_t)
+        || buf.st_size % sizeof(uint32_t) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    size_t size = buf.st_size;
+    const uint32_t *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        return false;
+    }
+
+    uint32_t *words = NULL;
+
+    if (memcmp(data, MEMO_MAGIC, 8) == 0
+        && data[2] == (uint32_t)image_hash
+        && data[3] == (uint32_t)(image_hash >> 32)
+        && data[4] == image_length) {
+        words = restore_segments(data + HEADER_WORDS,
+                                 size / sizeof(uint32_t) - HEADER_WORDS);
+    }
+
+    if (words != NULL) {
+        *segment_zero = words;
+        *num_words = seg_zero_length();
+        *prog_counter = data[5];
+        set_registers(data + 6);
+    }
+
+    munmap((void *)data, size);
+    return words != NULL;
+}
+
+/* memo_save
+ * Purpose: writes a snapshot of the UM as it is about to execute IN
+ * Parameters: a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the address of the IN, with no OUT executed yet
+ * Success output: none (the snapshot is written to a temporary file and
+                   renamed into place, so readers never see part of one)
+ * Failure output: none (the snapshot is skipped, with a message on
+                   stderr)
+ */
+static void memo_save(uint32_t prog_counter)
+{
+    size_t size = strlen(snapshot_path) + 32;
+    char *temp_path = malloc(size);
+    uint32_t header[HEADER_WORDS];
+
+    assert(temp_path != NULL);
+    snprintf(temp_path, size, "%s.%ld.tmp", snapshot_path, (long)getpid());
+
+    memcpy(header, MEMO_MAGIC, 8);
+    header[2] = (uint32_t)image_hash;
+    header[3] = (uint32_t)(image_hash >> 32);
+    header[4] = image_length;
+    header[5] = prog_counter;
+    get_registers(header + 6);
+
+    FILE *fp = fopen(temp_path, "wb");
+    bool ok = fp != NULL
+              && fwrite(header, sizeof(uint32_t), HEADER_WORDS, fp)
+                 == HEADER_WORDS
+              && save_segments(fp);
+
+    if (fp != NULL && fclose(fp) != 0) {
+        ok = false;
+    }
+    if (ok && rename(temp_path, snapshot_path) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "um: cannot write snapshot %s\n", snapshot_path);
+        unlink(temp_path);
+    }
+
+    free(temp_path);
+}
+
+/* memo_input
+ * Purpose: saves the snapshot at the first IN
+ * Parameters: a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the address of the IN
+ * Success output: none (the snapshot is saved and any hook this one
+                   replaced is called)
+ * Failure output: none
+ */
+static void memo_input(uint32_t prog_counter)
+{
+    hook_output(NULL);
+    memo_save(prog_counter);
+
+    if (next_input_hook != NULL) {
+        next_input_hook(prog_counter);
+    }
+}
+
+/* memo_output
+ * Purpose: gives up on the snapshot when OUT comes before IN
+ * Parameters: a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the address of the OUT
+ * Success output: none (the hook memo_input replaced is put back)
+ * Failure output: none
+ */
+static void memo_output(uint32_t prog_counter)
+{
+    (void)prog_counter;
+    hook_input(next_input_hook);
+}
+
+/* memo_start
+ * Purpose: resumes a program from its snapshot, or arranges for one to
+            be taken
+ * Parameters: a string, a pointer to the words of m0, an int pointer
+               and an int pointer
+ * Returns: true if the program was resumed from a snapshot
+ *
+ * Expected input: the cache directory, and the loaded program's m0,
+                   length and starting program counter, on the thread
+                   that will run it
+ * Success output: true, with m0, its length and the program counter
+                   updated to the snapshot's and the registers and
+                   segments restored; or false, with the program as it
+                   was and a snapshot to be written when it first
+                   executes IN, unless it executes OUT first
+ * Failure output: false; a snapshot that cannot be written is skipped
+                   with a message on stderr
+ */
+bool memo_start(const char *cache_dir, uint32_t **segment_zero,
+                int *num_words, int *prog_counter)
+{
+    image_hash = decode_image_hash(*segment_zero, *num_words);
+    image_length = *num_words;
+
+    free(snapshot_path);
+    snapshot_path = make_path(cache_dir, image_hash);
+
+    if (memo_resume(snapshot_path, segment_zero, num_words, prog_counter)) {
+        return true;
+    }
+
+    if (mkdir(cache_dir, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "um: cannot create cache directory %s\n",
+                cache_dir);
+        return false;
+    }
+
+    next_input_hook = hook_input(memo_input);
+    hook_output(memo_output);
+    return false;
+}
+
+/* memo_dump
+ * Purpose: writes the UM's registers and segments to a file
+ * Parameters: a string
+ * Returns: true if the file was written
+ *
+ * Expected input: the path to write, on the thread that ran the UM,
+                   after it halts
+ * Success output: true; the file holds r0 to r7 as native uint32_ts
+                   followed by the segments as written by
+                   save_segments, so two runs that end in the same state
+                   write identical files
+ * Failure output: false, with a message on stderr
+ */
+bool memo_dump(const char *path)
+{
+    uint32_t registers[8];
+    FILE *fp = fopen(path, "wb");
+
+    get_registers(registers);
+
+    bool ok = fp != NULL
+              && fwrite(registers, sizeof(uint32_t), 8, fp) == 8
+              && save_segments(fp);
+
+    if (fp != NULL && fclose(fp) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "um: cannot write state to %s\n", path);
+    }
+
+    return ok;
+}
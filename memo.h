@@ -0,0 +1,68 @@
+/**************************************************************
+ *
+ *                         memo.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class memoises the pure prefix of a program: everything it
+ *     does before its first IN, provided it has not executed an OUT
+ *     first. Until then the program's state depends only on its image,
+ *     so when it reaches that IN its registers, program counter and
+ *     segments are saved to a snapshot in a cache directory, named by
+ *     the image's hash. A later run of the same image maps the snapshot
+ *     and starts at the IN instead of executing the prefix again.
+ *
+ *     A snapshot file holds, as native uint32_ts: the magic words
+ *     "UMMEMO1\n", the 64-bit image hash, the image length, the program
+ *     counter, r0 to r7, and then the segments as written by
+ *     save_segments. Snapshots are only meant for the machine that
+ *     wrote them. memo_dump writes the registers and segments the same
+ *     way, without the header, so that the final states of two runs can
+ *     be compared byte for byte.
+ *
+ **************************************************************/
+#ifndef MEMO_INCLUDED
+#define MEMO_INCLUDED
+#include <stdbool.h>
+#include <stdint.h>
+
+/* memo_start
+ * Purpose: resumes a program from its snapshot, or arranges for one to
+            be taken
+ * Parameters: a string, a pointer to the words of m0, an int pointer
+               and an int pointer
+ * Returns: true if the program was resumed from a snapshot
+ *
+ * Expected input: the cache directory, and the loaded program's m0,
+                   length and starting program counter, on the thread
+                   that will run it
+ * Success output: true, with m0, its length and the program counter
+                   updated to the snapshot's and the registers and
+                   segments restored; or false, with the program as it
+                   was and a snapshot to be written when it first
+                   executes IN, unless it executes OUT first
+ * Failure output: false; a snapshot that cannot be written is skipped
+                   with a message on stderr
+ */
+bool memo_start(const char *cache_dir, uint32_t **segment_zero,
+                int *num_words, int *prog_counter);
+
+/* memo_dump
+ * Purpose: writes the UM's registers and segments to a file
+ * Parameters: a string
+ * Returns: true if the file was written
+ *
+ * Expected input: the path to write, on the thread that ran the UM,
+                   after it halts
+ * Success output: true; the file holds r0 to r7 as native uint32_ts
+                   followed by the segments as written by
+                   save_segments, so two runs that end in the same state
+                   write identical files
+ * Failure output: false, with a message on stderr
+ */
+bool memo_dump(const char *path);
+
+#endif
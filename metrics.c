@@ -0,0 +1,294 @@
+/**************************************************************
+ *
+ *                         metrics.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the metrics class.
+ *
+ **************************************************************/
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+
+/* How long a client has to send a request before it is answered anyway */
+#define REQUEST_TIMEOUT_MS 100
+
+__thread Um_metrics um_metrics;
+
+/* The stats thread and the UM it reports on; set up once */
+static const Um_metrics *served = NULL;
+static int listen_fd = -1;
+static int wake_pipe[2] = { -1, -1 };
+static pthread_t stats_thread;
+static char socket_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+/* Instructions per second over the last whole second; stats thread only */
+static double instruction_rate = 0;
+
+/* seconds_now
+ * Purpose: reads the monotonic clock
+ * Parameters: none
+ * Returns: the time in seconds
+ *
+ * Expected input: none
+ * Success output: seconds since an arbitrary point
+ * Failure output: none
+ */
+static double seconds_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* format_report
+ * Purpose: writes the served UM's counters in the Prometheus text format
+ * Parameters: a char pointer and a size_t
+ * Returns: the length of the report
+ *
+ * Expected input: a buffer and its size, which should be at least 2048
+ * Success output: the report, NUL-terminated
+ * Failure output: none (a report too long for the buffer is cut short)
+ */
+static size_t format_report(char *buffer, size_t size)
+{
+    struct {
+        const char *name;
+        const char *type;
+        const char *help;
+        double value;
+    } metrics[] = {
+        { "um_instructions_total", "counter", "UM instructions executed.",
+          __atomic_load_n(&served->instructions, __ATOMIC_RELAXED) },
+        { "um_instructions_per_second", "gauge",
+          "UM instructions executed per second, over the last second.",
+          instruction_rate },
+        { "um_live_segments", "gauge", "Segments mapped, including m[0].",
+          __atomic_load_n(&served->live_segments, __ATOMIC_RELAXED) },
+        { "um_mapped_words", "gauge", "Words in the mapped segments.",
+          __atomic_load_n(&served->mapped_words, __ATOMIC_RELAXED) },
+        { "um_input_bytes_total", "counter", "Bytes read by IN.",
+          __atomic_load_n(&served->input_bytes, __ATOMIC_RELAXED) },
+        { "um_output_bytes_total", "counter", "Bytes written by OUT.",
+          __atomic_load_n(&served->output_bytes, __ATOMIC_RELAXED) },
+        { "um_program_counter", "gauge",
+          "Address in m[0] of the instruction executing.",
+          __atomic_load_n(&served->prog_counter, __ATOMIC_RELAXED) },
+    };
+    size_t length = 0;
+
+    buffer[0] = '\0';
+    for (size_t i = 0; i < sizeof(metrics) / sizeof(metrics[0]); i++) {
+        int written = snprintf(buffer + length, size - length,
+                               "# HELP %s %s\n# TYPE %s %s\n%s %.0f\n",
+                               metrics[i].name, metrics[i].help,
+                               metrics[i].name, metrics[i].type,
+                               metrics[i].name, metrics[i].value);
+
+        if (written < 0 || (size_t)written >= size - length) {
+            break;
+        }
+        length += written;
+    }
+
+    return length;
+}
+
+/* send_all
+ * Purpose: writes a whole buffer to a socket
+ * Parameters: an int, a char pointer and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: a connected socket and what to send
+ * Success output: none
+ * Failure output: none (a client that goes away is simply dropped)
+ */
+static void send_all(int fd, const char *data, size_t length)
+{
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+
+        if (sent <= 0) {
+            return;
+        }
+        data += sent;
+        length -= sent;
+    }
+}
+
+/* answer
+ * Purpose: sends one report to a client
+ * Parameters: an int
+ * Returns: Nothing
+ *
+ * Expected input: a newly accepted connection
+ * Success output: none (the report was sent, as the body of an HTTP
+                   response if the client sent an HTTP request)
+ * Failure output: none
+ */
+static void answer(int fd)
+{
+    char request[512];
+    char body[4096];
+    char header[128];
+    bool http = false;
+    struct pollfd pfd = { fd, POLLIN, 0 };
+
+    if (poll(&pfd, 1, REQUEST_TIMEOUT_MS) > 0) {
+        ssize_t got = recv(fd, request, sizeof(request) - 1, 0);
+
+        http = got >= 4 && memcmp(request, "GET ", 4) == 0;
+    }
+
+    size_t length = format_report(body, sizeof(body));
+
+    if (http) {
+        int header_length = snprintf(header, sizeof(header),
+                                     "HTTP/1.0 200 OK\r\n"
+                                     "Content-Type: text/plain; "
+                                     "version=0.0.4\r\n"
+                                     "Content-Length: %zu\r\n\r\n", length);
+        send_all(fd, header, header_length);
+    }
+    send_all(fd, body, length);
+}
+
+/* stats_main
+ * Purpose: the stats thread: keeps the instruction rate up to date and
+            answers clients until told to stop
+ * Parameters: a void pointer (unused)
+ * Returns: NULL
+ *
+ * Expected input: a listening socket and a wake-up pipe
+ * Success output: none
+ * Failure output: none (the thread stops if poll fails)
+ */
+static void *stats_main(void *cl)
+{
+    uint64_t last_count = __atomic_load_n(&served->instructions,
+                                          __ATOMIC_RELAXED);
+    double last_time = seconds_now();
+
+    (void)cl;
+
+    for (;;) {
+        struct pollfd fds[2] = {
+            { listen_fd, POLLIN, 0 }, { wake_pipe[0], POLLIN, 0 }
+        };
+
+        if (poll(fds, 2, 1000) < 0 && errno != EINTR) {
+            break;
+        }
+        if (fds[1].revents != 0) {
+            break;
+        }
+
+        double now = seconds_now();
+
+        if (now - last_time >= 1.0) {
+            uint64_t count = __atomic_load_n(&served->instructions,
+                                             __ATOMIC_RELAXED);
+
+            instruction_rate = (count - last_count) / (now - last_time);
+            last_count = count;
+            last_time = now;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd = accept(listen_fd, NULL, NULL);
+
+            if (fd >= 0) {
+                answer(fd);
+                close(fd);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/* metrics_stop
+ * Purpose: stops the stats thread and removes the socket
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: registered with atexit by metrics_serve
+ * Success output: none
+ * Failure output: none
+ */
+static void metrics_stop()
+{
+    if (write(wake_pipe[1], "", 1) == 1) {
+        pthread_join(stats_thread, NULL);
+    }
+
+    close(listen_fd);
+    unlink(socket_path);
+}
+
+/* metrics_serve
+ * Purpose: starts serving the calling thread's counters on a Unix
+            domain socket
+ * Parameters: a string
+ * Returns: true if the socket is listening
+ *
+ * Expected input: the socket's path, which must not be in use; called
+                   on the thread that will run the UM, before it starts
+ * Success output: true; a stats thread answers connections until the
+                   process exits, when the socket is removed
+ * Failure output: false, with the reason on stderr
+ */
+bool metrics_serve(const char *path)
+{
+    struct sockaddr_un address;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "um: metrics socket path is too long\n");
+        return false;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0
+        || bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0
+        || listen(listen_fd, 8) < 0) {
+        fprintf(stderr, "um: cannot listen on %s: %s\n", path,
+                strerror(errno));
+        if (listen_fd >= 0) {
+            close(listen_fd);
+        }
+        return false;
+    }
+
+    strcpy(socket_path, path);
+    served = &um_metrics;
+
+    if (pipe(wake_pipe) < 0
+        || pthread_create(&stats_thread, NULL, stats_main, NULL) != 0) {
+        fprintf(stderr, "um: cannot start the metrics thread\n");
+        close(listen_fd);
+        unlink(socket_path);
+        return false;
+    }
+
+    atexit(metrics_stop);
+    return true;
+}
@@ -0,0 +1,69 @@
+/**************************************************************
+ *
+ *                         metrics.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class keeps live counters for the UM running on each thread,
+ *     and can serve the counters of one UM on a Unix domain socket so
+ *     that a long run can be watched without attaching a debugger.
+ *
+ *     The counters are plain fields of a thread-local Um_metrics that
+ *     segment.c and instruction.c update with relaxed atomic stores as
+ *     they go; nothing in the interpreter takes a lock. The program
+ *     counter and instruction count change on every instruction, so
+ *     the engines only publish them when execute_program is asked to
+ *     (for --metrics, --profile and --debug), from loops of their own;
+ *     other runs leave them at 0. A stats thread reads the counters
+ *     with relaxed loads once a second (to work out the instruction
+ *     rate) and whenever a client connects. Each connection gets one
+ *     report, in the Prometheus text format, and is closed; a client
+ *     that starts with an HTTP request (e.g. `curl --unix-socket PATH
+ *     http://localhost/metrics`) gets an HTTP response around it.
+ *
+ **************************************************************/
+#ifndef METRICS_INCLUDED
+#define METRICS_INCLUDED
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Um_metrics {
+        uint64_t instructions;      /* executed so far */
+        uint32_t prog_counter;      /* of the instruction executing */
+        uint32_t live_segments;     /* including m[0] */
+        uint64_t mapped_words;      /* in the live segments */
+        uint64_t input_bytes;       /* read by IN, not counting EOF */
+        uint64_t output_bytes;      /* written by OUT */
+} Um_metrics;
+
+/* The calling thread's UM's counters */
+extern __thread Um_metrics um_metrics;
+
+/* Stores a counter with relaxed ordering, so that a reader on another
+ * thread never sees a torn value */
+#define METRICS_SET(field, value) \
+        __atomic_store_n(&um_metrics.field, (value), __ATOMIC_RELAXED)
+
+/* Adds to a counter; only the UM's own thread writes it, so a load and
+ * a store are enough */
+#define METRICS_ADD(field, amount) \
+        METRICS_SET(field, um_metrics.field + (amount))
+
+/* metrics_serve
+ * Purpose: starts serving the calling thread's counters on a Unix
+            domain socket
+ * Parameters: a string
+ * Returns: true if the socket is listening
+ *
+ * Expected input: the socket's path, which must not be in use; called
+                   on the thread that will run the UM, before it starts
+ * Success output: true; a stats thread answers connections until the
+                   process exits, when the socket is removed
+ * Failure output: false, with the reason on stderr
+ */
+bool metrics_serve(const char *path);
+
+#endif
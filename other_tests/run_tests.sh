@@ -1,47 +1,385 @@
 #! /bin/sh
+#
+# Differential test and timing harness for the UM.
+#
+# Builds um and its tools, then runs every .um file in the tree, plus
+# randomly generated programs and regression programs too large to keep
+# in the tree, under each engine configuration below.
+# For every program, each configuration's output, exit status and final
+# state (registers and segments, from --dump-state) must match the
+# first configuration's byte for byte. Runtimes are appended to a CSV
+# so that they can be tracked from run to run.
+#
+# Usage: run_tests.sh [-r count] [-s seed] [-e "engines"] [-c file]
+#     -r    random programs to generate (default 20)
+#     -s    seed for the generator (default: the time)
+#     -e    configurations to run, first is the reference (default:
+#           all of them)
+#     -c    CSV to append runtimes to (default runtimes.csv)
+#
+# Configurations:
+#     switch       --engine=switch
+#     predecode    --engine=predecode
+#     codemap      --engine=predecode with a code map made by umdis -m
+#     tail         --engine=tail
+#     special      --engine=special
+#     branchless   --engine=special --branchless-cmov
+#     compressed   the program compressed by umz
+#     async        --async-io
+#     arena        --arena
+#
+# Programs written by write_regressions whose names start with handles_
+# are also run under --handles (the handles configuration), comparing
+# only output and status with the reference, since their registers hold
+# whichever segment IDs MAP returned.
+#
+# Pipelines of random and small programs are also run under --pipeline
+# with each kind of --pipeline-link, and must all match the queue.
+#
+# Results for failing programs are left in results/; the script exits
+# with status 1 if any program differed.
 
-rm *.dump
-# rm *.1
-# rm *.0
-# rm *.um
-rm *.gt
-rm *.out
-rm *.results
+cd "$(dirname "$0")" || exit 1
+ROOT=..
+RESULTS=results
 
-make
-./test
+RANDOM_PROGRAMS=20
+SEED=$(date +%s)
+ENGINES="switch predecode codemap tail special branchless compressed async arena"
+CSV=runtimes.csv
 
-echo -e
+while getopts "r:s:e:c:" opt; do
+    case $opt in
+        r) RANDOM_PROGRAMS=$OPTARG ;;
+        s) SEED=$OPTARG ;;
+        e) ENGINES=$OPTARG ;;
+        c) CSV=$OPTARG ;;
+        *) echo "Usage: run_tests.sh [-r count] [-s seed]" \
+                "[-e \"engines\"] [-c file]" >&2
+           exit 1 ;;
+    esac
+done
 
-testFiles=$(ls *.um)
+make -s -C "$ROOT" um umdis umasm umz || exit 1
+UM=$ROOT/um
 
-for testFile in $testFiles ; do
-    testName=$(echo $testFile | sed -E 's/(.*).um/\1/')
-    echo "Now testing $testName..."
+rm -rf "$RESULTS"
+mkdir -p "$RESULTS/random" "$RESULTS/regressions" "$RESULTS/pipeline"
 
-    if [ -f $testName.0 ] ; then
-        echo "   Input found: yes"
-    else
-        echo "   (No input found)"
+if [ ! -f "$CSV" ]; then
+    echo "date,commit,program,engine,seconds,status" > "$CSV"
+fi
+DATE=$(date +%Y-%m-%dT%H:%M:%S)
+COMMIT=$(git -C "$ROOT" rev-parse --short HEAD 2>/dev/null || echo none)
+
+# generate_program: writes a random program that halts without failing
+# to $1.s, assembles it to $1.um, and writes its input to $1.0. Values
+# written with OUT are masked to a byte with two NANDs against r4 = 255,
+# DIV only divides by a non-zero LV, loads and stores use the segment in
+# r5 with indices in range, and the one loop counts down r3, which its
+# body never writes. r6 is scratch, and r0 and r7 are left to jnz.
+generate_program() {
+    awk -v seed="$2" -v name="$1" 'BEGIN {
+        srand(seed)
+        s = name ".s"
+        print "    lv r4, 255" > s
+        print "    lv r6, 64" > s
+        print "    map r5, r6" > s
+        for (block = 0; block < 3; block++) {
+            if (block == 1) {
+                print "    lv r3, " 1 + int(rand() * 200) > s
+                print "loop:" > s
+            }
+            n = 10 + int(rand() * 60)
+            for (i = 0; i < n; i++) {
+                a = "r" 1 + int(rand() * (block == 1 ? 2 : 3))
+                b = "r" int(rand() * 6)
+                c = "r" int(rand() * 6)
+                k = int(rand() * 10)
+                if (k == 0) {
+                    print "    add " a ", " b ", " c > s
+                } else if (k == 1) {
+                    print "    mul " a ", " b ", " c > s
+                } else if (k == 2) {
+                    print "    nand " a ", " b ", " c > s
+                } else if (k == 3) {
+                    print "    cmov " a ", " b ", " c > s
+                } else if (k == 4) {
+                    print "    lv " a ", " int(rand() * 33554432) > s
+                } else if (k == 5) {
+                    print "    lv r6, " 1 + int(rand() * 1000) > s
+                    print "    div " a ", " b ", r6" > s
+                } else if (k == 6) {
+                    print "    lv r6, " int(rand() * 64) > s
+                    print "    sstore r5, r6, " b > s
+                } else if (k == 7) {
+                    print "    lv r6, " int(rand() * 64) > s
+                    print "    sload " a ", r5, r6" > s
+                } else if (k == 8) {
+                    print "    nand r6, " b ", r4" > s
+                    print "    nand r6, r6, r6" > s
+                    print "    out r6" > s
+                } else if (rand() < 0.5) {
+                    print "    in " a > s
+                } else {
+                    print "    lv r6, " int(rand() * 5000) > s
+                    print "    map r6, r6" > s
+                    print "    unmap r6" > s
+                }
+            }
+            if (block == 1) {
+                print "    lv r6, 0" > s
+                print "    nand r6, r6, r6" > s
+                print "    add r3, r3, r6" > s
+                print "    jnz r3, loop" > s
+            }
+        }
+        print "    halt" > s
+        n = int(rand() * 64)
+        for (i = 0; i < n; i++) {
+            printf "%c", 32 + int(rand() * 95) > (name ".0")
+        }
+        printf "" > (name ".0")
+    }'
+    "$ROOT/umasm" -o "$1.um" "$1.s"
+}
+
+# write_regressions: writes programs for bugs that only show on large
+# images, too big to keep in the tree, to $1 and assembles them
+write_regressions() {
+    # LOADP while predecode workers still read a mapped m[0] (more than
+    # 2^20 words); the workers only start on more than one CPU
+    cat > "$1/loadp_workers.s" <<EOF
+    lv r1, 1
+    map r2, r1
+    li r3, 0x70000000
+    sstore r2, r0, r3
+    lv r4, 'k'
+    out r4
+    loadp r2, r0
+    .space 1052672
+EOF
+    "$ROOT/umasm" -o "$1/loadp_workers.um" "$1/loadp_workers.s" || return 1
+
+    # Segment IDs computed from the one MAP returned: a round trip
+    # through arithmetic, then the plain index under a handle's tag
+    cat > "$1/handles_computed.s" <<EOF
+    lv r1, 4
+    map r2, r1
+    lv r3, 'h'
+    sstore r2, r0, r3
+    lv r6, 1
+    add r4, r2, r6
+    nand r6, r0, r0
+    add r4, r4, r6
+    sload r3, r4, r0
+    out r3
+    li r6, 0xFFFFF
+    nand r4, r2, r6
+    nand r4, r4, r4
+    lv r3, 'i'
+    sstore r4, r0, r3
+    sload r3, r2, r0
+    out r3
+    lv r3, 10
+    out r3
+    unmap r4
+    halt
+EOF
+    "$ROOT/umasm" -o "$1/handles_computed.um" "$1/handles_computed.s"
+}
+
+# write_stages: writes programs for pipeline stages to $1 and assembles
+# them: cat copies its input to its output, head copies one byte and
+# halts without reading the rest, and flood writes 300000 bytes, more
+# than any link holds
+write_stages() {
+    cat > "$1/cat.s" <<EOF
+loop:
+    in r1
+    nand r2, r1, r1
+    jnz r2, body
+    halt
+body:
+    out r1
+    lv r3, 1
+    jnz r3, loop
+EOF
+    cat > "$1/head.s" <<EOF
+    in r1
+    out r1
+    halt
+EOF
+    cat > "$1/flood.s" <<EOF
+    li r3, 300000
+    lv r1, 'x'
+loop:
+    out r1
+    nand r6, r0, r0
+    add r3, r3, r6
+    jnz r3, loop
+    halt
+EOF
+    for stage in cat head flood; do
+        "$ROOT/umasm" -o "$1/$stage.um" "$1/$stage.s" || return 1
+    done
+}
+
+# now: prints the time in seconds, with nanoseconds
+now() {
+    date +%s.%N
+}
+
+# run_engine: runs program $1 with input $2 under configuration $3,
+# leaving its output, status and final state in files named by $4
+run_engine() {
+    program=$1
+    options=""
+
+    case $3 in
+        switch) options="--engine=switch" ;;
+        predecode) options="--engine=predecode" ;;
+        codemap)
+            "$ROOT/umdis" -q -m "$4.map" "$1" > /dev/null
+            options="--engine=predecode --code-map=$4.map" ;;
+        tail) options="--engine=tail" ;;
+        special) options="--engine=special" ;;
+        branchless) options="--engine=special --branchless-cmov" ;;
+        compressed)
+            "$ROOT/umz" -o "$4.umz" "$1"
+            program=$4.umz ;;
+        async) options="--async-io" ;;
+        arena) options="--arena" ;;
+        handles) options="--handles" ;;
+        *) echo "unknown engine $3" >&2; exit 1 ;;
+    esac
+
+    rm -f "$4.state"
+    start=$(now)
+    # shellcheck disable=SC2086
+    "$UM" $options --dump-state="$4.state" "$program" < "$2" > "$4.out" \
+        2> /dev/null
+    status=$?
+    end=$(now)
+
+    echo "$status" > "$4.status"
+    [ -f "$4.state" ] || : > "$4.state"
+    seconds=$(echo "$start $end" | awk '{ printf "%.6f", $2 - $1 }')
+    echo "$DATE,$COMMIT,$(basename "$1"),$3,$seconds,$status" >> "$CSV"
+}
+
+# check_program: runs $1 under every configuration and compares each
+# against the first; prints a line and returns 1 if any differed
+check_program() {
+    name=$(basename "$1" .um)
+    dir=$RESULTS/$name
+    input=/dev/null
+    if [ -f "${1%.um}.0" ]; then
+        input=${1%.um}.0
+    elif [ -f "$ROOT/testing/$name.0" ]; then
+        input=$ROOT/testing/$name.0
     fi
 
-    if [ -f $testName.1 ] ; then
-        echo "   Output found: yes"
-        um $testFile > $testName.gt
-        ./um $testFile > $testName.out
-        diff $testName.gt $testName.out > $testName.results
-        if [ -s $testName.results ] ; then
-            echo "   ---> Diff FAILED :("
-        else
-            echo "   ---> Diff success!"
-            rm $testName.gt
-            rm $testName.out
-            rm $testName.results
+    mkdir -p "$dir"
+    reference=""
+    failed=0
+
+    for engine in $ENGINES; do
+        run_engine "$1" "$input" "$engine" "$dir/$engine"
+        if [ -z "$reference" ]; then
+            reference=$engine
+            continue
         fi
-        
-    else
-        echo "   (No output found)"
+        for kind in out status state; do
+            if ! cmp -s "$dir/$reference.$kind" "$dir/$engine.$kind"; then
+                echo "   ---> $name: $engine $kind differs from $reference"
+                failed=1
+            fi
+        done
+    done
+
+    case $name in
+        handles_*)
+            run_engine "$1" "$input" handles "$dir/handles"
+            for kind in out status; do
+                if ! cmp -s "$dir/$reference.$kind" "$dir/handles.$kind"
+                then
+                    echo "   ---> $name: handles $kind differs" \
+                         "from $reference"
+                    failed=1
+                fi
+            done ;;
+    esac
+
+    if [ $failed = 0 ]; then
+        rm -rf "$dir"
+    fi
+    return $failed
+}
+
+# check_pipeline: runs the pipeline of the programs given, with input
+# $1 and its results in files named by $2, over every kind of link and
+# compares each with the queue; prints a line and returns 1 if any
+# differed
+check_pipeline() {
+    input=$1
+    name=$2
+    shift 2
+    failed=0
+
+    for link in queue pipe socket; do
+        "$UM" --pipeline --pipeline-link=$link "$@" < "$input" \
+            > "$RESULTS/pipeline/$name.$link.out" 2> /dev/null
+        echo $? > "$RESULTS/pipeline/$name.$link.status"
+        [ $link = queue ] && continue
+        for kind in out status; do
+            if ! cmp -s "$RESULTS/pipeline/$name.queue.$kind" \
+                        "$RESULTS/pipeline/$name.$link.$kind"; then
+                echo "   ---> pipeline $name: $link $kind differs from queue"
+                failed=1
+            fi
+        done
+    done
+
+    return $failed
+}
+
+echo "Seed $SEED; engines: $ENGINES"
+
+i=0
+while [ $i -lt "$RANDOM_PROGRAMS" ]; do
+    generate_program "$RESULTS/random/random$i" $((SEED + i)) || exit 1
+    i=$((i + 1))
+done
+write_regressions "$RESULTS/regressions" || exit 1
+write_stages "$RESULTS/pipeline" || exit 1
+
+programs=0
+failures=0
+
+for program in $(find "$ROOT" -name '*.um' -not -path "*/$RESULTS/*") \
+               "$RESULTS"/random/*.um "$RESULTS"/regressions/*.um; do
+    [ -f "$program" ] || continue
+    programs=$((programs + 1))
+    if ! check_program "$program"; then
+        failures=$((failures + 1))
+    fi
+done
+
+stages=$RESULTS/pipeline
+input=/dev/null
+[ -f "$RESULTS/random/random0.0" ] && input=$RESULTS/random/random0.0
+for pipeline in "copy $stages/flood.um $stages/cat.um $stages/cat.um" \
+                "head $stages/flood.um $stages/head.um $stages/cat.um" \
+                "random $RESULTS/random/random0.um $stages/cat.um"; do
+    [ "${pipeline#random}" != "$pipeline" ] && [ "$RANDOM_PROGRAMS" = 0 ] \
+        && continue
+    programs=$((programs + 1))
+    # shellcheck disable=SC2086
+    if ! check_pipeline "$input" $pipeline; then
+        failures=$((failures + 1))
     fi
+done
 
-    # umdump $testFile > $testName.dump
-done
\ No newline at end of file
+echo "$programs programs, $failures differed; runtimes in $CSV"
+[ $failures = 0 ]
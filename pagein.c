@@ -0,0 +1,312 @@
+/**************************************************************
+ *
+ *                         pagein.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the pagein class.
+ *
+ **************************************************************/
+#define _GNU_SOURCE             /* for mremap */
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "pagein.h"
+#include "segment.h"
+#include "decode.h"
+
+/* How many lazily loaded images a process can have over its lifetime */
+#define MAX_LAZY_IMAGES 64
+
+/* The states of a chunk: the first thread to fault on an absent chunk
+ * claims it, and any other thread that faults on it waits until it is
+ * resident */
+#define CHUNK_ABSENT 0
+#define CHUNK_LOADING 1
+#define CHUNK_RESIDENT 2
+
+typedef struct Lazy_image {
+        Image image;
+        unsigned char *start;       /* the words of m0 */
+        size_t length;              /* bytes the chunks cover; 0 once freed */
+        size_t chunk_bytes;
+        unsigned char *resident;    /* atomic: a CHUNK_ state per chunk */
+} Lazy_image;
+
+/* Entries are only ever appended, and published by num_lazy_images, so
+ * the fault handler can read them without a lock */
+static Lazy_image lazy_images[MAX_LAZY_IMAGES];
+static int num_lazy_images;
+static pthread_mutex_t lazy_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct sigaction previous_action;
+
+/* corrupt_chunk
+ * Purpose: stops the program when a chunk cannot be expanded, or does
+            not match its hash
+ * Parameters: a string
+ * Returns: does not return
+ *
+ * Expected input: called from the fault handler, with the message
+ * Success output: none
+ * Failure output: exits with status 1 and the message on stderr, using
+                   only calls that are safe in a signal handler
+ */
+static void corrupt_chunk(const char *message)
+{
+    if (write(STDERR_FILENO, message, strlen(message)) < 0) {
+        _exit(1);
+    }
+    _exit(1);
+}
+
+/* page_in
+ * Purpose: expands one chunk of a lazily loaded image into m0
+ * Parameters: a Lazy_image pointer and a size_t
+ * Returns: true if the chunk's pages are now accessible
+ *
+ * Expected input: a live entry and the number of a chunk the calling
+                   thread has claimed
+ * Success output: true, with the chunk expanded; its pages become
+                   accessible all at once, already holding its words, so
+                   other threads (such as predecode workers) never see
+                   them half expanded and no store to them is lost
+ * Failure output: false if the pages could not be mapped (so the fault
+                   cannot be handled); exits the program if the chunk is
+                   damaged or its words do not match its hash, before
+                   any of them reach m0
+ */
+static bool page_in(Lazy_image *lazy, size_t chunk)
+{
+    unsigned char *first = lazy->start + chunk * lazy->chunk_bytes;
+    size_t bytes = lazy->length - chunk * lazy->chunk_bytes;
+
+    if (bytes > lazy->chunk_bytes) {
+        bytes = lazy->chunk_bytes;
+    }
+
+    /* Expanded off to the side, then moved over the reserved pages */
+    void *scratch = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (scratch == MAP_FAILED) {
+        return false;
+    }
+    if (!image_unpack(lazy->image, chunk, scratch)) {
+        corrupt_chunk("um: damaged chunk in compressed image\n");
+    }
+    if (!image_check(lazy->image, chunk, scratch)) {
+        corrupt_chunk("um: chunk of compressed image does not match "
+                      "its hash\n");
+    }
+    if (mremap(scratch, bytes, bytes, MREMAP_MAYMOVE | MREMAP_FIXED,
+               first) == MAP_FAILED) {
+        munmap(scratch, bytes);
+        return false;
+    }
+
+    return true;
+}
+
+/* await_chunk
+ * Purpose: waits for another thread to expand a chunk
+ * Parameters: a Lazy_image pointer and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: a live entry and a chunk some other thread has
+                   claimed
+ * Success output: none (the chunk is resident)
+ * Failure output: none
+ */
+static void await_chunk(Lazy_image *lazy, size_t chunk)
+{
+    while (__atomic_load_n(&lazy->resident[chunk], __ATOMIC_ACQUIRE)
+           != CHUNK_RESIDENT) {
+        sched_yield();
+    }
+}
+
+/* page_fault
+ * Purpose: handles SIGSEGV by expanding the chunk that was touched
+ * Parameters: an int, a siginfo_t pointer and a void pointer
+ * Returns: Nothing
+ *
+ * Expected input: the signal, its details, and the context
+ * Success output: none (the faulting access runs again, now on an
+                   expanded chunk, whichever thread expanded it)
+ * Failure output: for a fault outside every image, or a chunk that
+                   cannot be mapped, the previous action is put back, so
+                   the access faults again and is handled as it would
+                   have been without this class
+ */
+static void page_fault(int signal_number, siginfo_t *info, void *context)
+{
+    unsigned char *address = info->si_addr;
+    int count = __atomic_load_n(&num_lazy_images, __ATOMIC_ACQUIRE);
+
+    (void)signal_number;
+    (void)context;
+
+    /* Newest first: a freed m0's addresses may have been reused by a
+     * later image */
+    for (int i = count - 1; i >= 0; i--) {
+        Lazy_image *lazy = &lazy_images[i];
+        size_t length = __atomic_load_n(&lazy->length, __ATOMIC_ACQUIRE);
+
+        if (address < lazy->start || address >= lazy->start + length) {
+            continue;
+        }
+
+        size_t chunk = (address - lazy->start) / lazy->chunk_bytes;
+        unsigned char state = CHUNK_ABSENT;
+
+        if (!__atomic_compare_exchange_n(&lazy->resident[chunk], &state,
+                                         CHUNK_LOADING, false,
+                                         __ATOMIC_ACQUIRE,
+                                         __ATOMIC_ACQUIRE)) {
+            /* Another thread has it, or had it when this one faulted */
+            await_chunk(lazy, chunk);
+            return;
+        }
+        if (page_in(lazy, chunk)) {
+            __atomic_store_n(&lazy->resident[chunk], CHUNK_RESIDENT,
+                             __ATOMIC_RELEASE);
+            return;
+        }
+        break;
+    }
+
+    sigaction(SIGSEGV, &previous_action, NULL);
+}
+
+/* release_image
+ * Purpose: retires the entry for an m0 that is about to be freed
+ * Parameters: a uint32_t pointer
+ * Returns: Nothing
+ *
+ * Expected input: the words of a lazily loaded m0
+ * Success output: none (faults at its addresses are no longer handled,
+                   and the image is closed)
+ * Failure output: none
+ */
+static void release_image(uint32_t *words)
+{
+    int count = __atomic_load_n(&num_lazy_images, __ATOMIC_ACQUIRE);
+
+    for (int i = count - 1; i >= 0; i--) {
+        Lazy_image *lazy = &lazy_images[i];
+
+        if (lazy->start == (unsigned char *)words && lazy->length > 0) {
+            __atomic_store_n(&lazy->length, 0, __ATOMIC_RELEASE);
+            image_close(&lazy->image);
+            free(lazy->resident);
+            lazy->resident = NULL;
+            return;
+        }
+    }
+}
+
+/* load_eagerly
+ * Purpose: makes m0 from an image by expanding every chunk now
+ * Parameters: an Image
+ * Returns: a pointer to the words of m0
+ *
+ * Expected input: an Image that cannot be loaded lazily
+ * Success output: m0 holding the whole program (the image is closed)
+ * Failure output: exits the program, with a message on stderr, if a
+                   chunk is damaged or the program does not match the
+                   hash in the image's header
+ */
+static uint32_t *load_eagerly(Image image)
+{
+    uint32_t num_words = image_length(image);
+    uint32_t chunk_words = image_chunk_words(image);
+    uint32_t *words = init_segment(num_words);
+
+    for (uint32_t first = 0, i = 0; first < num_words;
+         first += chunk_words, i++) {
+        if (!image_unpack(image, i, words + first)) {
+            fprintf(stderr, "um: damaged chunk in compressed image\n");
+            exit(1);
+        }
+    }
+
+    if (decode_image_hash(words, num_words) != image_hash(image)) {
+        fprintf(stderr, "um: compressed image does not match its hash\n");
+        exit(1);
+    }
+
+    image_close(&image);
+    return words;
+}
+
+/* pagein_load
+ * Purpose: makes segment 0 from a compressed image
+ * Parameters: an Image and an int pointer
+ * Returns: a pointer to the words of m0
+ *
+ * Expected input: an Image from image_open, which the UM owns from now
+                   on, and where to store the program's length
+ * Success output: m0, as init_segment would make it, holding the
+                   image's program; its chunks are expanded on first
+                   touch
+ * Failure output: exits the program, with a message on stderr, if a
+                   chunk turns out to be damaged, or not to match its
+                   hash, when it is expanded
+ */
+uint32_t *pagein_load(Image image, int *num_words)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t chunk_bytes = (size_t)image_chunk_words(image) * 4;
+    uint32_t length = image_length(image);
+
+    *num_words = length;
+
+    pthread_mutex_lock(&lazy_lock);
+
+    if (length == 0 || chunk_bytes % page_size != 0
+        || num_lazy_images == MAX_LAZY_IMAGES) {
+        pthread_mutex_unlock(&lazy_lock);
+        return load_eagerly(image);
+    }
+
+    uint32_t *words = init_segment_reserved(length, release_image);
+
+    if (words == NULL) {
+        pthread_mutex_unlock(&lazy_lock);
+        return load_eagerly(image);
+    }
+
+    if (num_lazy_images == 0) {
+        struct sigaction action;
+
+        /* Every other signal waits, so that no handler (the profiler's,
+         * say) can fault on a chunk this thread is halfway through */
+        action.sa_sigaction = page_fault;
+        action.sa_flags = SA_SIGINFO;
+        sigfillset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previous_action);
+    }
+
+    size_t num_chunks = ((size_t)length * 4 + chunk_bytes - 1) / chunk_bytes;
+    Lazy_image *lazy = &lazy_images[num_lazy_images];
+
+    lazy->image = image;
+    lazy->start = (unsigned char *)words;
+    lazy->length = ((size_t)length * 4 + page_size - 1) & ~(page_size - 1);
+    lazy->chunk_bytes = chunk_bytes;
+    lazy->resident = calloc(num_chunks, 1);
+    assert(lazy->resident != NULL);
+
+    __atomic_store_n(&num_lazy_images, num_lazy_images + 1,
+                     __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&lazy_lock);
+
+    return words;
+}
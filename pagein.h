@@ -0,0 +1,49 @@
+/**************************************************************
+ *
+ *                         pagein.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class loads a compressed image (see image.h) into segment 0
+ *     without expanding it. Segment 0 is reserved with every page
+ *     inaccessible, and the first read or write of a page, whether an
+ *     instruction fetch, a load, a store or the pre-decoder, raises a
+ *     page fault. A SIGSEGV handler expands the chunk holding that page
+ *     into fresh pages, moves them over the inaccessible ones, and lets
+ *     the access run again. Chunks the program never touches are never
+ *     expanded, so a large image starts in the time it takes to map the
+ *     file. Faults may come from several threads at once (the predecode
+ *     workers read m0 too): the first to touch a chunk expands it, and
+ *     the others wait for it, so no thread ever sees a chunk half done.
+ *
+ *     If the lazy setup cannot be used (the chunks are not a whole
+ *     number of pages, or too many images are loaded at once), the image
+ *     is expanded in full up front instead.
+ *
+ **************************************************************/
+#ifndef PAGEIN_INCLUDED
+#define PAGEIN_INCLUDED
+#include <stdint.h>
+
+#include "image.h"
+
+/* pagein_load
+ * Purpose: makes segment 0 from a compressed image
+ * Parameters: an Image and an int pointer
+ * Returns: a pointer to the words of m0
+ *
+ * Expected input: an Image from image_open, which the UM owns from now
+                   on, and where to store the program's length
+ * Success output: m0, as init_segment would make it, holding the
+                   image's program; its chunks are expanded on first
+                   touch
+ * Failure output: exits the program, with a message on stderr, if a
+                   chunk turns out to be damaged, or not to match its
+                   hash, when it is expanded
+ */
+uint32_t *pagein_load(Image image, int *num_words);
+
+#endif
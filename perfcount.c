@@ -0,0 +1,184 @@
+/**************************************************************
+ *
+ *                         perfcount.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the perfcount class.
+ *
+ **************************************************************/
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfcount.h"
+
+#define CACHE_MISS(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) \
+                           | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+typedef struct Counter {
+        const char *name;
+        uint32_t type;
+        uint64_t config;
+        const char *unit;       /* what the per-instruction ratio means */
+        int fd;
+} Counter;
+
+static Counter counters[] = {
+        { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,
+          "per UM instruction", -1 },
+        { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,
+          "per UM instruction", -1 },
+        { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,
+          "per UM dispatch", -1 },
+        { "L1d-misses", PERF_TYPE_HW_CACHE,
+          CACHE_MISS(PERF_COUNT_HW_CACHE_L1D), "per UM instruction", -1 },
+        { "LLC-misses", PERF_TYPE_HW_CACHE,
+          CACHE_MISS(PERF_COUNT_HW_CACHE_LL), "per UM instruction", -1 },
+        { "dTLB-misses", PERF_TYPE_HW_CACHE,
+          CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB), "per UM instruction", -1 },
+};
+
+#define NUM_COUNTERS (sizeof(counters) / sizeof(counters[0]))
+
+/* open_counter
+ * Purpose: opens one counter, disabled, for the calling thread
+ * Parameters: a Counter pointer
+ * Returns: the file descriptor, or -1 with errno set
+ *
+ * Expected input: a counter from the table above
+ * Success output: a file descriptor for the counter
+ * Failure output: -1
+ */
+static int open_counter(Counter *counter)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = counter->type;
+    attr.config = counter->config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED
+                       | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* perfcount_start
+ * Purpose: opens and starts the hardware counters for this thread
+ * Parameters: none
+ * Returns: true if at least one counter is running
+ *
+ * Expected input: none
+ * Success output: true
+ * Failure output: false, with the reason on stderr
+ */
+bool perfcount_start()
+{
+    int opened = 0;
+    int first_error = 0;
+
+    for (size_t i = 0; i < NUM_COUNTERS; i++) {
+        counters[i].fd = open_counter(&counters[i]);
+        if (counters[i].fd >= 0) {
+            opened++;
+        } else if (first_error == 0) {
+            first_error = errno;
+        }
+    }
+
+    if (opened == 0) {
+        fprintf(stderr, "um: perf counters unavailable: %s\n",
+                strerror(first_error));
+        return false;
+    }
+
+    for (size_t i = 0; i < NUM_COUNTERS; i++) {
+        if (counters[i].fd >= 0) {
+            ioctl(counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    return true;
+}
+
+/* read_counter
+ * Purpose: reads a counter, scaling it up if the kernel multiplexed it
+ * Parameters: a Counter pointer and a uint64_t pointer
+ * Returns: true if the counter could be read
+ *
+ * Expected input: an open counter, and where to put its value
+ * Success output: true
+ * Failure output: false
+ */
+static bool read_counter(Counter *counter, uint64_t *value)
+{
+    uint64_t data[3];   /* value, time enabled, time running */
+
+    if (read(counter->fd, data, sizeof(data)) != sizeof(data)
+        || data[2] == 0) {
+        return false;
+    }
+
+    *value = data[2] < data[1]
+             ? (uint64_t)((double)data[0] * data[1] / data[2])
+             : data[0];
+    return true;
+}
+
+/* perfcount_report
+ * Purpose: stops the counters and prints them
+ * Parameters: a FILE pointer and a uint64_t
+ * Returns: Nothing
+ *
+ * Expected input: where to print, and the number of UM instructions
+                   executed while the counters ran
+ * Success output: none (one line per counter, with host cycles and
+                   instructions per UM instruction and branch misses per
+                   UM dispatch)
+ * Failure output: none
+ */
+void perfcount_report(FILE *fp, uint64_t um_instructions)
+{
+    for (size_t i = 0; i < NUM_COUNTERS; i++) {
+        if (counters[i].fd >= 0) {
+            ioctl(counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+
+    fprintf(fp, "um: perf counters for %" PRIu64 " UM instructions\n",
+            um_instructions);
+
+    double per = um_instructions > 0 ? 1.0 / um_instructions : 0;
+
+    for (size_t i = 0; i < NUM_COUNTERS; i++) {
+        uint64_t value;
+
+        if (counters[i].fd < 0) {
+            fprintf(fp, "    %-14s %16s\n", counters[i].name,
+                    "not available");
+            continue;
+        }
+
+        if (read_counter(&counters[i], &value)) {
+            fprintf(fp, "    %-14s %16" PRIu64 "  (%.4f %s)\n",
+                    counters[i].name, value, value * per, counters[i].unit);
+        } else {
+            fprintf(fp, "    %-14s %16s\n", counters[i].name, "not counted");
+        }
+
+        close(counters[i].fd);
+        counters[i].fd = -1;
+    }
+}
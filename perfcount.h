@@ -0,0 +1,49 @@
+/**************************************************************
+ *
+ *                         perfcount.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class measures the host's hardware performance counters
+ *     (cycles, instructions, branch misses, L1d, LLC and dTLB misses)
+ *     while a UM program runs, using perf_event_open, and reports them
+ *     per UM instruction. Counters the kernel will not open (because of
+ *     perf_event_paranoid, a container, or missing hardware support) are
+ *     left out of the report; the program runs either way.
+ *
+ **************************************************************/
+#ifndef PERFCOUNT_INCLUDED
+#define PERFCOUNT_INCLUDED
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* perfcount_start
+ * Purpose: opens and starts the hardware counters for this thread
+ * Parameters: none
+ * Returns: true if at least one counter is running
+ *
+ * Expected input: none
+ * Success output: true
+ * Failure output: false, with the reason on stderr
+ */
+bool perfcount_start();
+
+/* perfcount_report
+ * Purpose: stops the counters and prints them
+ * Parameters: a FILE pointer and a uint64_t
+ * Returns: Nothing
+ *
+ * Expected input: where to print, and the number of UM instructions
+                   executed while the counters ran
+ * Success output: none (one line per counter, with host cycles and
+                   instructions per UM instruction and branch misses per
+                   UM dispatch)
+ * Failure output: none
+ */
+void perfcount_report(FILE *fp, uint64_t um_instructions);
+
+#endif
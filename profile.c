@@ -0,0 +1,393 @@
+/**************************************************************
+ *
+ *                         profile.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the profile class.
+ *
+ **************************************************************/
+#define _GNU_SOURCE             /* for gettid */
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "profile.h"
+#include "metrics.h"
+#include "segment.h"
+
+/* Older C libraries name the field but not the macro */
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+/* Samples the ring holds; a power of 2. The collector empties it ten
+ * times a second, so this is enough for over 6 kHz with room to spare */
+#define RING_SIZE (1u << 16)
+
+/* How often the collector empties the ring, in milliseconds */
+#define COLLECT_INTERVAL_MS 100
+
+/* How many hot spots the report lists */
+#define REPORT_LINES 20
+
+/* A sample is the program counter in the low half and the opcode, or
+ * NO_OPCODE if m[0] could not be read there, in the high half */
+#define NO_OPCODE 0xff
+
+typedef struct Hot_spot {
+        uint64_t sample;        /* 0 for an empty slot; see spot_key */
+        uint64_t count;
+} Hot_spot;
+
+static const char *mnemonics[] = {
+        "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+        "map", "unmap", "out", "in", "loadp", "lv"
+};
+
+/* Written by the signal handler, read by the collector */
+static uint64_t ring[RING_SIZE];
+static uint32_t ring_head;      /* next slot the handler fills */
+static uint32_t ring_tail;      /* next slot the collector empties */
+static uint64_t dropped;
+
+/* The collector's table of counts, open addressed by sample */
+static Hot_spot *spots;
+static size_t spots_capacity;
+static size_t num_spots;
+static uint64_t num_samples;
+
+static timer_t timer;
+static unsigned frequency;
+static double cpu_start;        /* the UM thread's CPU time at the start */
+static pthread_t collector;
+static pthread_mutex_t collector_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t collector_wake = PTHREAD_COND_INITIALIZER;
+static bool stopping;
+
+/* cpu_seconds
+ * Purpose: reads the calling thread's CPU clock
+ * Parameters: none
+ * Returns: the CPU time in seconds
+ *
+ * Expected input: none
+ * Success output: seconds of CPU time the thread has used
+ * Failure output: none
+ */
+static double cpu_seconds()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* take_sample
+ * Purpose: the SIGPROF handler: records where the UM is
+ * Parameters: an int (unused)
+ * Returns: Nothing
+ *
+ * Expected input: runs on the UM's thread, between any two of its
+                   machine instructions
+ * Success output: none (the program counter and opcode are pushed onto
+                   the ring, or counted as dropped if it is full)
+ * Failure output: none
+ */
+static void take_sample(int signal_number)
+{
+    uint32_t pc = __atomic_load_n(&um_metrics.prog_counter,
+                                  __ATOMIC_RELAXED);
+    uint32_t word;
+    uint64_t opcode = segment_zero_peek(pc, &word) ? word >> 28 : NO_OPCODE;
+    uint32_t head = ring_head;
+
+    (void)signal_number;
+
+    if (head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) == RING_SIZE) {
+        __atomic_store_n(&dropped, dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    ring[head % RING_SIZE] = opcode << 32 | pc;
+    __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+}
+
+/* spot_key
+ * Purpose: turns a sample into a key for the table of counts
+ * Parameters: a uint64_t
+ * Returns: the key
+ *
+ * Expected input: a sample from the ring
+ * Success output: the sample plus 1, so that no key is 0
+ * Failure output: none
+ */
+static inline uint64_t spot_key(uint64_t sample)
+{
+    return sample + 1;
+}
+
+/* spot_find
+ * Purpose: finds a sample's slot in the table of counts
+ * Parameters: a Hot_spot pointer, a size_t and a uint64_t
+ * Returns: the slot
+ *
+ * Expected input: a table with a free slot, its capacity (a power of
+                   2), and a key from spot_key
+ * Success output: the slot holding the key, or the empty slot where it
+                   belongs
+ * Failure output: none
+ */
+static Hot_spot *spot_find(Hot_spot *table, size_t capacity, uint64_t key)
+{
+    size_t i = (key * 0x9e3779b97f4a7c15ull >> 32) & (capacity - 1);
+
+    while (table[i].sample != 0 && table[i].sample != key) {
+        i = (i + 1) & (capacity - 1);
+    }
+
+    return &table[i];
+}
+
+/* spot_count
+ * Purpose: adds one sample to the table of counts
+ * Parameters: a uint64_t
+ * Returns: Nothing
+ *
+ * Expected input: a sample from the ring; called only by the collector
+ * Success output: none (the table is doubled when half full)
+ * Failure output: exits the program if memory runs out
+ */
+static void spot_count(uint64_t sample)
+{
+    if (2 * (num_spots + 1) > spots_capacity) {
+        size_t capacity = spots_capacity == 0 ? 1024 : 2 * spots_capacity;
+        Hot_spot *table = calloc(capacity, sizeof(*table));
+        assert(table != NULL);
+
+        for (size_t i = 0; i < spots_capacity; i++) {
+            if (spots[i].sample != 0) {
+                *spot_find(table, capacity, spots[i].sample) = spots[i];
+            }
+        }
+
+        free(spots);
+        spots = table;
+        spots_capacity = capacity;
+    }
+
+    Hot_spot *spot = spot_find(spots, spots_capacity, spot_key(sample));
+
+    if (spot->sample == 0) {
+        spot->sample = spot_key(sample);
+        num_spots++;
+    }
+    spot->count++;
+    num_samples++;
+}
+
+/* drain
+ * Purpose: moves every sample in the ring into the table of counts
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: called only by the collector, or once it has stopped
+ * Success output: none
+ * Failure output: none
+ */
+static void drain()
+{
+    uint32_t tail = ring_tail;
+    uint32_t head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+
+    while (tail != head) {
+        spot_count(ring[tail % RING_SIZE]);
+        tail++;
+    }
+
+    __atomic_store_n(&ring_tail, tail, __ATOMIC_RELEASE);
+}
+
+/* collect
+ * Purpose: the collector thread: empties the ring until told to stop
+ * Parameters: a void pointer (unused)
+ * Returns: NULL
+ *
+ * Expected input: started by profile_start
+ * Success output: none
+ * Failure output: none
+ */
+static void *collect(void *cl)
+{
+    (void)cl;
+
+    pthread_mutex_lock(&collector_lock);
+    while (!stopping) {
+        struct timespec deadline;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += COLLECT_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_cond_timedwait(&collector_wake, &collector_lock, &deadline);
+        drain();
+    }
+    pthread_mutex_unlock(&collector_lock);
+
+    return NULL;
+}
+
+/* profile_start
+ * Purpose: starts sampling the UM on the calling thread
+ * Parameters: an unsigned
+ * Returns: true if the timer is running
+ *
+ * Expected input: samples per second of CPU time, from 1 to
+                   PROFILE_MAX_HZ; called once, on the thread that runs
+                   the UM, before it starts
+ * Success output: true
+ * Failure output: false, with the reason on stderr
+ */
+bool profile_start(unsigned hz)
+{
+    struct sigaction action;
+    struct sigevent event;
+    struct itimerspec interval;
+
+    assert(hz > 0 && hz <= PROFILE_MAX_HZ);
+    frequency = hz;
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = take_sample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGPROF, &action, NULL);
+
+    /* Only this thread's CPU time counts, and only this thread is
+     * interrupted, so that the collector, console and metrics threads
+     * are never sampled */
+    memset(&event, 0, sizeof(event));
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = gettid();
+
+    if (timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) < 0) {
+        fprintf(stderr, "um: cannot start the profiler: %s\n",
+                strerror(errno));
+        return false;
+    }
+
+    if (pthread_create(&collector, NULL, collect, NULL) != 0) {
+        fprintf(stderr, "um: cannot start the profiler thread\n");
+        timer_delete(timer);
+        return false;
+    }
+
+    long period = 1000000000L / hz;
+
+    interval.it_interval.tv_sec = period / 1000000000L;
+    interval.it_interval.tv_nsec = period % 1000000000L;
+    interval.it_value = interval.it_interval;
+    cpu_start = cpu_seconds();
+    timer_settime(timer, 0, &interval, NULL);
+
+    return true;
+}
+
+/* compare_spots
+ * Purpose: orders hot spots for qsort, most samples first
+ * Parameters: two void pointers
+ * Returns: an int, as qsort expects
+ *
+ * Expected input: two Hot_spots
+ * Success output: negative if the first has more samples (or as many,
+                   at a lower offset)
+ * Failure output: none
+ */
+static int compare_spots(const void *left, const void *right)
+{
+    const Hot_spot *a = left, *b = right;
+
+    if (a->count != b->count) {
+        return a->count > b->count ? -1 : 1;
+    }
+    return (a->sample & UINT32_MAX) < (b->sample & UINT32_MAX) ? -1 : 1;
+}
+
+/* profile_report
+ * Purpose: stops sampling and prints the hot spots
+ * Parameters: a FILE pointer
+ * Returns: Nothing
+ *
+ * Expected input: where to print; called on the UM's thread after
+                   profile_start succeeded
+ * Success output: none (the number of samples and the rate at which
+                   they were taken, then the hottest words of m[0] with
+                   their offsets, opcodes and share of the samples)
+ * Failure output: none
+ */
+void profile_report(FILE *fp)
+{
+    timer_delete(timer);
+    signal(SIGPROF, SIG_IGN);
+
+    pthread_mutex_lock(&collector_lock);
+    stopping = true;
+    pthread_cond_signal(&collector_wake);
+    pthread_mutex_unlock(&collector_lock);
+    pthread_join(collector, NULL);
+    drain();
+
+    /* The kernel may round a CPU-time timer up to its tick, so say how
+     * often samples were really taken */
+    double cpu_used = cpu_seconds() - cpu_start;
+
+    fprintf(fp, "um: profile: %" PRIu64 " samples in %.2f s of CPU time "
+            "(%u Hz asked, %.0f Hz taken), %" PRIu64 " dropped\n",
+            num_samples, cpu_used, frequency,
+            cpu_used > 0 ? (num_samples + dropped) / cpu_used : 0.0,
+            dropped);
+    if (num_samples == 0) {
+        return;
+    }
+
+    /* Pack the used slots to the front and sort them */
+    size_t used = 0;
+
+    for (size_t i = 0; i < spots_capacity; i++) {
+        if (spots[i].sample != 0) {
+            spots[used].sample = spots[i].sample - 1;
+            spots[used].count = spots[i].count;
+            used++;
+        }
+    }
+    qsort(spots, used, sizeof(*spots), compare_spots);
+
+    fprintf(fp, "um:   offset    opcode      samples        %%\n");
+    for (size_t i = 0; i < used && i < REPORT_LINES; i++) {
+        uint32_t pc = spots[i].sample & UINT32_MAX;
+        unsigned opcode = spots[i].sample >> 32;
+        const char *name = opcode < sizeof(mnemonics) / sizeof(mnemonics[0])
+                           ? mnemonics[opcode] : "?";
+
+        fprintf(fp, "um:   %08" PRIx32 "  %-6s %12" PRIu64 "  %6.2f\n", pc,
+                name, spots[i].count, 100.0 * spots[i].count / num_samples);
+    }
+
+    free(spots);
+    spots = NULL;
+    spots_capacity = 0;
+    num_spots = 0;
+}
@@ -0,0 +1,64 @@
+/**************************************************************
+ *
+ *                         profile.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class is a sampling profiler for the UM running on the
+ *     calling thread. A timer on the thread's CPU clock sends it SIGPROF
+ *     at a chosen frequency; the handler reads the program counter the
+ *     engines keep in um_metrics (metrics.h) and the word of m[0] there,
+ *     and pushes the pair onto a lock-free ring. A collector thread
+ *     drains the ring into a table of counts, and the report lists the
+ *     hottest words of m[0] by offset, as umdis numbers them.
+ *
+ *     The UM does nothing per instruction beyond the store of its
+ *     program counter it already makes for metrics.h, so the cost is one
+ *     short signal handler per sample: well under 1% at the default
+ *     1000 Hz. The kernel may round the period up to its scheduler tick;
+ *     the report gives the rate actually taken. Samples that arrive
+ *     while the ring is full are dropped and counted.
+ *
+ **************************************************************/
+#ifndef PROFILE_INCLUDED
+#define PROFILE_INCLUDED
+#include <stdbool.h>
+#include <stdio.h>
+
+/* The sampling frequency used when none is given */
+#define PROFILE_DEFAULT_HZ 1000
+
+/* The highest sampling frequency accepted */
+#define PROFILE_MAX_HZ 1000000
+
+/* profile_start
+ * Purpose: starts sampling the UM on the calling thread
+ * Parameters: an unsigned
+ * Returns: true if the timer is running
+ *
+ * Expected input: samples per second of CPU time, from 1 to
+                   PROFILE_MAX_HZ; called once, on the thread that runs
+                   the UM, before it starts
+ * Success output: true
+ * Failure output: false, with the reason on stderr
+ */
+bool profile_start(unsigned hz);
+
+/* profile_report
+ * Purpose: stops sampling and prints the hot spots
+ * Parameters: a FILE pointer
+ * Returns: Nothing
+ *
+ * Expected input: where to print; called on the UM's thread after
+                   profile_start succeeded
+ * Success output: none (the number of samples and the rate at which
+                   they were taken, then the hottest words of m[0] with
+                   their offsets, opcodes and share of the samples)
+ * Failure output: none
+ */
+void profile_report(FILE *fp);
+
+#endif
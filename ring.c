@@ -0,0 +1,108 @@
+/**************************************************************
+ *
+ *                         ring.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Implementation of the ring class.
+ *
+ **************************************************************/
+#include "ring.h"
+
+/* ring_init
+ * Purpose: initializes a ring that was not statically initialized
+ * Parameters: a Ring pointer
+ * Returns: Nothing
+ *
+ * Expected input: an uninitialized ring
+ * Success output: none (the ring is empty and open)
+ * Failure output: none
+ */
+void ring_init(Ring *ring)
+{
+    ring->head = 0;
+    ring->tail = 0;
+    ring->waiting = false;
+    ring->closed = false;
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->wake, NULL);
+}
+
+/* ring_destroy
+ * Purpose: releases the lock and condition variable of a ring
+ * Parameters: a Ring pointer
+ * Returns: Nothing
+ *
+ * Expected input: a ring made by ring_init that neither side is using
+ * Success output: none
+ * Failure output: none
+ */
+void ring_destroy(Ring *ring)
+{
+    pthread_mutex_destroy(&ring->lock);
+    pthread_cond_destroy(&ring->wake);
+}
+
+/* ring_wait
+ * Purpose: sleeps until a counter of a ring moves on from a value, or
+            the ring is closed
+ * Parameters: a Ring pointer, a uint32_t pointer, and a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the ring, its head or tail, and the value seen
+ * Success output: none (it may also return early, so the caller checks
+                   the counter again)
+ * Failure output: none
+ */
+void ring_wait(Ring *ring, uint32_t *counter, uint32_t seen)
+{
+    pthread_mutex_lock(&ring->lock);
+
+    /* The other side stores the counter, fences, then loads the flag
+     * (ring_wake); storing the flag before loading the counter here
+     * means at least one of the two sees the other's store */
+    __atomic_store_n(&ring->waiting, true, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(counter, __ATOMIC_SEQ_CST) == seen
+        && !__atomic_load_n(&ring->closed, __ATOMIC_SEQ_CST)) {
+        pthread_cond_wait(&ring->wake, &ring->lock);
+    }
+    __atomic_store_n(&ring->waiting, false, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/* ring_signal
+ * Purpose: wakes the other side of a ring
+ * Parameters: a Ring pointer
+ * Returns: Nothing
+ *
+ * Expected input: a ring whose other side is waiting
+ * Success output: none
+ * Failure output: none
+ */
+void ring_signal(Ring *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    pthread_cond_signal(&ring->wake);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/* ring_close
+ * Purpose: marks a ring as finished by one side and wakes the other
+ * Parameters: a Ring pointer
+ * Returns: Nothing
+ *
+ * Expected input: a ring to which its producer will add nothing more,
+                   or from which its consumer will take nothing more
+ * Success output: none
+ * Failure output: none
+ */
+void ring_close(Ring *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    __atomic_store_n(&ring->closed, true, __ATOMIC_SEQ_CST);
+    pthread_cond_signal(&ring->wake);
+    pthread_mutex_unlock(&ring->lock);
+}
@@ -0,0 +1,122 @@
+/**************************************************************
+ *
+ *                         ring.h
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     This class is the control block of a bounded single-producer/
+ *     single-consumer ring; the user keeps the elements in an array of
+ *     its own, whose size is a power of two. head and tail count the
+ *     elements taken and added since the start, so tail - head is the
+ *     number waiting, and each is written by only one side with a
+ *     release store that the other side reads with an acquire load.
+ *
+ *     Neither side takes a lock unless it has to wait. A side that finds
+ *     the ring empty (or full) sets the waiting flag, checks the counter
+ *     it is waiting on once more, and sleeps on a condition variable;
+ *     the other side publishes its counter, fences, and signals if it
+ *     sees the flag. Both the flag and the counter are sequentially
+ *     consistent at that point, so either the sleeper sees the new
+ *     counter or the other side sees the flag, and no wakeup is missed.
+ *     Either side may close the ring when it is done with it, which
+ *     wakes the other for good.
+ *
+ **************************************************************/
+#ifndef RING_INCLUDED
+#define RING_INCLUDED
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct Ring {
+        uint32_t head;
+        uint32_t tail;
+        bool waiting;
+        bool closed;            /* one side is done with the ring */
+        pthread_mutex_t lock;
+        pthread_cond_t wake;
+} Ring;
+
+#define RING_INITIALIZER { 0, 0, false, false, PTHREAD_MUTEX_INITIALIZER, \
+                           PTHREAD_COND_INITIALIZER }
+
+/* ring_init
+ * Purpose: initializes a ring that was not statically initialized
+ * Parameters: a Ring pointer
+ * Returns: Nothing
+ *
+ * Expected input: an uninitialized ring
+ * Success output: none (the ring is empty and open)
+ * Failure output: none
+ */
+void ring_init(Ring *ring);
+
+/* ring_destroy
+ * Purpose: releases the lock and condition variable of a ring
+ * Parameters: a Ring pointer
+ * Returns: Nothing
+ *
+ * Expected input: a ring made by ring_init that neither side is using
+ * Success output: none
+ * Failure output: none
+ */
+void ring_destroy(Ring *ring);
+
+/* ring_wait
+ * Purpose: sleeps until a counter of a ring moves on from a value, or
+            the ring is closed
+ * Parameters: a Ring pointer, a uint32_t pointer, and a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the ring, its head or tail, and the value seen
+ * Success output: none (it may also return early, so the caller checks
+                   the counter again)
+ * Failure output: none
+ */
+void ring_wait(Ring *ring, uint32_t *counter, uint32_t seen);
+
+/* ring_signal
+ * Purpose: wakes the other side of a ring
+ * Parameters: a Ring pointer
+ * Returns: Nothing
+ *
+ * Expected input: a ring whose other side is waiting
+ * Success output: none
+ * Failure output: none
+ */
+void ring_signal(Ring *ring);
+
+/* ring_close
+ * Purpose: marks a ring as finished by one side and wakes the other
+ * Parameters: a Ring pointer
+ * Returns: Nothing
+ *
+ * Expected input: a ring to which its producer will add nothing more,
+                   or from which its consumer will take nothing more
+ * Success output: none
+ * Failure output: none
+ */
+void ring_close(Ring *ring);
+
+/* ring_wake
+ * Purpose: wakes the other side of a ring if it is asleep
+ * Parameters: a Ring pointer
+ * Returns: Nothing
+ *
+ * Expected input: a ring whose head or tail has just been stored
+ * Success output: none
+ * Failure output: none
+ */
+static inline void ring_wake(Ring *ring)
+{
+    /* Orders the counter's store before the flag's load; see ring_wait */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST)) {
+        ring_signal(ring);
+    }
+}
+
+#endif
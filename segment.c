@@ -10,89 +10,575 @@
  *     Implementation of the segment class.
  *     
  **************************************************************/
+#include <string.h>
+
 #include "segment.h"
+#include "backing.h"
+#include "arena.h"
+#include "decode.h"
+#include "metrics.h"
 
-Seq_T segments;
-Seq_T available_indices;
+typedef struct Segment {
+    uint32_t length;
+    Backing_source source;      /* where backing_alloc took words from */
+    bool in_arena;      /* words came from the UM's arena */
+    uint32_t *words;
+    void (*release)(uint32_t *words);   /* called before words are freed */
+} *Segment;
 
-/* init_segment
- * Purpose: initializes our sequences of segments and available indicies,
-            and places m0 into our segments sequence
- * Parameters: A UArray_T
+/* How many segments the inline cache remembers; a power of 2 */
+#define SEGMENT_CACHE_SIZE 4
+
+/* A remembered segment. tag is the segment's index plus 1, so that an
+ * entry of zeroes holds nothing: it could only match index UINT32_MAX,
+ * which is never mapped, and its length of 0 makes that access fail as
+ * it should. */
+typedef struct Cache_entry {
+    uint32_t tag;
+    uint32_t length;
+    uint32_t *words;
+} Cache_entry;
+
+/* A handle is HANDLE_BIT, a tag from the slot's generation, and the
+ * segment's index; indices too large for the field stay plain */
+#define HANDLE_BIT 0x80000000u
+#define HANDLE_INDEX_BITS 20
+#define HANDLE_INDEX_MASK ((1u << HANDLE_INDEX_BITS) - 1)
+#define HANDLE_TAG_MASK ((HANDLE_BIT >> HANDLE_INDEX_BITS) - 1)
+
+typedef struct Handle_slot {
+    uint32_t handle;        /* 0 unless the index is mapped as a handle */
+    uint32_t length;
+    uint32_t *words;
+    uint32_t generation;    /* times the index has been given a handle */
+} Handle_slot;
+
+/* Set by segment_use_handles for every UM in the process */
+static bool use_handles = false;
+
+/* Set by segment_use_arena for every UM in the process */
+static bool use_arena = false;
+
+/* Each UM runs on a thread of its own, so its memory is thread-local */
+static __thread Segment *segments;            /* NULL where unmapped */
+static __thread uint32_t num_segments;
+static __thread uint32_t segments_capacity;
+static __thread uint32_t *free_indices;         /* a ring, oldest first */
+static __thread uint32_t free_head;
+static __thread uint32_t num_free;
+static __thread uint32_t free_capacity;
+static __thread Cache_entry cache[SEGMENT_CACHE_SIZE];
+static __thread uint64_t cache_hits;
+static __thread uint64_t cache_misses;
+static __thread Handle_slot *handle_slots;      /* NULL without handles */
+static __thread Arena arena;                    /* NULL without an arena */
+
+/* Told of every store, for the debugger; NULL almost always */
+static __thread Segment_watcher watcher;
+
+/* m[0], republished whenever it changes and before the old one is
+ * freed, so that a signal handler on this thread can read it while
+ * segments is being grown */
+static __thread Segment published_zero;
+
+/* bad_handle
+ * Purpose: stops a program that used a handle whose tag is stale
+ * Parameters: A uint32_t
+ * Returns: does not return
+ *
+ * Expected input: The offending ID
+ * Success output: none
+ * Failure output: always exits the program with status 1, saying why on
+                    stderr
+ */
+static void bad_handle(uint32_t segment_id)
+{
+    fprintf(stderr, "um: segment ID 0x%08x is a stale handle\n",
+            segment_id);
+    exit(1);
+}
+
+/* is_handle
+ * Purpose: tells whether a segment ID should be looked up as a handle
+ * Parameters: A uint32_t
+ * Returns: true if it is a handle
+ *
+ * Expected input: Any ID
+ * Success output: true if handles are in use and the ID has HANDLE_BIT
+                    set; without handles every ID is a plain index, and
+                    one that large simply fails its bounds check
+ * Failure output: none
+ */
+static inline bool is_handle(uint32_t segment_id)
+{
+    return (segment_id & HANDLE_BIT) != 0 && handle_slots != NULL;
+}
+
+/* handle_slot
+ * Purpose: finds the slot a handle names, checking its tag
+ * Parameters: A uint32_t
+ * Returns: A pointer to the Handle_slot
+ *
+ * Expected input: An ID for which is_handle is true
+ * Success output: The slot of a segment that is mapped under exactly
+                    this handle
+ * Failure output: exits the program (see bad_handle) if the segment was
+                    unmapped or never mapped under this handle
+ */
+static inline Handle_slot *handle_slot(uint32_t handle)
+{
+    Handle_slot *slot = &handle_slots[handle & HANDLE_INDEX_MASK];
+
+    if (slot->handle != handle) {
+        bad_handle(handle);
+    }
+
+    return slot;
+}
+
+/* segment_index_of
+ * Purpose: turns a segment ID from a program into an index into the
+            table of segments
+ * Parameters: A uint32_t
+ * Returns: A uint32_t
+ *
+ * Expected input: Any ID
+ * Success output: The index, for a live handle or a plain index
+ * Failure output: exits the program if the ID is a handle that is not
+                    live
+ */
+static uint32_t segment_index_of(uint32_t segment_id)
+{
+    if (is_handle(segment_id)) {
+        return handle_slot(segment_id) - handle_slots;
+    }
+
+    return segment_id;
+}
+
+/* cache_lookup
+ * Purpose: finds a segment's words and length, through the inline cache
+ * Parameters: A uint32_t
+ * Returns: A pointer to the cache entry holding the segment
+ *
+ * Expected input: Any segment index, including the index part of a
+                    live handle, which a program that computes its
+                    segment IDs may use instead of the handle
+ * Success output: The entry, filled in from the table of segments on
+                    a miss
+ * Failure output: exits the program if the index is out of bounds or
+                    the segment is not mapped
+ */
+static inline Cache_entry *cache_lookup(uint32_t segment_index)
+{
+    Cache_entry *entry = &cache[segment_index & (SEGMENT_CACHE_SIZE - 1)];
+
+    if (entry->tag == segment_index + 1) {
+        cache_hits++;
+        return entry;
+    }
+    cache_misses++;
+
+    if (segment_index >= num_segments) {
+        exit(1);
+    }
+    Segment seg = segments[segment_index];
+
+    if (seg == NULL) {
+        exit(1);
+    }
+
+    entry->tag = segment_index + 1;
+    entry->length = seg->length;
+    entry->words = seg->words;
+
+    return entry;
+}
+
+/* cache_forget
+ * Purpose: drops a segment from the inline cache
+ * Parameters: A uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: The index of a segment that is being freed or replaced
+ * Success output: none (the next access to the index misses)
+ * Failure output: none
+ */
+static void cache_forget(uint32_t segment_index)
+{
+    Cache_entry *entry = &cache[segment_index & (SEGMENT_CACHE_SIZE - 1)];
+
+    if (entry->tag == segment_index + 1) {
+        memset(entry, 0, sizeof(*entry));
+    }
+}
+
+/* handles_start
+ * Purpose: gives the calling thread an empty table of handle slots, if
+            handles are in use
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: called as the segments are initialized
+ * Success output: none
+ * Failure output: exits the program if memory runs out
+ */
+static void handles_start()
+{
+    free(handle_slots);
+    handle_slots = NULL;
+
+    if (use_handles) {
+        /* calloc maps a table this large lazily, so unused slots cost
+         * nothing */
+        handle_slots = calloc(HANDLE_INDEX_MASK + 1, sizeof(Handle_slot));
+        assert(handle_slots != NULL);
+    }
+}
+
+/* tables_start
+ * Purpose: makes the calling thread's table of segments and queue of
+            unmapped indices, both empty
+ * Parameters: two uint32_ts
+ * Returns: Nothing
+ *
+ * Expected input: room to reserve in each; the old ones, if any, have
+                   been freed
+ * Success output: none
+ * Failure output: exits the program if memory runs out
+ */
+static void tables_start(uint32_t segment_room, uint32_t free_room)
+{
+    segments_capacity = segment_room > 16 ? segment_room : 16;
+    segments = malloc(segments_capacity * sizeof(Segment));
+    num_segments = 0;
+
+    free_capacity = free_room > 16 ? free_room : 16;
+    free_indices = malloc(free_capacity * sizeof(uint32_t));
+    free_head = 0;
+    num_free = 0;
+
+    if (segments == NULL || free_indices == NULL) {
+        exit(1);
+    }
+
+    if (use_arena && arena == NULL) {
+        arena = arena_new();
+    }
+}
+
+/* table_add
+ * Purpose: appends a slot to the table of segments
+ * Parameters: A Segment
+ * Returns: The new slot's index
+ *
+ * Expected input: A Segment, or NULL for an unmapped slot
+ * Success output: The index, one past the previous last slot
+ * Failure output: exits the program if memory runs out
+ */
+static uint32_t table_add(Segment seg)
+{
+    if (num_segments == segments_capacity) {
+        segments_capacity *= 2;
+        segments = realloc(segments, segments_capacity * sizeof(Segment));
+        if (segments == NULL) {
+            exit(1);
+        }
+    }
+
+    segments[num_segments] = seg;
+    return num_segments++;
+}
+
+/* queue_push
+ * Purpose: adds an unmapped index to the back of the queue
+ * Parameters: A uint32_t
  * Returns: Nothing
  *
- * Expected input: A UArray_T of instructions read in from a file
- * Success output: none 
+ * Expected input: An index that is not mapped
+ * Success output: none (the index is reused after every index already
+                    in the queue)
+ * Failure output: exits the program if memory runs out
+ */
+static void queue_push(uint32_t index)
+{
+    if (num_free == free_capacity) {
+        uint32_t *grown = malloc(2 * free_capacity * sizeof(uint32_t));
+
+        if (grown == NULL) {
+            exit(1);
+        }
+        for (uint32_t i = 0; i < num_free; i++) {
+            grown[i] = free_indices[(free_head + i) % free_capacity];
+        }
+
+        free(free_indices);
+        free_indices = grown;
+        free_head = 0;
+        free_capacity *= 2;
+    }
+
+    free_indices[(free_head + num_free) % free_capacity] = index;
+    num_free++;
+}
+
+/* queue_pop
+ * Purpose: takes the oldest unmapped index from the queue
+ * Parameters: none
+ * Returns: A uint32_t
+ *
+ * Expected input: A queue that is not empty
+ * Success output: The index that was unmapped longest ago
  * Failure output: none
  */
-void init_segment(UArray_T m0)
+static uint32_t queue_pop()
 {
-    segments = Seq_new(0);
-    available_indices = Seq_new(0);
-    Seq_addhi(segments, m0);
+    uint32_t index = free_indices[free_head];
+
+    free_head = (free_head + 1) % free_capacity;
+    num_free--;
+
+    return index;
+}
+
+/* header_new
+ * Purpose: allocates the header of a segment
+ * Parameters: none
+ * Returns: The new Segment, with nothing filled in
+ *
+ * Expected input: the calling thread's tables have been started
+ * Success output: A Segment from the UM's arena if it has one, or else
+                   from the heap
+ * Failure output: exits the program if memory runs out
+ */
+static Segment header_new()
+{
+    if (arena != NULL) {
+        return arena_alloc(arena, sizeof(struct Segment));
+    }
+
+    Segment seg = malloc(sizeof(*seg));
+    assert(seg != NULL);
+
+    return seg;
+}
+
+/* segment_new
+ * Purpose: allocates a segment of zeroed words from the arena, for small
+            segments of a UM that has one, or else from the backing store
+ * Parameters: A uint32_t and a bool
+ * Returns: The new Segment
+ *
+ * Expected input: The number of words, and whether the segment should be
+                    placed as if it were large (true for m0)
+ * Success output: A Segment whose words are all 0, counted in the
+                   live segment metrics
+ * Failure output: exits the program if memory runs out
+ */
+static Segment segment_new(uint32_t length, bool always_large)
+{
+    Segment seg = header_new();
+    size_t bytes = (size_t)length * sizeof(uint32_t);
+
+    seg->length = length;
+    seg->in_arena = arena != NULL && !always_large
+                    && bytes <= ARENA_MAX_BYTES;
+    if (seg->in_arena) {
+        seg->words = arena_alloc(arena, bytes);
+        seg->source = SOURCE_HEAP;
+    } else {
+        seg->words = backing_alloc(length, always_large, &seg->source);
+    }
+    seg->release = NULL;
+
+    METRICS_ADD(live_segments, 1);
+    METRICS_ADD(mapped_words, length);
+
+    return seg;
+}
+
+/* segment_free
+ * Purpose: returns a segment's words to the arena or the backing store
+            they came from, and frees it
+ * Parameters: A Segment
+ * Returns: Nothing
+ *
+ * Expected input: A Segment made by segment_new
+ * Success output: none
+ * Failure output: none
+ */
+static void segment_free(Segment seg)
+{
+    METRICS_ADD(live_segments, -1);
+    METRICS_ADD(mapped_words, -(uint64_t)seg->length);
+
+    if (seg->release != NULL) {
+        seg->release(seg->words);
+    }
+
+    if (seg->in_arena) {
+        arena_release(arena, seg->words,
+                      (size_t)seg->length * sizeof(uint32_t));
+    } else {
+        backing_free(seg->words, seg->length, seg->source);
+    }
+
+    if (arena != NULL) {
+        arena_release(arena, seg, sizeof(*seg));
+    } else {
+        free(seg);
+    }
+}
+
+/* init_segment
+ * Purpose: initializes our table of segments and queue of available
+            indices, and maps a zeroed m0 of the given length
+ * Parameters: A uint32_t
+ * Returns: A pointer to the words of m0
+ *
+ * Expected input: The number of instructions in the program
+ * Success output: A pointer the caller fills with the program's
+                   instructions before execution begins
+ * Failure output: none
+ */
+uint32_t *init_segment(uint32_t num_words)
+{
+    memset(cache, 0, sizeof(cache));
+    handles_start();
+    tables_start(0, 0);
+
+    Segment m0 = segment_new(num_words, true);
+    table_add(m0);
+    __atomic_store_n(&published_zero, m0, __ATOMIC_SEQ_CST);
+
+    return m0->words;
+}
+
+/* init_segment_reserved
+ * Purpose: initializes the segments like init_segment, but leaves the
+            pages of m0 inaccessible so that the caller can fill them in
+            when they are first touched
+ * Parameters: A uint32_t and a function pointer
+ * Returns: A pointer to the words of m0, or NULL
+ *
+ * Expected input: The number of instructions in the program, and a
+                   function to call with m0's words just before they are
+                   freed (when m0 is replaced or the segments are freed)
+ * Success output: A pointer to words from backing_reserve, which the
+                   caller must mprotect a page at a time before they are
+                   read or written
+ * Failure output: NULL, with nothing initialized, if the memory cannot
+                   be reserved
+ */
+uint32_t *init_segment_reserved(uint32_t num_words,
+                                void (*release)(uint32_t *words))
+{
+    uint32_t *words = backing_reserve(num_words);
+
+    if (words == NULL) {
+        return NULL;
+    }
+
+    memset(cache, 0, sizeof(cache));
+    handles_start();
+    tables_start(0, 0);
+
+    Segment m0 = header_new();
+
+    m0->length = num_words;
+    m0->source = SOURCE_PAGES;
+    m0->in_arena = false;
+    m0->words = words;
+    m0->release = release;
+
+    METRICS_ADD(live_segments, 1);
+    METRICS_ADD(mapped_words, num_words);
+
+    table_add(m0);
+    __atomic_store_n(&published_zero, m0, __ATOMIC_SEQ_CST);
+
+    return words;
 }
 
 /* new_segment
- * Purpose: maps a new segment by adding it to our sequence of segments
+ * Purpose: maps a new segment by adding it to our table of segments
  * Parameters: An integer
  * Returns: Nothing
  *
  * Expected input: An integer denoting the size of the segment to be
                     mapped
- * Success output: The index that the new segment was mapped to
+ * Success output: The index that the new segment was mapped to, or a
+                    handle for it if handles are in use
  * Failure output: none
  */
 uint32_t new_segment(int size)
 {
-    UArray_T segment = UArray_new(size, sizeof(uint32_t));
+    /* The backing store hands out words that are already 0 */
+    Segment segment = segment_new(size, false);
+    uint32_t index;
 
-    /* Set instruction words to be 0*/
-    for (int i = 0; i < size; i++) {
-        *(uint32_t *)UArray_at(segment, i) = 0;
+    if (num_free == 0) {
+        index = table_add(segment);
+    } else {
+        index = queue_pop();
+        segments[index] = segment;
     }
 
-    if (Seq_length(available_indices) == 0) {
-        Seq_addhi(segments, segment);
-        return (Seq_length(segments) - 1);
-    } else {
-        uint32_t *available_index_p = (uint32_t *)Seq_remlo(available_indices);
-        uint32_t available_index = *available_index_p;
-        free(available_index_p);
+    if (handle_slots == NULL || index > HANDLE_INDEX_MASK) {
+        return index;
+    }
 
-        Seq_put(segments, available_index, segment);
+    Handle_slot *slot = &handle_slots[index];
 
-        return available_index;
-    }
+    slot->generation++;
+    slot->handle = HANDLE_BIT
+                   | (slot->generation & HANDLE_TAG_MASK) << HANDLE_INDEX_BITS
+                   | index;
+    slot->length = segment->length;
+    slot->words = segment->words;
+
+    return slot->handle;
 }
 
 /* free_segment
- * Purpose: frees the UArray at the given index
+ * Purpose: frees the segment at the given index
  * Parameters: A uint32_t
  * Returns: Nothing
  *
- * Expected input: A valid segment index
- * Success output: none
+ * Expected input: A valid segment index or live handle
+ * Success output: none; the segment's handle, if it had one, is stale
+                    from now on whichever ID the segment was freed by
  * Failure output: exits the program if the supplied index is out of bounds
  */
 void free_segment(uint32_t segment_index)
 {
-    if ((int)segment_index >= Seq_length(segments)) {
+    if (is_handle(segment_index)) {
+        segment_index = handle_slot(segment_index) - handle_slots;
+    }
+
+    if (segment_index >= num_segments) {
         exit(1);
     }
+    if (handle_slots != NULL && segment_index <= HANDLE_INDEX_MASK) {
+        handle_slots[segment_index].handle = 0;
+    }
+
+    Segment seg = segments[segment_index];
 
-    UArray_T seg = (UArray_T)Seq_put(segments, segment_index, NULL);
-    UArray_free(&seg);
+    if (seg == NULL) {
+        exit(1);
+    }
 
-    uint32_t *available_index = malloc(sizeof(uint32_t));
-    assert (available_index != NULL);
+    segments[segment_index] = NULL;
+    cache_forget(segment_index);
+    segment_free(seg);
 
-    *available_index = segment_index;
-    Seq_addhi(available_indices, available_index);
+    queue_push(segment_index);
 }
 
 /* free_all_segments
- * Purpose: frees both the segments and available_indicies sequences and
-            everything in them
+ * Purpose: frees the table of segments and the queue of available
+            indices, and everything in them
  * Parameters: none
  * Returns: Nothing
  *
@@ -102,26 +588,43 @@ void free_segment(uint32_t segment_index)
  */
 void free_all_segments()
 {
-    int length = Seq_length(segments);
+    __atomic_store_n(&published_zero, NULL, __ATOMIC_SEQ_CST);
 
-    for (int i = 0; i < length; i++) {
-        UArray_T seg = (UArray_T)Seq_remlo(segments); 
+    for (uint32_t i = 0; i < num_segments; i++) {
+        Segment seg = segments[i];
 
-        if (seg != NULL) {
-            UArray_free(&seg);
+        if (seg == NULL) {
+            continue;
+        }
+
+        if (arena == NULL) {
+            segment_free(seg);
+        } else if (!seg->in_arena) {
+            /* Only what the arena did not hand out is freed one by one */
+            if (seg->release != NULL) {
+                seg->release(seg->words);
+            }
+            backing_free(seg->words, seg->length, seg->source);
         }
     }
 
-    Seq_free(&segments);
+    if (arena != NULL) {
+        arena_free(&arena);
+        METRICS_SET(live_segments, 0);
+        METRICS_SET(mapped_words, 0);
+    }
 
-    length = Seq_length(available_indices);
+    free(segments);
+    segments = NULL;
+    num_segments = 0;
 
-    for (int i = 0; i < length; i++) {
-        uint32_t *available_index = (uint32_t *)Seq_remlo(available_indices); 
-        free(available_index);
-    }
+    free(free_indices);
+    free_indices = NULL;
+    num_free = 0;
 
-    Seq_free(&available_indices);
+    memset(cache, 0, sizeof(cache));
+    free(handle_slots);
+    handle_slots = NULL;
 }
 
 /* get_word
@@ -136,17 +639,22 @@ void free_all_segments()
  */
 uint32_t get_word(uint32_t segment_index, uint32_t word_index)
 {
-    if ((int)segment_index >= Seq_length(segments)) {
-        exit(1);
+    if (is_handle(segment_index)) {
+        Handle_slot *slot = handle_slot(segment_index);
+
+        if (word_index >= slot->length) {
+            exit(1);
+        }
+        return slot->words[word_index];
     }
 
-    UArray_T seg = (UArray_T)Seq_get(segments, segment_index);
+    Cache_entry *seg = cache_lookup(segment_index);
 
-    if ((int)word_index >= UArray_length(seg)) {
+    if (word_index >= seg->length) {
         exit(1);
     }
 
-    uint32_t word = *(uint32_t *)UArray_at(seg, word_index);
+    uint32_t word = seg->words[word_index];
    
     return word;
 }
@@ -164,17 +672,33 @@ uint32_t get_word(uint32_t segment_index, uint32_t word_index)
  */
 void set_word(uint32_t segment_index, uint32_t word_index, uint32_t word)
 {
-    if ((int)segment_index >= Seq_length(segments)) {
-        exit(1);
+    if (is_handle(segment_index)) {
+        Handle_slot *slot = handle_slot(segment_index);
+
+        if (word_index >= slot->length) {
+            exit(1);
+        }
+        if (watcher != NULL) {
+            watcher(segment_index, word_index, slot->words[word_index], word);
+        }
+        slot->words[word_index] = word;
+        return;
     }
 
-    UArray_T seg = (UArray_T)Seq_get(segments, segment_index);
+    Cache_entry *seg = cache_lookup(segment_index);
     
-    if ((int)word_index >= UArray_length(seg)) {
+    if (word_index >= seg->length) {
         exit(1);
     }
 
-    *(uint32_t *)UArray_at(seg, word_index) = word;
+    if (watcher != NULL) {
+        watcher(segment_index, word_index, seg->words[word_index], word);
+    }
+    seg->words[word_index] = word;
+
+    if (segment_index == 0) {
+        decode_invalidate(word_index);
+    }
 }
 
 /* replace_segment_zero
@@ -189,7 +713,9 @@ void set_word(uint32_t segment_index, uint32_t word_index, uint32_t word)
  */
 void replace_segment_zero(uint32_t new_segment_index)
 {
-    if ((int)new_segment_index >= Seq_length(segments)) {
+    new_segment_index = segment_index_of(new_segment_index);
+
+    if (new_segment_index >= num_segments) {
         exit(1);
     }
 
@@ -197,11 +723,160 @@ void replace_segment_zero(uint32_t new_segment_index)
         return;
     }
 
-    UArray_T seg = Seq_get(segments, new_segment_index);
-    UArray_T new_seg_zero = UArray_copy(seg, UArray_length(seg));
+    Segment seg = segments[new_segment_index];
+
+    if (seg == NULL) {
+        exit(1);
+    }
+
+    Segment new_seg_zero = segment_new(seg->length, true);
+    memcpy(new_seg_zero->words, seg->words, seg->length * sizeof(uint32_t));
+
+    Segment orig_seg_zero = segments[0];
+
+    segments[0] = new_seg_zero;
+    __atomic_store_n(&published_zero, new_seg_zero, __ATOMIC_SEQ_CST);
+    cache_forget(0);
+
+    /* Predecode workers may still be reading the old m[0]; this stops
+     * them, so it must come before the old words are freed */
+    decode_replace(new_seg_zero->words, new_seg_zero->length);
+    segment_free(orig_seg_zero);
+}
+
+/* save_segments
+ * Purpose: writes every segment, and the order in which freed indices
+            will be reused, to a file
+ * Parameters: a FILE pointer
+ * Returns: true if everything was written
+ *
+ * Expected input: an open file
+ * Success output: true; the file holds the number of segment slots and
+                   of free indices, then for each slot a word saying
+                   whether it is mapped, its length and its words, then
+                   the free indices, all as native uint32_ts
+ * Failure output: false
+ */
+bool save_segments(FILE *fp)
+{
+    uint32_t counts[2] = { num_segments, num_free };
+
+    fwrite(counts, sizeof(uint32_t), 2, fp);
+
+    for (uint32_t i = 0; i < counts[0]; i++) {
+        Segment seg = segments[i];
+        uint32_t header[2] = { seg != NULL, seg != NULL ? seg->length : 0 };
+
+        fwrite(header, sizeof(uint32_t), 2, fp);
+        if (seg != NULL) {
+            fwrite(seg->words, sizeof(uint32_t), seg->length, fp);
+        }
+    }
+
+    for (uint32_t i = 0; i < counts[1]; i++) {
+        uint32_t index = free_indices[(free_head + i) % free_capacity];
+
+        fwrite(&index, sizeof(uint32_t), 1, fp);
+    }
+
+    return !ferror(fp);
+}
+
+/* check_saved_segments
+ * Purpose: checks that words written by save_segments are well formed
+ * Parameters: a uint32_t pointer and a size_t
+ * Returns: true if restore_segments can safely use the words
+ *
+ * Expected input: the saved words and their number
+ * Success output: true
+ * Failure output: false if a count or length runs past the end, m[0] is
+                   not mapped, or a free index is not an unmapped slot
+ */
+static bool check_saved_segments(const uint32_t *data, size_t num_words)
+{
+    if (num_words < 2 || data[0] == 0) {
+        return false;
+    }
+
+    uint32_t num_segments = data[0];
+    uint32_t num_free = data[1];
+    const uint32_t *slot = data + 2;
+    const uint32_t *end = data + num_words;
+    uint32_t *free_slot = calloc(num_segments, sizeof(uint32_t));
+    bool ok = true;
+
+    assert(free_slot != NULL);
+
+    for (uint32_t i = 0; ok && i < num_segments; i++) {
+        if (end - slot < 2 || (size_t)(end - slot - 2) < slot[1]
+            || slot[0] > 1 || (i == 0 && slot[0] == 0)) {
+            ok = false;
+            break;
+        }
+        free_slot[i] = slot[0] == 0;
+        slot += 2 + (slot[0] != 0 ? slot[1] : 0);
+    }
+
+    ok = ok && (size_t)(end - slot) == num_free;
 
-    UArray_T orig_seg_zero = (UArray_T)Seq_put(segments, 0, new_seg_zero);
-    UArray_free(&orig_seg_zero);
+    for (uint32_t i = 0; ok && i < num_free; i++) {
+        ok = slot[i] < num_segments && free_slot[slot[i]];
+        if (ok) {
+            free_slot[slot[i]] = 0;     /* no index may be free twice */
+        }
+    }
+
+    free(free_slot);
+    return ok;
+}
+
+/* restore_segments
+ * Purpose: replaces every segment with ones written by save_segments
+ * Parameters: a uint32_t pointer and a size_t
+ * Returns: a pointer to the words of the new m0, or NULL
+ *
+ * Expected input: the saved words and their number; the segments may
+                   or may not have been initialized
+ * Success output: the new m0's words; the old segments are freed
+ * Failure output: NULL, leaving the segments as they were, if the
+                   words are not well formed
+ */
+uint32_t *restore_segments(const uint32_t *data, size_t num_words)
+{
+    if (!check_saved_segments(data, num_words)) {
+        return NULL;
+    }
+
+    if (segments != NULL) {
+        free_all_segments();
+    }
+
+    uint32_t saved_segments = data[0];
+    uint32_t saved_free = data[1];
+    const uint32_t *slot = data + 2;
+
+    memset(cache, 0, sizeof(cache));
+    tables_start(saved_segments, saved_free);
+
+    for (uint32_t i = 0; i < saved_segments; i++) {
+        Segment seg = NULL;
+
+        if (slot[0] != 0) {
+            seg = segment_new(slot[1], i == 0);
+            memcpy(seg->words, slot + 2, slot[1] * sizeof(uint32_t));
+            slot += slot[1];
+        }
+        slot += 2;
+
+        table_add(seg);
+    }
+
+    for (uint32_t i = 0; i < saved_free; i++) {
+        queue_push(slot[i]);
+    }
+
+    __atomic_store_n(&published_zero, segments[0], __ATOMIC_SEQ_CST);
+    return segments[0]->words;
 }
 
 /* seg_zero_length
@@ -215,6 +890,162 @@ void replace_segment_zero(uint32_t new_segment_index)
  */
 int seg_zero_length()
 {
-    UArray_T seg_zero = (UArray_T)Seq_get(segments, 0);
-    return UArray_length(seg_zero);
+    Segment seg_zero = segments[0];
+    return seg_zero->length;
+}
+
+/* segment_words
+ * Purpose: gives direct access to the words of a segment
+ * Parameters: a uint32_t and a uint32_t pointer
+ * Returns: a pointer to the segment's words
+ *
+ * Expected input: the index of a mapped segment, and where to store its
+                   length
+ * Success output: the words, valid until the segment is freed or (for
+                   m0) replaced
+ * Failure output: exits the program if the index is out of bounds or
+                   the segment is not mapped
+ */
+uint32_t *segment_words(uint32_t segment_index, uint32_t *length)
+{
+    segment_index = segment_index_of(segment_index);
+
+    if (segment_index >= num_segments) {
+        exit(1);
+    }
+
+    Segment seg = segments[segment_index];
+
+    if (seg == NULL) {
+        exit(1);
+    }
+
+    *length = seg->length;
+    return seg->words;
+}
+
+/* segment_zero_peek
+ * Purpose: reads a word of m[0] from a signal handler
+ * Parameters: a uint32_t and a uint32_t pointer
+ * Returns: true if the word was read
+ *
+ * Expected input: an index in m[0], and where to store the word; safe
+                   to call from a signal handler on the UM's thread,
+                   whatever the UM was doing when it was interrupted
+ * Success output: true, with the word stored
+ * Failure output: false if there is no m[0] or the index is past its end
+ */
+bool segment_zero_peek(uint32_t word_index, uint32_t *word)
+{
+    Segment seg = __atomic_load_n(&published_zero, __ATOMIC_SEQ_CST);
+
+    if (seg == NULL || word_index >= seg->length) {
+        return false;
+    }
+
+    *word = seg->words[word_index];
+    return true;
+}
+
+/* segment_peek
+ * Purpose: reads a word of any segment without stopping the program
+ * Parameters: 2 uint32_ts and a uint32_t pointer
+ * Returns: true if the word was read
+ *
+ * Expected input: any segment ID and word index, and where to store the
+                   word
+ * Success output: true, with the word stored
+ * Failure output: false if the segment is not mapped or the index is
+                   out of bounds
+ */
+bool segment_peek(uint32_t segment_id, uint32_t word_index, uint32_t *word)
+{
+    uint32_t length;
+    const uint32_t *words;
+
+    if (is_handle(segment_id)) {
+        Handle_slot *slot = &handle_slots[segment_id & HANDLE_INDEX_MASK];
+
+        if (slot->handle != segment_id) {
+            return false;
+        }
+        length = slot->length;
+        words = slot->words;
+    } else {
+        if (segment_id >= num_segments || segments[segment_id] == NULL) {
+            return false;
+        }
+        length = segments[segment_id]->length;
+        words = segments[segment_id]->words;
+    }
+
+    if (word_index >= length) {
+        return false;
+    }
+
+    *word = words[word_index];
+    return true;
+}
+
+/* segment_watch
+ * Purpose: sets a function to be told of every store by set_word on the
+            calling thread
+ * Parameters: a Segment_watcher
+ * Returns: Nothing
+ *
+ * Expected input: the watcher, or NULL for none
+ * Success output: none (each store is reported before it is made)
+ * Failure output: none
+ */
+void segment_watch(Segment_watcher watch)
+{
+    watcher = watch;
+}
+
+/* segment_cache_stats
+ * Purpose: reports how often the inline segment cache has been hit
+ * Parameters: two uint64_t pointers
+ * Returns: Nothing
+ *
+ * Expected input: where to store the counts
+ * Success output: none (the calling thread's hits and misses, counted
+                   over every get_word and set_word it has made)
+ * Failure output: none
+ */
+void segment_cache_stats(uint64_t *hits, uint64_t *misses)
+{
+    *hits = cache_hits;
+    *misses = cache_misses;
+}
+
+/* segment_use_handles
+ * Purpose: chooses whether new segments are named by tagged handles
+            instead of indices
+ * Parameters: a bool
+ * Returns: Nothing
+ *
+ * Expected input: true for handles; called before any UM initializes
+                   its segments
+ * Success output: none (from now on, new_segment returns handles)
+ * Failure output: none
+ */
+void segment_use_handles(bool enabled)
+{
+    use_handles = enabled;
+}
+
+/* segment_use_arena
+ * Purpose: chooses whether each UM allocates its segments from an arena
+ * Parameters: a bool
+ * Returns: Nothing
+ *
+ * Expected input: true for arenas; called before any UM initializes
+                   its segments
+ * Success output: none (from now on, each UM that initializes its
+                   segments gets an arena, freed with its segments)
+ * Failure output: none
+ */
+void segment_use_arena(bool enabled)
+{
+    use_arena = enabled;
 }
@@ -10,47 +10,102 @@
  *     This class allows the user to manage segmented memory. It offers
  *     functions to allocate new segments of memory, free memory segments,
  *     and access the elements within segments. Users should know that in
- *     this implementation, each segment holds a Hanson UArray of integers.
+ *     this implementation, each segment holds a flat array of words
+ *     obtained from the backing class, which decides whether the words
+ *     live on the heap or in huge pages. The segments belong to the
+ *     calling thread, which is the thread running the UM they are for.
+ *
+ *     get_word and set_word look segments up through a small inline
+ *     cache of recently used indices, so a loop over one segment skips
+ *     the table of segments; freeing or replacing a segment drops it
+ *     from the cache.
+ *
+ *     With segment_use_handles, new_segment names segments by handles
+ *     rather than indices: the top bit set, an 11-bit tag that changes
+ *     each time an index is reused, and the index in the low 20 bits.
+ *     A handle leads straight to a flat table holding the segment's
+ *     words and length, and the tag catches a handle that outlived its
+ *     segment (until the tag wraps). The UM only promises that a new ID
+ *     is not 0 and not in use, so a program that treats IDs as opaque
+ *     runs the same either way. One that computes its IDs still runs:
+ *     a handle's index used as a plain ID goes through the table of
+ *     segments, and freeing the segment by either ID makes its handle
+ *     stale. Only a handle whose tag is stale stops the program, with
+ *     a message. Indices past the 20-bit field are returned plain, as
+ *     they are without handles.
+ *
+ *     With segment_use_arena, each UM carves its segments' headers and
+ *     the words of segments smaller than ARENA_MAX_BYTES from an arena
+ *     of its own (see arena.h), reusing unmapped ones by size class, and
+ *     free_all_segments frees the arena in one go. Larger segments and
+ *     m0 still come from the backing class. This suits batches of many
+ *     short-lived UMs, whose segments are mostly small.
  *     
  **************************************************************/
 #ifndef SEGMENT_INCLUDED
 #define SEGMENT_INCLUDED
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
-#include <seq.h>
-#include <uarray.h>
-#include <bitpack.h>
 
+#include "bitpack.h"
 #include "instruction.h"
 
+/* Called by set_word before a word is overwritten, with the segment ID
+ * the program used */
+typedef void (*Segment_watcher)(uint32_t segment_id, uint32_t word_index,
+                                uint32_t old_word, uint32_t new_word);
+
 /* init_segment
- * Purpose: initializes our sequences of segments and available indicies,
-            and places m0 into our segments sequence
- * Parameters: A UArray_T
- * Returns: Nothing
+ * Purpose: initializes our table of segments and queue of available
+            indices, and maps a zeroed m0 of the given length
+ * Parameters: A uint32_t
+ * Returns: A pointer to the words of m0
  *
- * Expected input: A UArray_T of instructions read in from a file
- * Success output: none 
+ * Expected input: The number of instructions in the program
+ * Success output: A pointer the caller fills with the program's
+                   instructions before execution begins
  * Failure output: none
  */
-void init_segment(UArray_T m0);
+uint32_t *init_segment(uint32_t num_words);
+
+/* init_segment_reserved
+ * Purpose: initializes the segments like init_segment, but leaves the
+            pages of m0 inaccessible so that the caller can fill them in
+            when they are first touched
+ * Parameters: A uint32_t and a function pointer
+ * Returns: A pointer to the words of m0, or NULL
+ *
+ * Expected input: The number of instructions in the program, and a
+                   function to call with m0's words just before they are
+                   freed (when m0 is replaced or the segments are freed)
+ * Success output: A pointer to words from backing_reserve, which the
+                   caller must mprotect a page at a time before they are
+                   read or written
+ * Failure output: NULL, with nothing initialized, if the memory cannot
+                   be reserved
+ */
+uint32_t *init_segment_reserved(uint32_t num_words,
+                                void (*release)(uint32_t *words));
 
 /* new_segment
- * Purpose: maps a new segment by adding it to our sequence of segments
+ * Purpose: maps a new segment by adding it to our table of segments
  * Parameters: An integer
  * Returns: Nothing
  *
  * Expected input: An integer denoting the size of the segment to be
                     mapped
- * Success output: The index that the new segment was mapped to
+ * Success output: The index that the new segment was mapped to, or a
+                    handle for it if handles are in use
  * Failure output: none
  */
 uint32_t new_segment(int size);
 
 /* free_segment
- * Purpose: frees the UArray at the given index
+ * Purpose: frees the segment at the given index
  * Parameters: A uint32_t
  * Returns: Nothing
  *
@@ -61,8 +116,8 @@ uint32_t new_segment(int size);
 void free_segment(uint32_t segment_index);
 
 /* free_all_segments
- * Purpose: frees both the segments and available_indicies sequences and
-            everything in them
+ * Purpose: frees the table of segments and the queue of available
+            indices, and everything in them
  * Parameters: none
  * Returns: Nothing
  *
@@ -110,6 +165,34 @@ void set_word(uint32_t segment_index, uint32_t word_index,
  */
 void replace_segment_zero(uint32_t new_segment_index);
 
+/* save_segments
+ * Purpose: writes every segment, and the order in which freed indices
+            will be reused, to a file
+ * Parameters: a FILE pointer
+ * Returns: true if everything was written
+ *
+ * Expected input: an open file
+ * Success output: true; the file holds the number of segment slots and
+                   of free indices, then for each slot a word saying
+                   whether it is mapped, its length and its words, then
+                   the free indices, all as native uint32_ts
+ * Failure output: false
+ */
+bool save_segments(FILE *fp);
+
+/* restore_segments
+ * Purpose: replaces every segment with ones written by save_segments
+ * Parameters: a uint32_t pointer and a size_t
+ * Returns: a pointer to the words of the new m0, or NULL
+ *
+ * Expected input: the saved words and their number; the segments may
+                   or may not have been initialized
+ * Success output: the new m0's words; the old segments are freed
+ * Failure output: NULL, leaving the segments as they were, if the
+                   words are not well formed
+ */
+uint32_t *restore_segments(const uint32_t *data, size_t num_words);
+
 /* seg_zero_length
  * Purpose: returns the length of the 0th memory segment
  * Parameters: none
@@ -121,4 +204,94 @@ void replace_segment_zero(uint32_t new_segment_index);
  */
 int seg_zero_length();
 
-#endif
\ No newline at end of file
+/* segment_words
+ * Purpose: gives direct access to the words of a segment
+ * Parameters: a uint32_t and a uint32_t pointer
+ * Returns: a pointer to the segment's words
+ *
+ * Expected input: the index of a mapped segment, and where to store its
+                   length
+ * Success output: the words, valid until the segment is freed or (for
+                   m0) replaced
+ * Failure output: exits the program if the index is out of bounds or
+                   the segment is not mapped
+ */
+uint32_t *segment_words(uint32_t segment_index, uint32_t *length);
+
+/* segment_zero_peek
+ * Purpose: reads a word of m[0] from a signal handler
+ * Parameters: a uint32_t and a uint32_t pointer
+ * Returns: true if the word was read
+ *
+ * Expected input: an index in m[0], and where to store the word; safe
+                   to call from a signal handler on the UM's thread,
+                   whatever the UM was doing when it was interrupted
+ * Success output: true, with the word stored
+ * Failure output: false if there is no m[0] or the index is past its end
+ */
+bool segment_zero_peek(uint32_t word_index, uint32_t *word);
+
+/* segment_peek
+ * Purpose: reads a word of any segment without stopping the program
+ * Parameters: 2 uint32_ts and a uint32_t pointer
+ * Returns: true if the word was read
+ *
+ * Expected input: any segment ID and word index, and where to store the
+                   word
+ * Success output: true, with the word stored
+ * Failure output: false if the segment is not mapped or the index is
+                   out of bounds
+ */
+bool segment_peek(uint32_t segment_id, uint32_t word_index, uint32_t *word);
+
+/* segment_watch
+ * Purpose: sets a function to be told of every store by set_word on the
+            calling thread
+ * Parameters: a Segment_watcher
+ * Returns: Nothing
+ *
+ * Expected input: the watcher, or NULL for none
+ * Success output: none (each store is reported before it is made)
+ * Failure output: none
+ */
+void segment_watch(Segment_watcher watch);
+
+/* segment_cache_stats
+ * Purpose: reports how often the inline segment cache has been hit
+ * Parameters: two uint64_t pointers
+ * Returns: Nothing
+ *
+ * Expected input: where to store the counts
+ * Success output: none (the calling thread's hits and misses, counted
+                   over every get_word and set_word it has made)
+ * Failure output: none
+ */
+void segment_cache_stats(uint64_t *hits, uint64_t *misses);
+
+/* segment_use_handles
+ * Purpose: chooses whether new segments are named by tagged handles
+            instead of indices
+ * Parameters: a bool
+ * Returns: Nothing
+ *
+ * Expected input: true for handles; called before any UM initializes
+                   its segments
+ * Success output: none (from now on, new_segment returns handles)
+ * Failure output: none
+ */
+void segment_use_handles(bool enabled);
+
+/* segment_use_arena
+ * Purpose: chooses whether each UM allocates its segments from an arena
+ * Parameters: a bool
+ * Returns: Nothing
+ *
+ * Expected input: true for arenas; called before any UM initializes
+                   its segments
+ * Success output: none (from now on, each UM that initializes its
+                   segments gets an arena, freed with its segments)
+ * Failure output: none
+ */
+void segment_use_arena(bool enabled);
+
+#endif
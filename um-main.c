@@ -12,98 +12,746 @@
  *     and segment.h modules where necessary.
  *     
  *     Note
- *     A UM file must be supplied.
+ *     A UM file must be supplied, either a raw .um file or a compressed
+ *     image made by umz (see image.h), whose chunks are expanded as the
+ *     program first touches them. It may be preceded by options:
+ *         --pipeline            run every UM file given, each on a
+ *                               thread of its own, with the output of
+ *                               each feeding the input of the next
+ *         --pipeline-link=KIND  join pipeline stages with a queue
+ *                               (default), a pipe or a socketpair; with
+ *                               pipe, the last stage's output is
+ *                               spliced to stdout (not with --output
+ *                               or --async-io)
+ *         --fan-out             the UM file is followed by input files;
+ *                               run the program up to its first IN,
+ *                               then clone it once per input file,
+ *                               writing each clone's output to the
+ *                               input file's name plus ".out"
+ *         --memo=DIR            keep a snapshot of the program as it
+ *                               first executes IN (if it has not
+ *                               executed OUT) in DIR, and start later
+ *                               runs of the same image from it
+ *         --jobs=N              run at most N clones at once (default:
+ *                               the number of online CPUs)
+ *         --hugepages=MODE      place m0 and large segments in huge
+ *                               pages; MODE is thp, hugetlb or off
+ *         --huge-threshold=N    segments of N or more words are large
+ *         --first-touch         fault huge mappings in on the thread
+ *                               that allocates them (NUMA locality)
+ *         --reclaim             unmap freed segments on a background
+ *                               thread instead of in UNMAP and LOADP
+ *         --handles             MAP returns tagged handles that lead
+ *                               straight to a segment's words, for
+ *                               programs that never compute segment
+ *                               IDs (not with --memo)
+ *         --arena               allocate small segments from an arena
+ *                               per UM, freed in one go when it exits
+ *         --engine=NAME         switch (default) unpacks each word as
+ *                               it runs; predecode runs from the
+ *                               decoded stream kept by decode.h;
+ *                               tail gives each opcode a handler that
+ *                               jumps straight to the next one's;
+ *                               special runs the decoded stream through
+ *                               handlers generated for each register
+ *                               triple of the hot opcodes
+ *         --branchless-cmov     with --engine=special, CMOV selects
+ *                               its result with a mask, not a branch
+ *         --code-map=FILE       a map written by umdis; only the words
+ *                               it marks as code are pre-decoded
+ *         --input=FILE          read input from FILE (memory mapped)
+ *                               instead of stdin
+ *         --output=FILE         write output straight into a memory
+ *                               mapping of FILE instead of stdout
+ *         --record=FILE         log every input byte the program reads
+ *         --replay=FILE         read input from a log made by --record
+ *         --async-io            do console I/O on background threads
+ *         --perf-counters       report hardware performance counters
+ *                               for the run, and the hit rate of the
+ *                               segment cache, on stderr
+ *         --dump-state=FILE     when the program halts, write its
+ *                               registers and segments to FILE
+ *         --metrics=PATH        serve live counters for the run (see
+ *                               metrics.h) on a Unix domain socket at
+ *                               PATH, removed when the program exits
+ *         --profile[=HZ]        sample the program counter HZ times a
+ *                               second of CPU time (default 1000) and
+ *                               report the hottest words of m[0] on
+ *                               stderr when the program halts
+ *         --debug[=FILE]        run under the debugger (see debug.h),
+ *                               reading commands from FILE or the
+ *                               terminal; uses the predecode engine
+ *                               unless special is chosen
  *     
  **************************************************************/
 #include "bitpack.h"
+#include <ctype.h>
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
 #include <sys/types.h>
-#include <sys/stat.h>
 #include <unistd.h>
 
 #include "segment.h"
 #include "instruction.h"
+#include "backing.h"
+#include "decode.h"
+#include "console.h"
+#include "perfcount.h"
+#include "clone.h"
+#include "memo.h"
+#include "loader.h"
+#include "metrics.h"
+#include "profile.h"
+#include "debug.h"
 
-UArray_T read_words(FILE *fp, int num_words);
-void print_words(UArray_T segment_zero);
-void execute_program();
+/* Most bytes in flight between two stages of a pipeline */
+#define PIPELINE_QUEUE_SIZE (1 << 16)
+
+typedef enum Um_engine {
+        ENGINE_SWITCH = 0, ENGINE_PREDECODE, ENGINE_TAIL, ENGINE_SPECIAL,
+        ENGINE_SPECIAL_BRANCHLESS
+} Um_engine;
+
+/* How the stages of a pipeline are joined */
+typedef enum Pipeline_link {
+        LINK_QUEUE = 0, LINK_PIPE, LINK_SOCKET
+} Pipeline_link;
+
+typedef struct Stage {
+        const char *path;
+        Um_engine engine;
+        Device input;           /* from the previous stage, or NULL */
+        Device output;          /* to the next stage, or NULL */
+        pthread_t thread;
+} Stage;
+
+static void start_stream(Um_engine engine, uint32_t *segment_zero,
+                         int num_words, const uint8_t *code_map);
+uint64_t execute_program(Um_engine engine, int prog_counter,
+                         bool publish);
+void run_pipeline(int num_stages, char *paths[], Um_engine engine,
+                  Pipeline_link link);
+void usage_error();
+static bool parse_unsigned(const char *text, size_t *value);
+
+static struct option long_options[] = {
+    { "hugepages",      required_argument, NULL, 'H' },
+    { "huge-threshold", required_argument, NULL, 'T' },
+    { "first-touch",    no_argument,       NULL, 'F' },
+    { "engine",         required_argument, NULL, 'E' },
+    { "branchless-cmov", no_argument,      NULL, 'B' },
+    { "code-map",       required_argument, NULL, 'C' },
+    { "record",         required_argument, NULL, 'R' },
+    { "replay",         required_argument, NULL, 'P' },
+    { "input",          required_argument, NULL, 'i' },
+    { "output",         required_argument, NULL, 'o' },
+    { "perf-counters",  no_argument,       NULL, 'p' },
+    { "async-io",       no_argument,       NULL, 'A' },
+    { "pipeline",       no_argument,       NULL, 'L' },
+    { "pipeline-link",  required_argument, NULL, 'K' },
+    { "fan-out",        no_argument,       NULL, 'f' },
+    { "jobs",           required_argument, NULL, 'j' },
+    { "memo",           required_argument, NULL, 'M' },
+    { "reclaim",        no_argument,       NULL, 'U' },
+    { "handles",        no_argument,       NULL, 'N' },
+    { "arena",          no_argument,       NULL, 'W' },
+    { "dump-state",     required_argument, NULL, 'D' },
+    { "metrics",        required_argument, NULL, 'S' },
+    { "profile",        optional_argument, NULL, 'Q' },
+    { "debug",          optional_argument, NULL, 'G' },
+    { NULL, 0, NULL, 0 }
+};
 
 int main(int argc, char *argv[])
 {
-    if (argc != 2) {
-        printf("Incorrect usage!\n");
+    Backing_mode backing_mode = BACKING_HEAP;
+    size_t huge_threshold = BACKING_DEFAULT_THRESHOLD;
+    bool first_touch = false;
+    Um_engine engine = ENGINE_SWITCH;
+    const char *code_map_path = NULL;
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    const char *input_path = NULL;
+    const char *output_path = NULL;
+    const char *memo_dir = NULL;
+    const char *state_path = NULL;
+    const char *metrics_path = NULL;
+    unsigned profile_hz = 0;
+    bool debugging = false;
+    const char *debug_path = NULL;
+    bool branchless_cmov = false;
+    bool handles = false;
+    bool arena = false;
+    bool perf_counters = false;
+    bool async_io = false;
+    bool pipeline = false;
+    const char *link_name = NULL;
+    Pipeline_link link = LINK_QUEUE;
+    bool fan_out = false;
+    bool reclaim = false;
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t number;      /* an option's numeric argument */
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "", long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'H':
+                if (strcmp(optarg, "thp") == 0) {
+                    backing_mode = BACKING_THP;
+                } else if (strcmp(optarg, "hugetlb") == 0) {
+                    backing_mode = BACKING_HUGETLB;
+                } else if (strcmp(optarg, "off") == 0) {
+                    backing_mode = BACKING_HEAP;
+                } else {
+                    usage_error();
+                }
+                break;
+            case 'T':
+                if (!parse_unsigned(optarg, &huge_threshold)) {
+                    usage_error();
+                }
+                break;
+            case 'F':
+                first_touch = true;
+                break;
+            case 'E':
+                if (strcmp(optarg, "switch") == 0) {
+                    engine = ENGINE_SWITCH;
+                } else if (strcmp(optarg, "predecode") == 0) {
+                    engine = ENGINE_PREDECODE;
+                } else if (strcmp(optarg, "tail") == 0) {
+                    engine = ENGINE_TAIL;
+                } else if (strcmp(optarg, "special") == 0) {
+                    engine = ENGINE_SPECIAL;
+                } else {
+                    usage_error();
+                }
+                break;
+            case 'B':
+                branchless_cmov = true;
+                break;
+            case 'C':
+                code_map_path = optarg;
+                break;
+            case 'R':
+                record_path = optarg;
+                break;
+            case 'P':
+                replay_path = optarg;
+                break;
+            case 'i':
+                input_path = optarg;
+                break;
+            case 'o':
+                output_path = optarg;
+                break;
+            case 'p':
+                perf_counters = true;
+                break;
+            case 'A':
+                async_io = true;
+                break;
+            case 'L':
+                pipeline = true;
+                break;
+            case 'K':
+                link_name = optarg;
+                if (strcmp(optarg, "queue") == 0) {
+                    link = LINK_QUEUE;
+                } else if (strcmp(optarg, "pipe") == 0) {
+                    link = LINK_PIPE;
+                } else if (strcmp(optarg, "socket") == 0) {
+                    link = LINK_SOCKET;
+                } else {
+                    usage_error();
+                }
+                break;
+            case 'f':
+                fan_out = true;
+                break;
+            case 'j':
+                if (!parse_unsigned(optarg, &number) || number == 0
+                    || number > INT_MAX) {
+                    usage_error();
+                }
+                jobs = number;
+                break;
+            case 'M':
+                memo_dir = optarg;
+                break;
+            case 'U':
+                reclaim = true;
+                break;
+            case 'N':
+                handles = true;
+                break;
+            case 'W':
+                arena = true;
+                break;
+            case 'D':
+                state_path = optarg;
+                break;
+            case 'S':
+                metrics_path = optarg;
+                break;
+            case 'Q':
+                number = PROFILE_DEFAULT_HZ;
+                if ((optarg != NULL && !parse_unsigned(optarg, &number))
+                    || number == 0 || number > PROFILE_MAX_HZ) {
+                    usage_error();
+                }
+                profile_hz = number;
+                break;
+            case 'G':
+                debugging = true;
+                debug_path = optarg;
+                break;
+            default:
+                usage_error();
+        }
+    }
+
+    int num_files = argc - optind;
+
+    if ((pipeline ? num_files < 1 : fan_out ? num_files < 2
+                                            : num_files != 1)
+        || (pipeline && (code_map_path != NULL || perf_counters
+                         || memo_dir != NULL || state_path != NULL
+                         || metrics_path != NULL || profile_hz != 0
+                         || debugging))
+        || (link_name != NULL && !pipeline)
+        || (link == LINK_PIPE && (output_path != NULL || async_io))
+        || (fan_out && (pipeline || async_io || perf_counters
+                        || state_path != NULL || metrics_path != NULL
+                        || profile_hz != 0 || debugging
+                        || record_path != NULL || replay_path != NULL
+                        || input_path != NULL || output_path != NULL))
+        || (branchless_cmov && engine != ENGINE_SPECIAL)
+        || (debugging && engine == ENGINE_TAIL)
+        || (handles && memo_dir != NULL)
+        || (record_path != NULL && replay_path != NULL)
+        || (input_path != NULL && replay_path != NULL)) {
+        usage_error();
+    }
+
+    if (branchless_cmov) {
+        engine = ENGINE_SPECIAL_BRANCHLESS;
+    }
+    if (debugging && engine == ENGINE_SWITCH) {
+        engine = ENGINE_PREDECODE;
+    }
+
+    backing_configure(backing_mode, huge_threshold, first_touch);
+    segment_use_handles(handles);
+    segment_use_arena(arena);
+    if (reclaim && !backing_reclaim_start()) {
         exit(EXIT_FAILURE);
     }
 
-    struct stat buf;
-    
-    FILE *fp = fopen(argv[1], "r");
-    assert(fp != NULL);
+    if (input_path != NULL || output_path != NULL) {
+        Device input = NULL;
+        Device output = NULL;
 
-    stat(argv[1], &buf);
-    int num_words = buf.st_size / 4;
+        if ((input_path != NULL
+             && (input = device_input_file(input_path)) == NULL)
+            || (output_path != NULL
+                && (output = device_output_file(output_path)) == NULL)) {
+            exit(EXIT_FAILURE);
+        }
 
-    UArray_T segment_zero = read_words(fp, num_words);
+        console_bind(input, output);
+    }
 
-    init_segment(segment_zero);
+    if ((record_path != NULL && !console_record(record_path))
+        || (replay_path != NULL && !console_replay(replay_path))) {
+        exit(EXIT_FAILURE);
+    }
 
-    execute_program(num_words);
+    if (async_io) {
+        console_async();
+    }
 
-    free_all_segments();
+    if (fan_out) {
+        clone_fan_out(num_files - 1, argv + optind + 1, jobs);
+    }
+
+    if (pipeline) {
+        run_pipeline(num_files, argv + optind, engine, link);
+        console_close();
+        return 0;
+    }
+
+    int num_words;
+    int prog_counter = 0;
+    uint32_t *segment_zero = load_program(argv[optind], &num_words);
+
+    if (memo_dir != NULL) {
+        memo_start(memo_dir, &segment_zero, &num_words, &prog_counter);
+    }
+
+    uint8_t *code_map = NULL;
 
-    fclose(fp);
+    if (code_map_path != NULL && engine != ENGINE_SWITCH
+        && engine != ENGINE_TAIL) {
+        code_map = codemap_read(code_map_path, segment_zero, num_words);
+    }
+
+    if (debugging && !debug_start(debug_path, prog_counter)) {
+        exit(EXIT_FAILURE);
+    }
+
+    start_stream(engine, segment_zero, num_words, code_map);
+    free(code_map);
+
+    if (metrics_path != NULL && !metrics_serve(metrics_path)) {
+        exit(EXIT_FAILURE);
+    }
+
+    bool counting = perf_counters && perfcount_start();
+    bool profiling = profile_hz != 0 && profile_start(profile_hz);
+
+    uint64_t instructions = execute_program(engine, prog_counter,
+                                            metrics_path != NULL
+                                            || profiling || debugging);
+
+    if (profiling) {
+        profile_report(stderr);
+    }
+
+    if (counting) {
+        perfcount_report(stderr, instructions);
+    }
+    if (perf_counters) {
+        uint64_t hits, misses;
+
+        segment_cache_stats(&hits, &misses);
+        fprintf(stderr, "um: segment cache: %" PRIu64 " hits, %" PRIu64
+                " misses (%.2f%% hit rate)\n", hits, misses,
+                hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
+    }
+
+    if (fan_out && !clone_finish()) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (state_path != NULL && !memo_dump(state_path)) {
+        exit(EXIT_FAILURE);
+    }
+
+    decode_free();
+    free_all_segments();
+    console_close();
     
     return 0;
 }
 
-/* read_words
- * Purpose: Reads the instructions from a file into what will become
-            segment 0
- * Parameters: a file pointer and an integer
- * Returns: A UArray
+/* usage_error
+ * Purpose: reports a malformed command line and exits
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none
+ * Success output: none
+ * Failure output: always exits the program with EXIT_FAILURE
+ */
+void usage_error()
+{
+    printf("Incorrect usage!\n");
+    exit(EXIT_FAILURE);
+}
+
+/* parse_unsigned
+ * Purpose: reads an option's value as a decimal number
+ * Parameters: a string and a size_t pointer
+ * Returns: true if the whole string is a number
  *
- * Expected input: A file pointer pointing to a file that is filled with
-                    valid um instructions, and the number of uint32_t words
-                    in that fiile
- * Success output: A UArray_T that contains all of the instructions in the
-                    supplied file in the proper order
- * Failure output: none
+ * Expected input: the option's argument, and where to store the number
+ * Success output: true, with the number stored
+ * Failure output: false, with nothing stored, if the string is empty,
+                   has anything but digits in it, or does not fit
  */
-UArray_T read_words(FILE *fp, int num_words)
+static bool parse_unsigned(const char *text, size_t *value)
 {
-    UArray_T segment_zero = UArray_new(num_words, sizeof(uint32_t));
+    char *end;
 
-    for (int i = 0; i < num_words; i++) {
-        uint32_t curr_word = 0;
+    if (!isdigit((unsigned char)text[0])) {
+        return false;
+    }
 
-        for (int j = 24; j >= 0; j -= 8) {
-            uint32_t c = fgetc(fp);
-            curr_word = Bitpack_newu(curr_word, 8, j, c);
-        }
+    errno = 0;
+    unsigned long long number = strtoull(text, &end, 10);
 
-        *(uint32_t *)UArray_at(segment_zero, i) = curr_word;
+    if (errno != 0 || *end != '\0' || number > SIZE_MAX) {
+        return false;
     }
 
-    return segment_zero;
+    *value = number;
+    return true;
 }
 
-/* execute_program
- * Purpose: loops through all of the words in m[0] and calls opcode_reader
-            on them, updating the program pointer as needed
- * Parameters: none
+/* start_stream
+ * Purpose: builds the decoded stream for the engines that run from one
+ * Parameters: a Um_engine, a uint32_t pointer, an int, and a uint8_t
+               pointer
  * Returns: Nothing
  *
- * Expected input: none
+ * Expected input: the engine, the words of m[0] and their number, and a
+                   code map or NULL
+ * Success output: none (for predecode and special, the calling thread
+                   has a stream, with handlers bound for special)
+ * Failure output: exits the program if memory runs out
+ */
+static void start_stream(Um_engine engine, uint32_t *segment_zero,
+                         int num_words, const uint8_t *code_map)
+{
+    if (engine == ENGINE_SWITCH || engine == ENGINE_TAIL) {
+        return;
+    }
+
+    if (engine == ENGINE_SPECIAL) {
+        decode_bind(select_handler);
+    } else if (engine == ENGINE_SPECIAL_BRANCHLESS) {
+        decode_bind(select_handler_branchless);
+    }
+    decode_load(segment_zero, num_words, code_map);
+}
+
+/* run_engine
+ * Purpose: the loops of execute_program, for one setting of publish
+ * Parameters: a Um_engine, an int and a bool
+ * Returns: the number of instructions executed
+ *
+ * Expected input: as execute_program; publish is a constant at each
+                   call, so each call gets a copy of the loops with the
+                   publishing compiled in or out
  * Success output: none
  * Failure output: none
  */
-void execute_program()
+static inline __attribute__((always_inline))
+uint64_t run_engine(Um_engine engine, int prog_counter, const bool publish)
 {
     bool continue_execution = true;
-    int prog_counter = 0;
+    uint64_t instructions = 0;
+
+    if (engine == ENGINE_PREDECODE) {
+        while (continue_execution == true) {
+            const Um_decoded *inst = decode_fetch(prog_counter);
+            if (publish) {
+                METRICS_SET(prog_counter, prog_counter);
+                METRICS_SET(instructions, instructions + 1);
+            }
+            prog_counter++;
+            instructions++;
+            decoded_reader(inst, &continue_execution, &prog_counter);
+        }
+        return instructions;
+    }
+    if (engine == ENGINE_SPECIAL || engine == ENGINE_SPECIAL_BRANCHLESS) {
+        while (continue_execution == true) {
+            const Um_decoded *inst = decode_fetch(prog_counter);
+            if (publish) {
+                METRICS_SET(prog_counter, prog_counter);
+                METRICS_SET(instructions, instructions + 1);
+            }
+            prog_counter++;
+            instructions++;
+            inst->handler(inst, &continue_execution, &prog_counter);
+        }
+        return instructions;
+    }
+    if (engine == ENGINE_TAIL) {
+        return tail_execute(prog_counter, publish);
+    }
 
     while (continue_execution == true) {
         Um_instruction word = get_word(0, prog_counter);
+        if (publish) {
+            METRICS_SET(prog_counter, prog_counter);
+            METRICS_SET(instructions, instructions + 1);
+        }
         prog_counter++;
+        instructions++;
         opcode_reader(word, &continue_execution, &prog_counter);
     }
+
+    return instructions;
+}
+
+/* execute_program
+ * Purpose: loops through all of the words in m[0] and calls opcode_reader
+            (or decoded_reader, or their bound handlers) on them,
+            updating the program pointer as needed, or hands m[0] to
+            tail_execute
+ * Parameters: a Um_engine, an int and a bool
+ * Returns: the number of instructions executed
+ *
+ * Expected input: the engine to run with, the index in m[0] to start at
+                   (0 unless the program is resumed from a snapshot), and
+                   whether to publish the program counter and
+                   instruction count in um_metrics before each
+                   instruction, which --metrics, --profile and --debug
+                   read; the predecode and special engines need
+                   start_stream to have been called
+ * Success output: none
+ * Failure output: none
+ */
+uint64_t execute_program(Um_engine engine, int prog_counter, bool publish)
+{
+    /* Publishing costs two stores an instruction, so a run nobody is
+     * watching gets loops without them */
+    if (publish) {
+        return run_engine(engine, prog_counter, true);
+    }
+    return run_engine(engine, prog_counter, false);
+}
+
+/* run_stage
+ * Purpose: runs one UM of a pipeline on the calling thread
+ * Parameters: a pointer to the Stage
+ * Returns: NULL
+ *
+ * Expected input: a Stage whose devices (if any) are ends of the links
+                   to its neighbours
+ * Success output: none (the UM has halted and its devices are freed, so
+                   the next stage reads EOF once it has read everything)
+ * Failure output: exits the program if the UM fails
+ */
+static void *run_stage(void *cl)
+{
+    Stage *stage = cl;
+    int num_words;
+
+    bind_devices(stage->input, stage->output);
+
+    uint32_t *segment_zero = load_program(stage->path, &num_words);
+
+    start_stream(stage->engine, segment_zero, num_words, NULL);
+
+    execute_program(stage->engine, 0, false);
+
+    decode_free();
+    free_all_segments();
+
+    bind_devices(NULL, NULL);
+    if (stage->output != NULL) {
+        device_free(&stage->output);
+    }
+    if (stage->input != NULL) {
+        device_free(&stage->input);
+    }
+
+    return NULL;
+}
+
+/* join_stages
+ * Purpose: makes the devices that join one stage of a pipeline to the
+            next
+ * Parameters: two Device pointers and a Pipeline_link
+ * Returns: Nothing
+ *
+ * Expected input: where to store the writing stage's output and the
+                   reading stage's input, and the kind of link
+ * Success output: none (what is written to the output is read from the
+                   input, which reads EOF once the output is freed)
+ * Failure output: exits the program if a pipe or socketpair cannot be
+                   created
+ */
+static void join_stages(Device *output, Device *input, Pipeline_link link)
+{
+    Device ends[2];
+    bool joined = true;
+
+    switch (link) {
+        case LINK_QUEUE:
+            joined = device_queue(PIPELINE_QUEUE_SIZE, input, output);
+            break;
+        case LINK_PIPE:
+            joined = device_pipe(input, output);
+            break;
+        case LINK_SOCKET:
+            joined = device_socketpair(ends);
+            *output = ends[0];
+            *input = ends[1];
+            break;
+    }
+
+    if (!joined) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+/* run_pipeline
+ * Purpose: runs several UMs at once, each reading what the one before
+            it writes
+ * Parameters: an int, an array of strings, a Um_engine and a
+               Pipeline_link
+ * Returns: Nothing
+ *
+ * Expected input: the number of UM files, their paths in pipeline
+                   order, the engine to run them with, and how to join
+                   neighbouring stages
+ * Success output: none (the first UM reads from the console, the last
+                   writes to it, and each pair of neighbours is joined by
+                   a bounded queue, pipe or socketpair that makes the
+                   writer wait while it is full; with pipes, the last UM
+                   writes into one more pipe, which the calling thread
+                   splices to stdout; this returns once every UM has
+                   halted)
+ * Failure output: exits the program if any UM fails or a thread, pipe
+                   or socketpair cannot be started
+ */
+void run_pipeline(int num_stages, char *paths[], Um_engine engine,
+                  Pipeline_link link)
+{
+    Stage *stages = calloc(num_stages, sizeof(*stages));
+    assert(stages != NULL);
+    Device spliced = NULL;
+
+    for (int i = 0; i < num_stages; i++) {
+        stages[i].path = paths[i];
+        stages[i].engine = engine;
+    }
+
+    for (int i = 0; i + 1 < num_stages; i++) {
+        join_stages(&stages[i].output, &stages[i + 1].input, link);
+    }
+
+    /* A stage that halts before reading all its input closes its end
+     * of the link, and the stage writing to it must carry on, dropping
+     * output, as it would with a queue */
+    if (link != LINK_QUEUE) {
+        signal(SIGPIPE, SIG_IGN);
+    }
+    if (link == LINK_PIPE) {
+        join_stages(&stages[num_stages - 1].output, &spliced, link);
+    }
+
+    for (int i = 0; i < num_stages; i++) {
+        if (pthread_create(&stages[i].thread, NULL, run_stage,
+                           &stages[i]) != 0) {
+            fprintf(stderr, "um: cannot start pipeline stage %s\n",
+                    paths[i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Until stdout stops taking it; freeing the read end then makes the
+     * last stage's output be dropped rather than fill the pipe */
+    if (spliced != NULL) {
+        while (device_splice(spliced, STDOUT_FILENO,
+                             PIPELINE_QUEUE_SIZE) > 0) {
+        }
+        device_free(&spliced);
+    }
+
+    for (int i = 0; i < num_stages; i++) {
+        pthread_join(stages[i].thread, NULL);
+    }
+
+    free(stages);
 }
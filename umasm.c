@@ -0,0 +1,1252 @@
+/**************************************************************
+ *
+ *                         umasm.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     An assembler for UM programs. It reads the same syntax umdis
+ *     prints, so a listing can be edited and reassembled, and adds
+ *     labels, pseudo-instructions and a peephole optimiser.
+ *
+ *     Usage: umasm [-O0] [-o output.um] source.s
+ *         -O0   turn off the peephole optimiser
+ *
+ *     Syntax, one statement per line, `;` or `#` starts a comment:
+ *         label:                      defines a label
+ *         cmov/sload/sstore/add/mul/div/nand rA, rB, rC
+ *         halt
+ *         map rB, rC        unmap rC        out rC        in rC
+ *         loadp rB, rC      lv rA, value
+ *         .word value       a data word (number or label)
+ *         .space n          n zero words
+ *     Numbers are decimal, 0x hex, or 'c' characters. A leading
+ *     8-digit hex address followed by `:` (as umdis prints) is ignored.
+ *
+ *     Pseudo-instructions, which assume the register conventions below:
+ *         li rA, value      loads any 32-bit value with the cheapest of
+ *                           LV, LV+NAND, LV+ADDs, or LV/MUL/ADD via r6
+ *         jmp L             jump to L
+ *         jz rC, L          jump to L if rC is 0
+ *         jnz rC, L         jump to L if rC is not 0
+ *         call L            jump to L with the return address in r7
+ *         ret               jump to the address in r7
+ *         push rX / pop rX  push or pop the stack
+ *         enter n           push r7 and reserve n locals
+ *         leave n           drop the locals and pop r7
+ *         ldl rX, k / stl k, rX   load or store local k
+ *
+ *     Register conventions for pseudo-instructions
+ *     r0 holds 0 and must never be written (UM registers start at 0).
+ *     r5 is the stack pointer, an index into m[0]; point it at a
+ *     `.space` block before the first push. The stack grows upward.
+ *     r6 is scratch and r7 is the link register; both are clobbered by
+ *     jumps and calls. Programs are free to use r1-r4.
+ *
+ *     The optimiser deletes instructions that reload a value a register
+ *     already holds, moves that cannot change anything, writes that are
+ *     overwritten before being read, and jumps to the next instruction.
+ *     It only reasons within straight-line code between labels, so it
+ *     assumes control enters code only at a label: the target of a
+ *     computed jump (a LOADP to an address that was not loaded from a
+ *     label, say a number or an offset from one) must be labelled, or
+ *     the program assembled with -O0, since code after an unlabelled
+ *     target may have lost instructions that only looked redundant.
+ *
+ **************************************************************/
+#include <ctype.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "instruction.h"
+
+#define MAX_LINE 1024
+#define SCRATCH r6
+#define LINK r7
+#define STACK_POINTER r5
+#define ZERO r0
+#define LV_LIMIT ((uint32_t)1 << 25)
+
+typedef enum Item_kind { I_INST = 0, I_WORD, I_SPACE, I_LABEL } Item_kind;
+
+typedef struct Item {
+        uint8_t kind;
+        uint8_t op;
+        uint8_t a, b, c;
+        bool dead;              /* removed by the optimiser */
+        bool jump;              /* part of a jmp the optimiser may drop */
+        uint32_t value;         /* LV value, .word value or .space size */
+        char *label;            /* label named by the item, or NULL */
+        int line;
+} Item;
+
+typedef struct Symbol {
+        char *name;
+        uint32_t address;
+} Symbol;
+
+static const char *mnemonics[] = {
+        "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+        "map", "unmap", "out", "in", "loadp", "lv"
+};
+
+static Item *items;
+static uint32_t num_items, items_capacity;
+static Symbol *symbols;
+static uint32_t num_symbols, symbols_capacity;
+static int line_number;
+static uint32_t internal_labels;
+
+static void parse_file(FILE *fp);
+static void optimise();
+static void write_image(FILE *fp);
+
+int main(int argc, char *argv[])
+{
+    const char *output_path = "a.um";
+    bool optimising = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "O:o:")) != -1) {
+        switch (opt) {
+            case 'O':
+                optimising = strcmp(optarg, "0") != 0;
+                break;
+            case 'o':
+                output_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: umasm [-O0] [-o output.um] "
+                                "source.s\n");
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind != 1) {
+        fprintf(stderr, "Usage: umasm [-O0] [-o output.um] source.s\n");
+        exit(EXIT_FAILURE);
+    }
+
+    FILE *in = strcmp(argv[optind], "-") == 0 ? stdin
+                                                : fopen(argv[optind], "r");
+    if (in == NULL) {
+        fprintf(stderr, "umasm: cannot read %s\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+    parse_file(in);
+    if (in != stdin) {
+        fclose(in);
+    }
+
+    if (optimising) {
+        optimise();
+    }
+
+    FILE *out = fopen(output_path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "umasm: cannot write %s\n", output_path);
+        exit(EXIT_FAILURE);
+    }
+    write_image(out);
+    fclose(out);
+
+    for (uint32_t i = 0; i < num_items; i++) {
+        free(items[i].label);
+    }
+    for (uint32_t i = 0; i < num_symbols; i++) {
+        free(symbols[i].name);
+    }
+    free(items);
+    free(symbols);
+
+    return 0;
+}
+
+/* error
+ * Purpose: reports an error in the source and exits
+ * Parameters: two strings
+ * Returns: does not return
+ *
+ * Expected input: a message, and a detail to add after it or NULL
+ * Success output: none
+ * Failure output: always exits with EXIT_FAILURE, the message on stderr
+                   with the current line number
+ */
+static void error(const char *message, const char *detail)
+{
+    fprintf(stderr, "umasm: line %d: %s%s%s\n", line_number, message,
+            detail != NULL ? ": " : "", detail != NULL ? detail : "");
+    exit(EXIT_FAILURE);
+}
+
+/* copy_string
+ * Purpose: returns a heap copy of a string
+ * Parameters: a string
+ * Returns: the copy
+ *
+ * Expected input: any string
+ * Success output: a copy the caller frees
+ * Failure output: exits the program if memory runs out
+ */
+static char *copy_string(const char *s)
+{
+    char *copy = malloc(strlen(s) + 1);
+    assert(copy != NULL);
+    strcpy(copy, s);
+    return copy;
+}
+
+/* append_item
+ * Purpose: adds an item to the program and returns a pointer to it
+ * Parameters: an Item_kind
+ * Returns: a pointer to the new Item
+ *
+ * Expected input: the kind of item
+ * Success output: a zeroed item of that kind, tagged with the current
+                   line; valid until the next item is appended
+ * Failure output: exits the program if memory runs out
+ */
+static Item *append_item(Item_kind kind)
+{
+    if (num_items == items_capacity) {
+        items_capacity = items_capacity == 0 ? 256 : 2 * items_capacity;
+        items = realloc(items, items_capacity * sizeof(Item));
+        assert(items != NULL);
+    }
+
+    Item *item = &items[num_items++];
+    memset(item, 0, sizeof(*item));
+    item->kind = kind;
+    item->line = line_number;
+    return item;
+}
+
+/* emit3
+ * Purpose: appends a three-register instruction
+ * Parameters: a Um_opcode and 3 ints
+ * Returns: Nothing
+ *
+ * Expected input: any opcode but LV, and its registers (0 where unused)
+ * Success output: none
+ * Failure output: none
+ */
+static void emit3(Um_opcode op, int a, int b, int c)
+{
+    Item *item = append_item(I_INST);
+    item->op = op;
+    item->a = a;
+    item->b = b;
+    item->c = c;
+}
+
+/* emit_lv
+ * Purpose: appends an LV of a number, or of a label's address
+ * Parameters: an int, a uint32_t and a string
+ * Returns: Nothing
+ *
+ * Expected input: the register, and the value or a label (NULL for none)
+ * Success output: none (a label is resolved when the image is written)
+ * Failure output: exits the program if memory runs out
+ */
+static void emit_lv(int a, uint32_t value, const char *label)
+{
+    Item *item = append_item(I_INST);
+    item->op = LV;
+    item->a = a;
+    item->value = value;
+    item->label = label != NULL ? copy_string(label) : NULL;
+}
+
+/* emit_label
+ * Purpose: appends a label definition
+ * Parameters: a string
+ * Returns: Nothing
+ *
+ * Expected input: the label's name
+ * Success output: none
+ * Failure output: exits the program if memory runs out
+ */
+static void emit_label(const char *name)
+{
+    Item *item = append_item(I_LABEL);
+    item->label = copy_string(name);
+}
+
+/* new_internal_label
+ * Purpose: makes a fresh label name for use inside a macro expansion
+ * Parameters: a char pointer and a size_t
+ * Returns: the buffer
+ *
+ * Expected input: a buffer and its size
+ * Success output: a name, starting with ".L", that no other
+                   expansion uses and no source label can clash with
+ * Failure output: none
+ */
+static char *new_internal_label(char *buffer, size_t size)
+{
+    snprintf(buffer, size, ".L%" PRIu32, internal_labels++);
+    return buffer;
+}
+
+/* load_constant
+ * Purpose: emits the shortest sequence this assembler knows that puts
+            value in register a, using SCRATCH if it needs a second
+            register
+ * Parameters: an int and a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the register and the value
+ * Success output: none
+ * Failure output: reports an error if a is SCRATCH and the value needs a
+                   second register
+ */
+static void load_constant(int a, uint32_t value)
+{
+    /* Candidates, cheapest first: LV; LV+NAND; LV+k ADDs (shift left
+     * by k, k <= 3 beats the general case); LV/LV/MUL(/LV/ADD) */
+    if (value < LV_LIMIT) {
+        emit_lv(a, value, NULL);
+        return;
+    }
+    if (~value < LV_LIMIT) {
+        emit_lv(a, ~value, NULL);
+        emit3(NAND, a, a, a);
+        return;
+    }
+    for (int k = 1; k <= 3; k++) {
+        uint32_t mask = ((uint32_t)1 << k) - 1;
+        if ((value & mask) == 0 && (value >> k) < LV_LIMIT) {
+            emit_lv(a, value >> k, NULL);
+            for (int i = 0; i < k; i++) {
+                emit3(ADD, a, a, a);
+            }
+            return;
+        }
+    }
+
+    if (a == SCRATCH) {
+        error("li needs a register other than the scratch register", NULL);
+    }
+
+    /* value = high * 2^k + low; prefer the k that makes low 0 */
+    int best_k = 7;
+    for (int k = 7; k <= 24; k++) {
+        uint32_t mask = ((uint32_t)1 << k) - 1;
+        if ((value & mask) == 0) {
+            best_k = k;
+        }
+    }
+    uint32_t low = value & (((uint32_t)1 << best_k) - 1);
+
+    emit_lv(a, value >> best_k, NULL);
+    emit_lv(SCRATCH, (uint32_t)1 << best_k, NULL);
+    emit3(MUL, a, a, SCRATCH);
+    if (low != 0) {
+        emit_lv(SCRATCH, low, NULL);
+        emit3(ADD, a, a, SCRATCH);
+    }
+}
+
+/* add_constant
+ * Purpose: emits code that adds a (possibly negative) constant to a
+            register, using SCRATCH
+ * Parameters: an int and an int32_t
+ * Returns: Nothing
+ *
+ * Expected input: a register other than SCRATCH, and the constant
+ * Success output: none (nothing is emitted for 0)
+ * Failure output: none
+ */
+static void add_constant(int a, int32_t delta)
+{
+    uint32_t value = (uint32_t)delta;
+
+    if (value < LV_LIMIT || ~value < LV_LIMIT) {
+        if (delta != 0) {
+            load_constant(SCRATCH, value);
+            emit3(ADD, a, a, SCRATCH);
+        }
+        return;
+    }
+
+    /* load_constant would need a register besides SCRATCH, so add the
+     * high bits (loaded, then doubled into place) and the low k bits
+     * one after the other */
+    int k = 0;
+    while ((value >> k) >= LV_LIMIT) {
+        k++;
+    }
+    uint32_t low = value & (((uint32_t)1 << k) - 1);
+
+    emit_lv(SCRATCH, value >> k, NULL);
+    for (int i = 0; i < k; i++) {
+        emit3(ADD, SCRATCH, SCRATCH, SCRATCH);
+    }
+    emit3(ADD, a, a, SCRATCH);
+    if (low != 0) {
+        emit_lv(SCRATCH, low, NULL);
+        emit3(ADD, a, a, SCRATCH);
+    }
+}
+
+/* Tokenising ***************************************************/
+
+/* skip_space
+ * Purpose: returns s advanced past any white space
+ * Parameters: a string
+ * Returns: the rest of the string
+ *
+ * Expected input: any string
+ * Success output: a pointer to its first character that is not white
+                   space (the terminating NUL if there is none)
+ * Failure output: none
+ */
+static char *skip_space(char *s)
+{
+    while (isspace((unsigned char)*s)) {
+        s++;
+    }
+    return s;
+}
+
+/* next_operand
+ * Purpose: splits the next comma-separated operand off *rest
+ * Parameters: a pointer to a string
+ * Returns: the operand, or NULL if there are none left
+ *
+ * Expected input: the rest of a statement, which is modified in place
+ * Success output: the operand without surrounding white space; *rest is
+                   moved past it and its comma
+ * Failure output: reports an error for an unterminated character literal
+ */
+static char *next_operand(char **rest)
+{
+    char *s = skip_space(*rest);
+    if (*s == '\0') {
+        return NULL;
+    }
+
+    char *end = s;
+    if (*end == '\'') {
+        end = strchr(end + 1, '\'');
+        if (end == NULL) {
+            error("unterminated character", NULL);
+        }
+    }
+    end = strchr(end, ',');
+    if (end != NULL) {
+        *end = '\0';
+        *rest = end + 1;
+    } else {
+        *rest = s + strlen(s);
+    }
+
+    char *back = s + strlen(s);
+    while (back > s && isspace((unsigned char)back[-1])) {
+        *--back = '\0';
+    }
+    return s;
+}
+
+/* parse_register
+ * Purpose: parses r0-r7, or reports an error
+ * Parameters: a string
+ * Returns: the register's number
+ *
+ * Expected input: an operand, or NULL if it was missing
+ * Success output: 0 to 7
+ * Failure output: reports an error for anything else
+ */
+static int parse_register(const char *s)
+{
+    if (s == NULL || (s[0] != 'r' && s[0] != 'R') || s[1] < '0'
+        || s[1] > '7' || s[2] != '\0') {
+        error("expected a register", s);
+    }
+    return s[1] - '0';
+}
+
+/* parse_value
+ * Purpose: parses a number or character literal, or returns the label
+            it names through *label
+ * Parameters: a string and a string pointer
+ * Returns: the value
+ *
+ * Expected input: an operand, or NULL if it was missing, and where to store
+                   a label
+ * Success output: the number (decimal, 0x hex or negative) or character,
+                   with NULL stored; or 0, with the operand stored as a
+                   label
+ * Failure output: reports an error for a missing operand or a malformed
+                   number or character
+ */
+static uint32_t parse_value(const char *s, const char **label)
+{
+    *label = NULL;
+    if (s == NULL) {
+        error("missing operand", NULL);
+    }
+    if (s[0] == '\'') {
+        if (s[1] == '\\' && s[2] == 'n' && s[3] == '\'') {
+            return '\n';
+        }
+        if (s[1] != '\0' && s[2] == '\'') {
+            return (unsigned char)s[1];
+        }
+        error("bad character literal", s);
+    }
+    if (isdigit((unsigned char)s[0]) || s[0] == '-') {
+        char *end;
+        long long n = strtoll(s, &end, 0);
+        if (*end != '\0') {
+            error("bad number", s);
+        }
+        return (uint32_t)n;
+    }
+    *label = s;
+    return 0;
+}
+
+/* parse_number
+ * Purpose: parses an operand that must not be a label
+ * Parameters: a string
+ * Returns: the value
+ *
+ * Expected input: an operand, or NULL if it was missing
+ * Success output: the number or character
+ * Failure output: reports an error for a label, or as parse_value does
+ */
+static uint32_t parse_number(const char *s)
+{
+    const char *label;
+    uint32_t value = parse_value(s, &label);
+    if (label != NULL) {
+        error("expected a number", s);
+    }
+    return value;
+}
+
+/* expect_end
+ * Purpose: reports an error if a statement has operands left over
+ * Parameters: a pointer to a string
+ * Returns: Nothing
+ *
+ * Expected input: the rest of a statement
+ * Success output: none
+ * Failure output: reports an error if there is another operand
+ */
+static void expect_end(char **rest)
+{
+    if (next_operand(rest) != NULL) {
+        error("too many operands", NULL);
+    }
+}
+
+/* Statements ***************************************************/
+
+/* parse_pseudo
+ * Purpose: expands a pseudo-instruction
+ * Parameters: a string and a string
+ * Returns: false if name is not a pseudo-instruction
+ *
+ * Expected input: the statement's name and its operands
+ * Success output: true, with the expansion appended, if name is a
+                   pseudo-instruction
+ * Failure output: reports an error for bad operands
+ */
+static bool parse_pseudo(const char *name, char *rest)
+{
+    char internal[32];
+    const char *label;
+
+    if (strcmp(name, "li") == 0) {
+        int a = parse_register(next_operand(&rest));
+        uint32_t value = parse_value(next_operand(&rest), &label);
+        if (label != NULL) {
+            emit_lv(a, 0, label);
+        } else {
+            load_constant(a, value);
+        }
+    } else if (strcmp(name, "jmp") == 0) {
+        parse_value(next_operand(&rest), &label);
+        if (label == NULL) {
+            error("jmp needs a label", NULL);
+        }
+        emit_lv(SCRATCH, 0, label);
+        items[num_items - 1].jump = true;
+        emit3(LOADP, 0, ZERO, SCRATCH);
+        items[num_items - 1].jump = true;
+    } else if (strcmp(name, "jz") == 0 || strcmp(name, "jnz") == 0) {
+        int c = parse_register(next_operand(&rest));
+        parse_value(next_operand(&rest), &label);
+        if (label == NULL || c == SCRATCH || c == LINK) {
+            error("expected a program register and a label", NULL);
+        }
+        char *next = new_internal_label(internal, sizeof(internal));
+        bool if_zero = name[1] == 'z';
+
+        /* r6 := the address taken when rC is nonzero, r7 := the other */
+        emit_lv(SCRATCH, 0, if_zero ? next : label);
+        emit_lv(LINK, 0, if_zero ? label : next);
+        emit3(CMOV, LINK, SCRATCH, c);
+        emit3(LOADP, 0, ZERO, LINK);
+        emit_label(next);
+    } else if (strcmp(name, "call") == 0) {
+        parse_value(next_operand(&rest), &label);
+        if (label == NULL) {
+            error("call needs a label", NULL);
+        }
+        char *next = new_internal_label(internal, sizeof(internal));
+        emit_lv(LINK, 0, next);
+        emit_lv(SCRATCH, 0, label);
+        emit3(LOADP, 0, ZERO, SCRATCH);
+        emit_label(next);
+    } else if (strcmp(name, "ret") == 0) {
+        emit3(LOADP, 0, ZERO, LINK);
+    } else if (strcmp(name, "push") == 0) {
+        int x = parse_register(next_operand(&rest));
+        emit3(SSTORE, ZERO, STACK_POINTER, x);
+        add_constant(STACK_POINTER, 1);
+    } else if (strcmp(name, "pop") == 0) {
+        int x = parse_register(next_operand(&rest));
+        add_constant(STACK_POINTER, -1);
+        emit3(SLOAD, x, ZERO, STACK_POINTER);
+    } else if (strcmp(name, "enter") == 0) {
+        int32_t locals = parse_number(next_operand(&rest));
+        emit3(SSTORE, ZERO, STACK_POINTER, LINK);
+        add_constant(STACK_POINTER, locals + 1);
+    } else if (strcmp(name, "leave") == 0) {
+        int32_t locals = parse_number(next_operand(&rest));
+        add_constant(STACK_POINTER, -(locals + 1));
+        emit3(SLOAD, LINK, ZERO, STACK_POINTER);
+    } else if (strcmp(name, "ldl") == 0 || strcmp(name, "stl") == 0) {
+        bool load = name[0] == 'l';
+        int x = 0;
+        int32_t k;
+        if (load) {
+            x = parse_register(next_operand(&rest));
+            k = parse_number(next_operand(&rest));
+        } else {
+            k = parse_number(next_operand(&rest));
+            x = parse_register(next_operand(&rest));
+        }
+        /* local k lives at sp - 1 - k */
+        load_constant(SCRATCH, (uint32_t)(-1 - k));
+        emit3(ADD, SCRATCH, STACK_POINTER, SCRATCH);
+        if (load) {
+            emit3(SLOAD, x, ZERO, SCRATCH);
+        } else {
+            emit3(SSTORE, ZERO, SCRATCH, x);
+        }
+    } else {
+        return false;
+    }
+
+    expect_end(&rest);
+    return true;
+}
+
+/* parse_instruction
+ * Purpose: parses a machine instruction, directive or pseudo-instruction
+ * Parameters: a string and a string
+ * Returns: Nothing
+ *
+ * Expected input: the statement's name and its operands
+ * Success output: none (the statement's items are appended)
+ * Failure output: reports an error for an unknown name, bad operands, or an
+                   LV value that does not fit in 25 bits
+ */
+static void parse_instruction(const char *name, char *rest)
+{
+    const char *label;
+
+    if (strcmp(name, ".word") == 0) {
+        Item *item = append_item(I_WORD);
+        item->value = parse_value(next_operand(&rest), &label);
+        item->label = label != NULL ? copy_string(label) : NULL;
+        expect_end(&rest);
+        return;
+    }
+    if (strcmp(name, ".space") == 0) {
+        Item *item = append_item(I_SPACE);
+        item->value = parse_number(next_operand(&rest));
+        expect_end(&rest);
+        return;
+    }
+    if (parse_pseudo(name, rest)) {
+        return;
+    }
+
+    int op = -1;
+    for (int i = 0; i <= LV; i++) {
+        if (strcmp(name, mnemonics[i]) == 0) {
+            op = i;
+        }
+    }
+
+    switch (op) {
+        case HALT:
+            emit3(HALT, 0, 0, 0);
+            break;
+        case LV: {
+            int a = parse_register(next_operand(&rest));
+            uint32_t value = parse_value(next_operand(&rest), &label);
+            if (label == NULL && value >= LV_LIMIT) {
+                error("value does not fit in 25 bits", NULL);
+            }
+            emit_lv(a, value, label);
+            break;
+        }
+        case ACTIVATE:
+        case LOADP: {
+            int b = parse_register(next_operand(&rest));
+            int c = parse_register(next_operand(&rest));
+            emit3(op, 0, b, c);
+            break;
+        }
+        case INACTIVATE:
+        case OUT:
+        case IN:
+            emit3(op, 0, 0, parse_register(next_operand(&rest)));
+            break;
+        case -1:
+            error("unknown instruction", name);
+            break;
+        default: {
+            int a = parse_register(next_operand(&rest));
+            int b = parse_register(next_operand(&rest));
+            int c = parse_register(next_operand(&rest));
+            emit3(op, a, b, c);
+        }
+    }
+
+    expect_end(&rest);
+}
+
+/* parse_line
+ * Purpose: parses one line of source
+ * Parameters: a string
+ * Returns: Nothing
+ *
+ * Expected input: a line, which is modified in place
+ * Success output: none (its labels and statement, if any, are
+                   appended; umdis addresses are skipped)
+ * Failure output: reports an error as parse_instruction does
+ */
+static void parse_line(char *line)
+{
+    char *comment = strpbrk(line, ";#");
+    /* a ';' or '#' inside a character literal is not a comment */
+    while (comment != NULL && comment > line && comment[-1] == '\''
+           && comment[1] == '\'') {
+        comment = strpbrk(comment + 1, ";#");
+    }
+    if (comment != NULL) {
+        *comment = '\0';
+    }
+
+    char *s = skip_space(line);
+
+    /* labels and umdis addresses */
+    for (;;) {
+        char *end = s;
+        while (isalnum((unsigned char)*end) || *end == '_' || *end == '.') {
+            end++;
+        }
+        if (end == s || *end != ':') {
+            break;
+        }
+        *end = '\0';
+
+        bool address = end - s == 8;
+        for (char *p = s; p < end && address; p++) {
+            address = isxdigit((unsigned char)*p);
+        }
+        if (!address) {
+            emit_label(s);
+        }
+        s = skip_space(end + 1);
+    }
+
+    if (*s == '\0') {
+        return;
+    }
+
+    char *name = s;
+    while (*s != '\0' && !isspace((unsigned char)*s)) {
+        s++;
+    }
+    if (*s != '\0') {
+        *s++ = '\0';
+    }
+    parse_instruction(name, s);
+}
+
+/* parse_file
+ * Purpose: parses a whole source file into items
+ * Parameters: a FILE pointer
+ * Returns: Nothing
+ *
+ * Expected input: an open source file
+ * Success output: none (every line's items are appended)
+ * Failure output: reports the first error in the source
+ */
+static void parse_file(FILE *fp)
+{
+    char line[MAX_LINE];
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        line_number++;
+        parse_line(line);
+    }
+}
+
+/* Optimiser ****************************************************/
+
+typedef struct Known {
+        bool valid;
+        uint32_t value;
+        const char *label;      /* the value is this label's address */
+} Known;
+
+/* known_equal
+ * Purpose: tells whether two known values are certainly the same
+ * Parameters: two Knowns
+ * Returns: true if they are
+ *
+ * Expected input: any values
+ * Success output: true if both are valid and are the same number or the
+                   same label's address
+ * Failure output: none
+ */
+static bool known_equal(Known x, Known y)
+{
+    if (!x.valid || !y.valid) {
+        return false;
+    }
+    if (x.label != NULL || y.label != NULL) {
+        return x.label != NULL && y.label != NULL
+               && strcmp(x.label, y.label) == 0;
+    }
+    return x.value == y.value;
+}
+
+/* is_number
+ * Purpose: tells whether a known value is a number, not an address
+ * Parameters: a Known
+ * Returns: true if it is
+ *
+ * Expected input: any value
+ * Success output: true for a valid value without a label
+ * Failure output: none
+ */
+static bool is_number(Known k)
+{
+    return k.valid && k.label == NULL;
+}
+
+/* forget_all
+ * Purpose: marks every register unknown, or known to be 0 at the very
+            start of the program
+ * Parameters: a Known pointer and a bool
+ * Returns: Nothing
+ *
+ * Expected input: the 8 registers' values, and whether this is the start of
+                   the program
+ * Success output: none
+ * Failure output: none
+ */
+static void forget_all(Known *known, bool at_start)
+{
+    for (int r = 0; r < 8; r++) {
+        known[r].valid = at_start;
+        known[r].value = 0;
+        known[r].label = NULL;
+    }
+}
+
+/* remove_redundant
+ * Purpose: deletes instructions that give a register the value it
+            already holds
+ * Parameters: none
+ * Returns: whether anything was deleted
+ *
+ * Expected input: the parsed items
+ * Success output: true if an instruction was marked dead
+ * Failure output: none
+ */
+static bool remove_redundant()
+{
+    Known known[8];
+    bool changed = false;
+
+    forget_all(known, true);
+
+    for (uint32_t i = 0; i < num_items; i++) {
+        Item *item = &items[i];
+
+        if (item->dead) {
+            continue;
+        }
+        if (item->kind != I_INST) {
+            forget_all(known, false);
+            continue;
+        }
+
+        Known result = { false, 0, NULL };
+        int dest = -1;
+
+        switch (item->op) {
+            case LV:
+                result.valid = true;
+                result.value = item->value;
+                result.label = item->label;
+                dest = item->a;
+                break;
+            case CMOV:
+                if (item->a == item->b
+                    || (is_number(known[item->c])
+                        && known[item->c].value == 0)) {
+                    item->dead = changed = true;
+                    continue;
+                }
+                if (is_number(known[item->c])) {
+                    result = known[item->b];
+                } else if (known_equal(known[item->a], known[item->b])) {
+                    item->dead = changed = true;
+                    continue;
+                }
+                dest = item->a;
+                break;
+            case ADD:
+            case MUL:
+            case NAND:
+            case DIV:
+                if (is_number(known[item->b]) && is_number(known[item->c])) {
+                    uint32_t b = known[item->b].value;
+                    uint32_t c = known[item->c].value;
+                    result.valid = item->op != DIV || c != 0;
+                    result.value = item->op == ADD ? b + c
+                                 : item->op == MUL ? b * c
+                                 : item->op == NAND ? ~(b & c)
+                                 : c != 0 ? b / c : 0;
+                }
+                dest = item->a;
+                break;
+            case SLOAD:
+                dest = item->a;
+                break;
+            case ACTIVATE:
+                dest = item->b;
+                break;
+            case IN:
+                dest = item->c;
+                break;
+            case HALT:
+            case LOADP:
+                forget_all(known, false);
+                continue;
+            default:
+                continue;
+        }
+
+        if (result.valid && known_equal(result, known[dest])) {
+            item->dead = changed = true;
+            continue;
+        }
+        known[dest] = result;
+    }
+
+    return changed;
+}
+
+/* remove_dead_writes
+ * Purpose: deletes side-effect free instructions whose result is
+            overwritten before it is read
+ * Parameters: none
+ * Returns: whether anything was deleted
+ *
+ * Expected input: the parsed items
+ * Success output: true if an instruction was marked dead
+ * Failure output: none
+ */
+static bool remove_dead_writes()
+{
+    uint8_t live = 0xff;
+    bool changed = false;
+
+    for (uint32_t i = num_items; i-- > 0;) {
+        Item *item = &items[i];
+
+        if (item->dead) {
+            continue;
+        }
+        if (item->kind != I_INST) {
+            live = 0xff;
+            continue;
+        }
+
+        uint8_t a = 1 << item->a, b = 1 << item->b, c = 1 << item->c;
+
+        switch (item->op) {
+            case LV:
+            case ADD:
+            case MUL:
+            case NAND:
+                if ((live & a) == 0) {
+                    item->dead = changed = true;
+                    continue;
+                }
+                live &= ~a;
+                if (item->op != LV) {
+                    live |= b | c;
+                }
+                break;
+            case CMOV:
+                if ((live & a) == 0) {
+                    item->dead = changed = true;
+                    continue;
+                }
+                live |= a | b | c;
+                break;
+            case DIV:
+            case SLOAD:
+                live &= ~a;
+                live |= b | c;
+                break;
+            case ACTIVATE:
+                live &= ~b;
+                live |= c;
+                break;
+            case IN:
+                live &= ~c;
+                break;
+            case HALT:
+            case LOADP:
+                live = 0xff;
+                break;
+            default:
+                live |= a | b | c;
+        }
+    }
+
+    return changed;
+}
+
+/* remove_jumps_to_next
+ * Purpose: deletes jmp expansions whose target follows them directly
+ * Parameters: none
+ * Returns: whether anything was deleted
+ *
+ * Expected input: the parsed items
+ * Success output: true if a jump was marked dead
+ * Failure output: none
+ */
+static bool remove_jumps_to_next()
+{
+    bool changed = false;
+
+    for (uint32_t i = 0; i + 1 < num_items; i++) {
+        Item *load = &items[i];
+        if (load->dead || !load->jump || load->op != LV) {
+            continue;
+        }
+
+        uint32_t j = i + 1;
+        while (j < num_items && items[j].dead) {
+            j++;
+        }
+        if (j >= num_items || !items[j].jump) {
+            continue;
+        }
+
+        for (uint32_t k = j + 1; k < num_items; k++) {
+            if (items[k].dead) {
+                continue;
+            }
+            if (items[k].kind != I_LABEL) {
+                break;
+            }
+            if (strcmp(items[k].label, load->label) == 0) {
+                load->dead = items[j].dead = changed = true;
+                break;
+            }
+        }
+    }
+
+    return changed;
+}
+
+/* optimise
+ * Purpose: runs the peephole passes until none of them finds anything
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: the parsed items
+ * Success output: none (redundant items are marked dead)
+ * Failure output: none
+ */
+static void optimise()
+{
+    bool changed = true;
+
+    while (changed) {
+        changed = remove_redundant();
+        changed = remove_dead_writes() || changed;
+        changed = remove_jumps_to_next() || changed;
+    }
+}
+
+/* Output *******************************************************/
+
+/* find_symbol
+ * Purpose: looks up a defined label, returning NULL if there is none
+ * Parameters: a string
+ * Returns: a pointer to the Symbol, or NULL
+ *
+ * Expected input: a label's name; called after assign_addresses
+ * Success output: the label's symbol
+ * Failure output: NULL if the label is not defined
+ */
+static Symbol *find_symbol(const char *name)
+{
+    for (uint32_t i = 0; i < num_symbols; i++) {
+        if (strcmp(symbols[i].name, name) == 0) {
+            return &symbols[i];
+        }
+    }
+    return NULL;
+}
+
+/* assign_addresses
+ * Purpose: gives every label the address of the word that follows it
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: the items, after any optimisation
+ * Success output: none (every label is in the symbol table)
+ * Failure output: reports an error for a label defined twice
+ */
+static void assign_addresses()
+{
+    uint32_t address = 0;
+
+    for (uint32_t i = 0; i < num_items; i++) {
+        Item *item = &items[i];
+        line_number = item->line;
+
+        if (item->dead) {
+            continue;
+        }
+        if (item->kind == I_LABEL) {
+            if (find_symbol(item->label) != NULL) {
+                error("label defined twice", item->label);
+            }
+            if (num_symbols == symbols_capacity) {
+                symbols_capacity = symbols_capacity == 0
+                                   ? 64 : 2 * symbols_capacity;
+                symbols = realloc(symbols,
+                                  symbols_capacity * sizeof(Symbol));
+                assert(symbols != NULL);
+            }
+            Symbol symbol = { copy_string(item->label), address };
+            symbols[num_symbols++] = symbol;
+        } else if (item->kind == I_SPACE) {
+            address += item->value;
+        } else {
+            address++;
+        }
+    }
+}
+
+/* resolve
+ * Purpose: returns the value of an item's operand, looking up its label
+ * Parameters: an Item pointer
+ * Returns: the value
+ *
+ * Expected input: an LV or .word item; called after assign_addresses
+ * Success output: its number, or its label's address
+ * Failure output: reports an error for an undefined label
+ */
+static uint32_t resolve(const Item *item)
+{
+    if (item->label == NULL) {
+        return item->value;
+    }
+
+    Symbol *symbol = find_symbol(item->label);
+    if (symbol == NULL) {
+        line_number = item->line;
+        error("undefined label", item->label);
+    }
+    return symbol->address;
+}
+
+/* put_word
+ * Purpose: writes a word most significant byte first, as the UM reads
+ * Parameters: a FILE pointer and a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: an open file and the word
+ * Success output: none
+ * Failure output: none
+ */
+static void put_word(FILE *fp, uint32_t word)
+{
+    for (int lsb = 24; lsb >= 0; lsb -= 8) {
+        fputc((word >> lsb) & 0xff, fp);
+    }
+}
+
+/* write_image
+ * Purpose: lays out the program and writes it as a .um image
+ * Parameters: a FILE pointer
+ * Returns: Nothing
+ *
+ * Expected input: the file to write to
+ * Success output: none (every live item is written as a word)
+ * Failure output: reports an error for a duplicate or undefined label, or a
+                   label whose address does not fit in an LV
+ */
+static void write_image(FILE *fp)
+{
+    assign_addresses();
+
+    for (uint32_t i = 0; i < num_items; i++) {
+        Item *item = &items[i];
+        line_number = item->line;
+
+        if (item->dead || item->kind == I_LABEL) {
+            continue;
+        }
+        if (item->kind == I_SPACE) {
+            for (uint32_t j = 0; j < item->value; j++) {
+                put_word(fp, 0);
+            }
+            continue;
+        }
+        if (item->kind == I_WORD) {
+            put_word(fp, resolve(item));
+            continue;
+        }
+
+        Um_instruction word = 0;
+        word = Bitpack_newu(word, 4, 28, item->op);
+        if (item->op == LV) {
+            uint32_t value = resolve(item);
+            if (value >= LV_LIMIT) {
+                error("value does not fit in 25 bits", item->label);
+            }
+            word = Bitpack_newu(word, 3, 25, item->a);
+            word = Bitpack_newu(word, 25, 0, value);
+        } else {
+            word = Bitpack_newu(word, 3, 6, item->a);
+            word = Bitpack_newu(word, 3, 3, item->b);
+            word = Bitpack_newu(word, 3, 0, item->c);
+        }
+        put_word(fp, word);
+    }
+}
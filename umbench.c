@@ -0,0 +1,503 @@
+/**************************************************************
+ *
+ *                         umbench.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Microbenchmarks for the primitives the UM is built from, each
+ *     measured on its own: Bitpack_getu field extraction, opcode_reader
+ *     dispatch for every opcode, get_word and set_word, new_segment and
+ *     free_segment pairs of several sizes, read_words for several
+ *     image sizes, and the lifetime of a short-lived UM's segments with
+ *     and without an arena.
+ *
+ *     Each benchmark is first calibrated to a batch of iterations that
+ *     takes at least SAMPLE_NS, then timed for a number of warm-up
+ *     batches that are thrown away and a number of sample batches. The
+ *     median, 99th percentile and minimum time per iteration over the
+ *     samples are printed, in nanoseconds.
+ *
+ *     Usage: umbench [-n samples] [-w warmup] [name]
+ *         -n    timed batches per benchmark (default 100)
+ *         -w    untimed warm-up batches per benchmark (default 10)
+ *         name  only run benchmarks whose name contains this string
+ *
+ **************************************************************/
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "instruction.h"
+#include "segment.h"
+#include "device.h"
+#include "loader.h"
+
+/* Shortest time a timed batch should take */
+#define SAMPLE_NS 100000.0
+
+/* Words in the segment get_word and set_word run over */
+#define DATA_WORDS (1 << 16)
+
+/* Segments each short-lived UM maps before it exits */
+#define SHORT_VM_SEGMENTS 256
+
+typedef struct Benchmark {
+        const char *name;
+        void (*run)(long arg, size_t iterations);
+        long arg;
+} Benchmark;
+
+/* Results are folded into this so the compiler keeps the work */
+static volatile uint32_t sink;
+
+static uint32_t data_segment;
+static uint32_t decode_words[256];
+static FILE *image_file;
+static long image_words;
+static uint32_t *image_buffer;
+
+/* word
+ * Purpose: packs a three-register instruction
+ * Parameters: an opcode and three registers
+ * Returns: the instruction
+ *
+ * Expected input: any opcode but LV, and registers from 0 to 7
+ * Success output: the instruction word
+ * Failure output: none
+ */
+static Um_instruction word(Um_opcode op, unsigned a, unsigned b, unsigned c)
+{
+    return (uint32_t)op << 28 | a << 6 | b << 3 | c;
+}
+
+/* reset_registers
+ * Purpose: puts the registers into the state the dispatch benchmarks
+            expect
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: data_segment is mapped
+ * Success output: none (r3 is a non-zero divisor and a segment size,
+                   r4 and r5 index data_segment, r0 and r7 are 0)
+ * Failure output: none
+ */
+static void reset_registers()
+{
+    uint32_t registers[8] = { 0, 'A', 'B', 7, data_segment, 3, 0, 0 };
+
+    set_registers(registers);
+}
+
+/* run_bitpack
+ * Purpose: unpacks the opcode and three register fields of words
+ * Parameters: a long and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: an unused argument, and the number of words to unpack
+ * Success output: none
+ * Failure output: none
+ */
+static void run_bitpack(long arg, size_t iterations)
+{
+    uint32_t result = 0;
+
+    (void)arg;
+    for (size_t i = 0; i < iterations; i++) {
+        uint32_t instruction = decode_words[i & 255];
+
+        result ^= Bitpack_getu(instruction, 4, 28)
+                  ^ Bitpack_getu(instruction, 3, 6)
+                  ^ Bitpack_getu(instruction, 3, 3)
+                  ^ Bitpack_getu(instruction, 3, 0);
+    }
+    sink = result;
+}
+
+/* run_dispatch
+ * Purpose: runs one instruction through opcode_reader repeatedly
+ * Parameters: a long and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: an opcode, and how many times to dispatch it; MAP is
+                   timed as a MAP followed by an UNMAP of the new segment
+ * Success output: none
+ * Failure output: none
+ */
+static void run_dispatch(long op, size_t iterations)
+{
+    Um_instruction instruction;
+    Um_instruction unmap = word(INACTIVATE, 0, 0, 6);
+    bool running = true;
+    int prog_counter = 0;
+
+    switch (op) {
+        case SLOAD:
+            instruction = word(SLOAD, 1, 4, 5);
+            break;
+        case SSTORE:
+            instruction = word(SSTORE, 4, 5, 1);
+            break;
+        case ACTIVATE:
+            instruction = word(ACTIVATE, 0, 6, 3);
+            break;
+        case OUT:
+        case IN:
+            instruction = word(op, 0, 0, 1);
+            break;
+        case LOADP:
+            instruction = word(LOADP, 0, 0, 7);
+            break;
+        case LV:
+            instruction = (uint32_t)LV << 28 | 1 << 25 | 12345;
+            break;
+        default:
+            instruction = word(op, 1, 2, 3);
+    }
+
+    reset_registers();
+    for (size_t i = 0; i < iterations; i++) {
+        opcode_reader(instruction, &running, &prog_counter);
+        if (op == ACTIVATE) {
+            opcode_reader(unmap, &running, &prog_counter);
+        }
+    }
+    sink = running + prog_counter;
+}
+
+/* run_get_word
+ * Purpose: reads words of a segment in a scattered order
+ * Parameters: a long and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: an unused argument, and the number of words to read
+ * Success output: none
+ * Failure output: none
+ */
+static void run_get_word(long arg, size_t iterations)
+{
+    uint32_t result = 0;
+    uint32_t index = 0;
+
+    (void)arg;
+    for (size_t i = 0; i < iterations; i++) {
+        result += get_word(data_segment, index);
+        index = (index + 4099) & (DATA_WORDS - 1);
+    }
+    sink = result;
+}
+
+/* run_set_word
+ * Purpose: writes words of a segment in a scattered order
+ * Parameters: a long and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: an unused argument, and the number of words to write
+ * Success output: none
+ * Failure output: none
+ */
+static void run_set_word(long arg, size_t iterations)
+{
+    uint32_t index = 0;
+
+    (void)arg;
+    for (size_t i = 0; i < iterations; i++) {
+        set_word(data_segment, index, i);
+        index = (index + 4099) & (DATA_WORDS - 1);
+    }
+}
+
+/* run_segment_pair
+ * Purpose: maps and unmaps segments of one size
+ * Parameters: a long and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: the segment size in words, and the number of pairs
+ * Success output: none
+ * Failure output: none
+ */
+static void run_segment_pair(long size, size_t iterations)
+{
+    for (size_t i = 0; i < iterations; i++) {
+        free_segment(new_segment(size));
+    }
+}
+
+/* short_vm_thread
+ * Purpose: runs the segment lifetimes of a batch of short-lived UMs
+ * Parameters: a void pointer
+ * Returns: NULL
+ *
+ * Expected input: a pointer to the number of UMs; run on a thread of
+                   its own, since each UM's segments belong to a thread
+ * Success output: none
+ * Failure output: none
+ */
+static void *short_vm_thread(void *arg)
+{
+    size_t iterations = *(size_t *)arg;
+
+    for (size_t i = 0; i < iterations; i++) {
+        init_segment(64);
+        for (int j = 0; j < SHORT_VM_SEGMENTS; j++) {
+            uint32_t id = new_segment(1 + j % 64);
+
+            if (j % 4 == 3) {
+                free_segment(id);
+            }
+        }
+        free_all_segments();
+    }
+
+    return NULL;
+}
+
+/* run_short_vm
+ * Purpose: starts, fills and frees the segments of short-lived UMs,
+            with or without an arena
+ * Parameters: a long and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: nonzero for an arena, and the number of UMs
+ * Success output: none
+ * Failure output: exits the program if the thread cannot be started
+ */
+static void run_short_vm(long arena, size_t iterations)
+{
+    pthread_t thread;
+
+    segment_use_arena(arena != 0);
+    if (pthread_create(&thread, NULL, short_vm_thread, &iterations) != 0) {
+        fprintf(stderr, "umbench: cannot start a thread\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_join(thread, NULL);
+    segment_use_arena(false);
+}
+
+/* run_read_words
+ * Purpose: reads an image of a given size with read_words
+ * Parameters: a long and a size_t
+ * Returns: Nothing
+ *
+ * Expected input: the image size in words, and the number of reads
+ * Success output: none
+ * Failure output: exits the program if the image file cannot be made
+ */
+static void run_read_words(long size, size_t iterations)
+{
+    if (image_words != size) {
+        if (image_file != NULL) {
+            fclose(image_file);
+        }
+        image_file = tmpfile();
+        image_buffer = realloc(image_buffer, size * sizeof(uint32_t));
+        if (image_file == NULL || image_buffer == NULL) {
+            fprintf(stderr, "umbench: cannot make a test image\n");
+            exit(EXIT_FAILURE);
+        }
+        for (long i = 0; i < size * 4; i++) {
+            putc(i * 131 & 0xff, image_file);
+        }
+        image_words = size;
+    }
+
+    for (size_t i = 0; i < iterations; i++) {
+        rewind(image_file);
+        read_words(image_file, image_buffer, size);
+    }
+    sink = image_buffer[size - 1];
+}
+
+static Benchmark benchmarks[] = {
+    { "Bitpack_getu",               run_bitpack,      0 },
+    { "opcode_reader/CMOV",         run_dispatch,     CMOV },
+    { "opcode_reader/SLOAD",        run_dispatch,     SLOAD },
+    { "opcode_reader/SSTORE",       run_dispatch,     SSTORE },
+    { "opcode_reader/ADD",          run_dispatch,     ADD },
+    { "opcode_reader/MUL",          run_dispatch,     MUL },
+    { "opcode_reader/DIV",          run_dispatch,     DIV },
+    { "opcode_reader/NAND",         run_dispatch,     NAND },
+    { "opcode_reader/HALT",         run_dispatch,     HALT },
+    { "opcode_reader/MAP+UNMAP",    run_dispatch,     ACTIVATE },
+    { "opcode_reader/OUT",          run_dispatch,     OUT },
+    { "opcode_reader/IN",           run_dispatch,     IN },
+    { "opcode_reader/LOADP",        run_dispatch,     LOADP },
+    { "opcode_reader/LV",           run_dispatch,     LV },
+    { "get_word",                   run_get_word,     0 },
+    { "set_word",                   run_set_word,     0 },
+    { "new+free_segment/1",         run_segment_pair, 1 },
+    { "new+free_segment/64",        run_segment_pair, 64 },
+    { "new+free_segment/4096",      run_segment_pair, 4096 },
+    { "new+free_segment/65536",     run_segment_pair, 65536 },
+    { "new+free_segment/1048576",   run_segment_pair, 1 << 20 },
+    { "read_words/1024",            run_read_words,   1024 },
+    { "read_words/65536",           run_read_words,   65536 },
+    { "read_words/1048576",         run_read_words,   1 << 20 },
+    { "short_vm/heap",              run_short_vm,     0 },
+    { "short_vm/arena",             run_short_vm,     1 },
+};
+
+#define NUM_BENCHMARKS (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+/* time_batch
+ * Purpose: times one batch of a benchmark
+ * Parameters: a Benchmark pointer and a size_t
+ * Returns: the time the batch took, in nanoseconds
+ *
+ * Expected input: a benchmark from the table, and the batch size
+ * Success output: the elapsed monotonic time
+ * Failure output: none
+ */
+static double time_batch(Benchmark *benchmark, size_t iterations)
+{
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    benchmark->run(benchmark->arg, iterations);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start.tv_sec) * 1e9
+           + (end.tv_nsec - start.tv_nsec);
+}
+
+/* compare_doubles
+ * Purpose: orders two doubles for qsort
+ * Parameters: two void pointers
+ * Returns: negative, zero or positive
+ *
+ * Expected input: pointers to doubles
+ * Success output: the sign of the first minus the second
+ * Failure output: none
+ */
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* measure
+ * Purpose: calibrates, warms up and samples one benchmark, and prints
+            its line of the report
+ * Parameters: a Benchmark pointer and two ints
+ * Returns: Nothing
+ *
+ * Expected input: a benchmark from the table, the number of samples
+                   (at least 1) and the number of warm-up batches
+ * Success output: none (one line on stdout)
+ * Failure output: exits the program if memory runs out
+ */
+static void measure(Benchmark *benchmark, int samples, int warmup)
+{
+    size_t iterations = 1;
+
+    /* Untimed, so one-off setup (such as writing the test image) does
+     * not count towards calibration */
+    benchmark->run(benchmark->arg, 1);
+
+    while (time_batch(benchmark, iterations) < SAMPLE_NS
+           && iterations < ((size_t)1 << 30)) {
+        iterations *= 2;
+    }
+
+    for (int i = 0; i < warmup; i++) {
+        time_batch(benchmark, iterations);
+    }
+
+    double *per_iteration = malloc(samples * sizeof(double));
+    if (per_iteration == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < samples; i++) {
+        per_iteration[i] = time_batch(benchmark, iterations) / iterations;
+    }
+    qsort(per_iteration, samples, sizeof(double), compare_doubles);
+
+    int p99 = (samples * 99) / 100;
+
+    if (p99 >= samples) {
+        p99 = samples - 1;
+    }
+
+    printf("%-28s %12zu %12.2f %12.2f %12.2f\n", benchmark->name,
+           iterations, per_iteration[samples / 2], per_iteration[p99],
+           per_iteration[0]);
+    fflush(stdout);
+    free(per_iteration);
+}
+
+int main(int argc, char *argv[])
+{
+    int samples = 100;
+    int warmup = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:w:")) != -1) {
+        switch (opt) {
+            case 'n':
+                samples = atoi(optarg);
+                break;
+            case 'w':
+                warmup = atoi(optarg);
+                break;
+            default:
+                samples = 0;
+        }
+    }
+
+    if (samples < 1 || warmup < 0 || argc - optind > 1) {
+        fprintf(stderr, "Usage: umbench [-n samples] [-w warmup] "
+                        "[name]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    const char *filter = optind < argc ? argv[optind] : "";
+
+    /* IN and OUT go to devices that never block */
+    Device input = device_fd(open("/dev/zero", O_RDONLY), true);
+    Device output = device_fd(open("/dev/null", O_WRONLY), true);
+
+    bind_devices(input, output);
+
+    uint32_t *segment_zero = init_segment(64);
+
+    for (int i = 0; i < 64; i++) {
+        segment_zero[i] = word(HALT, 0, 0, 0);
+    }
+    data_segment = new_segment(DATA_WORDS);
+
+    srand(40);
+    for (int i = 0; i < 256; i++) {
+        decode_words[i] = (uint32_t)rand() << 16 ^ rand();
+    }
+
+    printf("%-28s %12s %12s %12s %12s\n", "benchmark", "iters/sample",
+           "median ns", "p99 ns", "min ns");
+    for (size_t i = 0; i < NUM_BENCHMARKS; i++) {
+        if (strstr(benchmarks[i].name, filter) != NULL) {
+            measure(&benchmarks[i], samples, warmup);
+        }
+    }
+
+    if (image_file != NULL) {
+        fclose(image_file);
+    }
+    free(image_buffer);
+    free_all_segments();
+    bind_devices(NULL, NULL);
+    device_free(&input);
+    device_free(&output);
+
+    return 0;
+}
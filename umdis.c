@@ -0,0 +1,821 @@
+/**************************************************************
+ *
+ *                         umdis.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     A disassembler and static analyser for .um images. Starting at
+ *     word 0 with every register 0, it follows the program's control
+ *     flow, tracking small sets of constant values for each register so
+ *     that the targets of LOADP instructions can be resolved. The usual
+ *     patterns are a jump to a constant, a CMOV that picks between two
+ *     constants, and a jump through a table of addresses stored in m[0]
+ *     (LV base, ADD index, SLOAD, LOADP). Words never reached as code
+ *     are reported as data.
+ *
+ *     Usage: umdis [-q] [-m map_file] program.um
+ *         -q    print only the summary, not the listing
+ *         -m    write a code map that `um --code-map` can load
+ *
+ *     Note
+ *     The analysis assumes that m[0] is only modified by SSTOREs it can
+ *     see. If it finds one that may write m[0], it starts over without
+ *     trusting words loaded from m[0]. A LOADP from another segment
+ *     leaves the image, so code reached only that way is not found; the
+ *     UM decodes such words lazily, so the map is only ever a hint.
+ *
+ **************************************************************/
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "decode.h"
+
+#define MAX_SET 8
+#define MAX_TABLE 4096
+
+/* Abstract register values: a small set of constants, a known constant
+ * plus an unknown offset, a word loaded from m[0] at such an offset,
+ * an identifier returned by MAP (never 0), or anything at all */
+typedef enum Value_kind {
+        V_SET = 0, V_OFFSET, V_TABLE, V_SEGMENT, V_TOP
+} Value_kind;
+
+typedef struct Value {
+        uint8_t kind;
+        uint8_t count;          /* number of constants in a V_SET */
+        uint32_t vals[MAX_SET]; /* the set, or the base of an offset */
+} Value;
+
+typedef struct State {
+        Value regs[8];
+} State;
+
+typedef struct Entry {
+        uint32_t pc;
+        bool queued;
+        State state;
+} Entry;
+
+typedef struct Jump_table {
+        uint32_t base, count, user;
+} Jump_table;
+
+static const char *mnemonics[] = {
+        "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+        "map", "unmap", "out", "in", "loadp", "lv"
+};
+
+/* The image being analysed and what the analysis has found about it */
+static uint32_t *words;
+static uint32_t num_words;
+static uint8_t *code_map;       /* words reached as code */
+static uint8_t *table_map;      /* words that belong to a jump table */
+static uint8_t *unresolved_map; /* LOADPs with unknown targets */
+static uint8_t *switch_map;     /* LOADPs that load another segment */
+static bool trust_m0;
+static bool m0_written;
+
+static Entry *entries;
+static uint32_t num_entries, entries_capacity;
+static int32_t *entry_index;    /* pc -> index into entries, or -1 */
+static uint32_t *worklist;
+static uint32_t worklist_length;
+
+static Jump_table *tables;
+static uint32_t num_tables, tables_capacity;
+
+static uint32_t *read_image(const char *path, uint32_t *length);
+static void analyse();
+static void print_listing(bool listing, const char *path);
+
+int main(int argc, char *argv[])
+{
+    const char *map_path = NULL;
+    bool listing = true;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "qm:")) != -1) {
+        switch (opt) {
+            case 'q':
+                listing = false;
+                break;
+            case 'm':
+                map_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: umdis [-q] [-m map_file] "
+                                "program.um\n");
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind != 1) {
+        fprintf(stderr, "Usage: umdis [-q] [-m map_file] program.um\n");
+        exit(EXIT_FAILURE);
+    }
+
+    words = read_image(argv[optind], &num_words);
+
+    trust_m0 = true;
+    analyse();
+    if (m0_written) {
+        trust_m0 = false;
+        analyse();
+    }
+
+    print_listing(listing, argv[optind]);
+
+    if (map_path != NULL) {
+        FILE *fp = fopen(map_path, "w");
+        if (fp == NULL) {
+            fprintf(stderr, "umdis: cannot write %s\n", map_path);
+            exit(EXIT_FAILURE);
+        }
+        codemap_write(fp, code_map, words, num_words);
+        fclose(fp);
+    }
+
+    free(words);
+    free(code_map);
+    free(table_map);
+    free(unresolved_map);
+    free(switch_map);
+    free(entries);
+    free(entry_index);
+    free(worklist);
+    free(tables);
+
+    return 0;
+}
+
+/* read_image
+ * Purpose: reads a .um file into an array of words
+ * Parameters: a string and a uint32_t pointer
+ * Returns: the words of the image
+ *
+ * Expected input: the path of a .um file and where to put its length
+ * Success output: the words, most significant byte first as in the UM
+ * Failure output: exits the program if the file cannot be read
+ */
+static uint32_t *read_image(const char *path, uint32_t *length)
+{
+    struct stat buf;
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL || stat(path, &buf) != 0) {
+        fprintf(stderr, "umdis: cannot read %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    *length = buf.st_size / 4;
+    uint32_t *image = malloc((*length + 1) * sizeof(uint32_t));
+    assert(image != NULL);
+
+    for (uint32_t i = 0; i < *length; i++) {
+        uint32_t word = 0;
+        for (int j = 0; j < 4; j++) {
+            word = (word << 8) | (fgetc(fp) & 0xff);
+        }
+        image[i] = word;
+    }
+
+    fclose(fp);
+    return image;
+}
+
+/* set_of
+ * Purpose: makes a one-element V_SET
+ * Parameters: a uint32_t
+ * Returns: the Value
+ *
+ * Expected input: any constant
+ * Success output: a V_SET holding just that constant
+ * Failure output: none
+ */
+static Value set_of(uint32_t val)
+{
+    Value v = { V_SET, 1, { val } };
+    return v;
+}
+
+/* top
+ * Purpose: makes a value about which nothing is known
+ * Parameters: none
+ * Returns: the Value
+ *
+ * Expected input: none
+ * Success output: a V_TOP
+ * Failure output: none
+ */
+static Value top()
+{
+    Value v = { V_TOP, 0, { 0 } };
+    return v;
+}
+
+/* set_add
+ * Purpose: adds a constant to a V_SET, widening to V_TOP when full
+ * Parameters: a Value pointer and a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: any value, and a constant
+ * Success output: none (a V_SET holds the constant, or has become V_TOP
+                   if it already held MAX_SET others; other kinds are
+                   left as they are)
+ * Failure output: none
+ */
+static void set_add(Value *v, uint32_t val)
+{
+    if (v->kind != V_SET) {
+        return;
+    }
+    for (int i = 0; i < v->count; i++) {
+        if (v->vals[i] == val) {
+            return;
+        }
+    }
+    if (v->count == MAX_SET) {
+        *v = top();
+    } else {
+        v->vals[v->count++] = val;
+    }
+}
+
+/* join
+ * Purpose: computes the least value that covers both arguments
+ * Parameters: two Values
+ * Returns: the joined value
+ *
+ * Expected input: the values a register may hold on two paths
+ * Success output: the union of two V_SETs (V_TOP if it is too large),
+                   either value if they are the same, or else V_TOP
+ * Failure output: none
+ */
+static Value join(Value x, Value y)
+{
+    if (x.kind == V_SET && y.kind == V_SET) {
+        for (int i = 0; i < y.count; i++) {
+            set_add(&x, y.vals[i]);
+        }
+        return x;
+    }
+    if (x.kind == y.kind && x.kind != V_TOP && x.vals[0] == y.vals[0]) {
+        return x;
+    }
+    return top();
+}
+
+/* value_equal
+ * Purpose: tells whether two abstract values are the same
+ * Parameters: two Values
+ * Returns: true if they are the same
+ *
+ * Expected input: any values
+ * Success output: true if they are of the same kind and, for V_SETs,
+                   hold the same constants in any order
+ * Failure output: none
+ */
+static bool value_equal(Value x, Value y)
+{
+    if (x.kind != y.kind) {
+        return false;
+    }
+    if (x.kind == V_TOP) {
+        return true;
+    }
+    if (x.kind != V_SET) {
+        return x.vals[0] == y.vals[0];
+    }
+    if (x.count != y.count) {
+        return false;
+    }
+    for (int i = 0; i < x.count; i++) {
+        bool found = false;
+        for (int j = 0; j < y.count; j++) {
+            found = found || x.vals[i] == y.vals[j];
+        }
+        if (!found) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* is_const
+ * Purpose: tells whether a value is known to be exactly val
+ * Parameters: a Value and a uint32_t
+ * Returns: true if it is
+ *
+ * Expected input: any value, and a constant
+ * Success output: true only for a V_SET holding just that constant
+ * Failure output: none
+ */
+static bool is_const(Value v, uint32_t val)
+{
+    return v.kind == V_SET && v.count == 1 && v.vals[0] == val;
+}
+
+/* may_be_zero
+ * Purpose: tells whether a value could be 0 at run time
+ * Parameters: a Value
+ * Returns: true if it could
+ *
+ * Expected input: any value
+ * Success output: false for a segment ID or a V_SET without 0, true
+                   otherwise
+ * Failure output: none
+ */
+static bool may_be_zero(Value v)
+{
+    if (v.kind == V_SEGMENT) {
+        return false;
+    }
+    if (v.kind != V_SET) {
+        return true;
+    }
+    for (int i = 0; i < v.count; i++) {
+        if (v.vals[i] == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* arith
+ * Purpose: applies ADD, MUL, DIV or NAND to two abstract values
+ * Parameters: a Um_opcode and two Values
+ * Returns: the abstract result
+ *
+ * Expected input: one of the four opcodes, and the values of rB and rC
+ * Success output: the set of results for two V_SETs, a V_OFFSET for a
+                   constant added to an unknown (how a table index is
+                   formed), or else V_TOP
+ * Failure output: none
+ */
+static Value arith(Um_opcode op, Value x, Value y)
+{
+    if (x.kind == V_SET && y.kind == V_SET) {
+        Value result = { V_SET, 0, { 0 } };
+        for (int i = 0; i < x.count; i++) {
+            for (int j = 0; j < y.count; j++) {
+                uint32_t b = x.vals[i], c = y.vals[j];
+                switch (op) {
+                    case ADD:  set_add(&result, b + c); break;
+                    case MUL:  set_add(&result, b * c); break;
+                    case NAND: set_add(&result, ~(b & c)); break;
+                    default:
+                        /* a zero divisor fails, so it adds nothing */
+                        if (c != 0) {
+                            set_add(&result, b / c);
+                        }
+                }
+            }
+        }
+        return result.count == 0 && result.kind == V_SET ? top() : result;
+    }
+
+    if (op == ADD) {
+        /* constant + unknown is how a table index is usually formed */
+        Value base = x.kind == V_SET ? x : y;
+        Value other = x.kind == V_SET ? y : x;
+
+        if (base.kind == V_SET && base.count == 1) {
+            if (other.kind == V_OFFSET) {
+                /* Either constant could be the table's base; keep the
+                 * sum if it lies in the image, else the newer constant */
+                uint32_t sum = other.vals[0] + base.vals[0];
+                Value v = { V_OFFSET, 0, { sum } };
+                if (sum >= num_words && base.vals[0] < num_words) {
+                    v.vals[0] = base.vals[0];
+                }
+                return v;
+            } else if (other.kind != V_SET && other.kind != V_SEGMENT) {
+                Value v = { V_OFFSET, 0, { base.vals[0] } };
+                return v;
+            }
+        }
+    }
+
+    return top();
+}
+
+/* record_table
+ * Purpose: notes a jump table found at base, used by the LOADP at user
+ * Parameters: 2 uint32_ts and a uint32_t pointer
+ * Returns: the targets found in the table
+ *
+ * Expected input: the table's address, the LOADP's, and where to store
+                   the number of targets
+ * Success output: the words from base that are addresses in the image
+                   (at most MAX_TABLE), with their number stored; the
+                   table is listed once and its words marked
+ * Failure output: none (a table with no targets stores 0)
+ */
+static uint32_t *record_table(uint32_t base, uint32_t user, uint32_t *count)
+{
+    uint32_t n = 0;
+
+    while (base + n < num_words && n < MAX_TABLE
+           && words[base + n] < num_words) {
+        n++;
+    }
+
+    if (num_tables == tables_capacity) {
+        tables_capacity = tables_capacity == 0 ? 8 : 2 * tables_capacity;
+        tables = realloc(tables, tables_capacity * sizeof(Jump_table));
+        assert(tables != NULL);
+    }
+
+    bool seen = false;
+    for (uint32_t i = 0; i < num_tables; i++) {
+        seen = seen || (tables[i].base == base && tables[i].user == user);
+    }
+    if (!seen && n > 0) {
+        Jump_table table = { base, n, user };
+        tables[num_tables++] = table;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        CODEMAP_SET(table_map, base + i);
+    }
+
+    *count = n;
+    return &words[base];
+}
+
+/* flow_into
+ * Purpose: merges a state into the entry for pc, creating the entry if
+            there is none, and queues the entry if its state changed
+ * Parameters: a uint32_t and a State pointer
+ * Returns: Nothing
+ *
+ * Expected input: an address control may reach, and the registers'
+                   values when it does
+ * Success output: none (addresses outside the image are ignored)
+ * Failure output: none
+ */
+static void flow_into(uint32_t pc, const State *state)
+{
+    if (pc >= num_words) {
+        return;
+    }
+
+    int32_t index = entry_index[pc];
+
+    if (index < 0) {
+        if (num_entries == entries_capacity) {
+            entries_capacity = entries_capacity == 0
+                               ? 64 : 2 * entries_capacity;
+            entries = realloc(entries, entries_capacity * sizeof(Entry));
+            assert(entries != NULL);
+        }
+        index = num_entries++;
+        entry_index[pc] = index;
+        entries[index].pc = pc;
+        entries[index].state = *state;
+        entries[index].queued = false;
+    } else {
+        bool changed = false;
+        State *old = &entries[index].state;
+
+        for (int r = 0; r < 8; r++) {
+            Value joined = join(old->regs[r], state->regs[r]);
+            changed = changed || !value_equal(joined, old->regs[r]);
+            old->regs[r] = joined;
+        }
+        if (!changed) {
+            return;
+        }
+    }
+
+    if (!entries[index].queued) {
+        entries[index].queued = true;
+        worklist[worklist_length++] = index;
+    }
+}
+
+/* jump
+ * Purpose: follows a LOADP at pc whose operands have the given values
+ * Parameters: a uint32_t, two Values and a State pointer
+ * Returns: Nothing
+ *
+ * Expected input: the LOADP's address, the values of rB and rC, and the
+                   registers' values there
+ * Success output: none (each target it can resolve, and the word after
+                   a call, gets the state; the LOADP is marked if it
+                   loads another segment or its target is unknown)
+ * Failure output: none
+ */
+static void jump(uint32_t pc, Value seg, Value target, const State *state)
+{
+    /* A register holding the address after the LOADP is a return
+     * address; the callee's return may not be resolvable, so assume
+     * the call returns, knowing nothing about the registers then
+     * except r0, which compiled code keeps at 0 */
+    for (int r = 0; r < 8; r++) {
+        const Value *v = &state->regs[r];
+        for (int i = 0; v->kind == V_SET && i < v->count; i++) {
+            if (v->vals[i] == pc + 1) {
+                State unknown;
+                for (int q = 0; q < 8; q++) {
+                    unknown.regs[q] = top();
+                }
+                unknown.regs[0] = state->regs[0];
+                flow_into(pc + 1, &unknown);
+            }
+        }
+    }
+
+    if (!is_const(seg, 0)) {
+        CODEMAP_SET(switch_map, pc);
+        return;
+    }
+
+    if (target.kind == V_SET) {
+        for (int i = 0; i < target.count; i++) {
+            flow_into(target.vals[i], state);
+        }
+    } else if (target.kind == V_TABLE) {
+        uint32_t count;
+        uint32_t *targets = record_table(target.vals[0], pc, &count);
+
+        for (uint32_t i = 0; i < count; i++) {
+            flow_into(targets[i], state);
+        }
+        if (count == 0) {
+            CODEMAP_SET(unresolved_map, pc);
+        }
+    } else {
+        CODEMAP_SET(unresolved_map, pc);
+    }
+}
+
+/* walk
+ * Purpose: executes the program abstractly from an entry until control
+            leaves straight-line code or reaches other known code
+ * Parameters: a uint32_t and a State
+ * Returns: Nothing
+ *
+ * Expected input: an entry's address and its state
+ * Success output: none (the words walked are marked as code, and the
+                   state flows on to the entries that follow)
+ * Failure output: none
+ */
+static void walk(uint32_t pc, State state)
+{
+    for (;;) {
+        if (pc >= num_words) {
+            return;
+        }
+        CODEMAP_SET(code_map, pc);
+
+        Um_decoded inst;
+        decode_word(words[pc], &inst);
+        Value *regs = state.regs;
+
+        switch (inst.op) {
+            case CMOV:
+                if (!may_be_zero(regs[inst.c])) {
+                    regs[inst.a] = regs[inst.b];
+                } else if (!is_const(regs[inst.c], 0)) {
+                    regs[inst.a] = join(regs[inst.a], regs[inst.b]);
+                }
+                break;
+            case SLOAD:
+                if (trust_m0 && is_const(regs[inst.b], 0)
+                    && regs[inst.c].kind == V_SET) {
+                    Value loaded = { V_SET, 0, { 0 } };
+                    for (int i = 0; i < regs[inst.c].count; i++) {
+                        uint32_t index = regs[inst.c].vals[i];
+                        if (index < num_words) {
+                            set_add(&loaded, words[index]);
+                        }
+                    }
+                    regs[inst.a] = loaded.count > 0 ? loaded : top();
+                } else if (trust_m0 && is_const(regs[inst.b], 0)
+                           && regs[inst.c].kind == V_OFFSET) {
+                    Value loaded = { V_TABLE, 0, { regs[inst.c].vals[0] } };
+                    regs[inst.a] = loaded;
+                } else {
+                    regs[inst.a] = top();
+                }
+                break;
+            case SSTORE:
+                m0_written = m0_written || may_be_zero(regs[inst.a]);
+                break;
+            case ADD:
+            case MUL:
+            case DIV:
+            case NAND:
+                if (inst.op == DIV && is_const(regs[inst.c], 0)) {
+                    return;
+                }
+                regs[inst.a] = arith(inst.op, regs[inst.b], regs[inst.c]);
+                break;
+            case HALT:
+                return;
+            case ACTIVATE: {
+                Value segment = { V_SEGMENT, 0, { 0 } };
+                regs[inst.b] = segment;
+                break;
+            }
+            case INACTIVATE:
+            case OUT:
+                break;
+            case IN:
+                regs[inst.c] = top();
+                break;
+            case LOADP:
+                jump(pc, regs[inst.b], regs[inst.c], &state);
+                return;
+            case LV:
+                regs[inst.a] = set_of(inst.value);
+                break;
+            default:
+                return;
+        }
+
+        pc++;
+
+        /* Stop at the start of another walk; its entry carries on */
+        if (pc < num_words && entry_index[pc] >= 0) {
+            flow_into(pc, &state);
+            return;
+        }
+    }
+}
+
+/* analyse
+ * Purpose: finds the code reachable from word 0 and the jump tables
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: the image in words, and trust_m0 set as it should be
+ * Success output: none (the maps, entries and tables describe the
+                   image; m0_written is set if an SSTORE may write m[0])
+ * Failure output: exits the program if memory runs out
+ */
+static void analyse()
+{
+    size_t map_bytes = CODEMAP_BYTES(num_words) + 1;
+
+    free(code_map);
+    free(table_map);
+    free(unresolved_map);
+    free(switch_map);
+    free(entries);
+    free(entry_index);
+    free(worklist);
+
+    code_map = calloc(map_bytes, 1);
+    table_map = calloc(map_bytes, 1);
+    unresolved_map = calloc(map_bytes, 1);
+    switch_map = calloc(map_bytes, 1);
+    entry_index = malloc((num_words + 1) * sizeof(int32_t));
+    worklist = malloc((num_words + 1) * sizeof(uint32_t));
+    assert(code_map != NULL && table_map != NULL && entry_index != NULL
+           && unresolved_map != NULL && switch_map != NULL
+           && worklist != NULL);
+
+    memset(entry_index, -1, (num_words + 1) * sizeof(int32_t));
+    entries = NULL;
+    num_entries = entries_capacity = 0;
+    worklist_length = 0;
+    num_tables = 0;
+    m0_written = false;
+
+    State initial;
+    for (int r = 0; r < 8; r++) {
+        initial.regs[r] = set_of(0);
+    }
+    flow_into(0, &initial);
+
+    while (worklist_length > 0) {
+        uint32_t index = worklist[--worklist_length];
+        entries[index].queued = false;
+        walk(entries[index].pc, entries[index].state);
+    }
+}
+
+/* print_instruction
+ * Purpose: prints one decoded word in assembler syntax
+ * Parameters: a uint32_t
+ * Returns: Nothing
+ *
+ * Expected input: the address of a word in the image
+ * Success output: none (a line on stdout, noting an unresolved or
+                   cross-segment LOADP, or a .word for an invalid opcode)
+ * Failure output: none
+ */
+static void print_instruction(uint32_t pc)
+{
+    Um_decoded inst;
+    decode_word(words[pc], &inst);
+
+    if (inst.op > LV) {
+        printf("%08" PRIx32 ":  .word 0x%08" PRIx32 "    ; invalid opcode\n",
+               pc, words[pc]);
+        return;
+    }
+
+    printf("%08" PRIx32 ":  %-6s ", pc, mnemonics[inst.op]);
+
+    switch (inst.op) {
+        case HALT:
+            break;
+        case LV:
+            printf("r%d, %" PRIu32, inst.a, inst.value);
+            break;
+        case ACTIVATE:
+            printf("r%d, r%d", inst.b, inst.c);
+            break;
+        case INACTIVATE:
+        case OUT:
+        case IN:
+            printf("r%d", inst.c);
+            break;
+        case LOADP:
+            printf("r%d, r%d", inst.b, inst.c);
+            if (CODEMAP_TEST(unresolved_map, pc)) {
+                printf("    ; unresolved target");
+            } else if (CODEMAP_TEST(switch_map, pc)) {
+                printf("    ; loads another segment");
+            }
+            break;
+        default:
+            printf("r%d, r%d, r%d", inst.a, inst.b, inst.c);
+    }
+    printf("\n");
+}
+
+/* print_listing
+ * Purpose: prints the summary and, if asked, the annotated listing
+ * Parameters: a bool and a string
+ * Returns: Nothing
+ *
+ * Expected input: whether to print the listing, and the image's path;
+                   called after analyse
+ * Success output: none (the summary, and the listing with code and
+                   data ranges, on stdout)
+ * Failure output: none
+ */
+static void print_listing(bool listing, const char *path)
+{
+    uint32_t code_words = 0, code_ranges = 0, data_words = 0;
+    uint32_t data_ranges = 0, unresolved = 0, switches = 0;
+
+    for (uint32_t i = 0; i < num_words; i++) {
+        bool code = CODEMAP_TEST(code_map, i);
+        bool prev = i > 0 && CODEMAP_TEST(code_map, i - 1);
+
+        code_words += code;
+        data_words += !code;
+        code_ranges += code && (i == 0 || !prev);
+        data_ranges += !code && (i == 0 || prev);
+        unresolved += CODEMAP_TEST(unresolved_map, i);
+        switches += CODEMAP_TEST(switch_map, i);
+    }
+
+    printf("; %s: %" PRIu32 " words, hash %016" PRIx64 "\n", path,
+           num_words, decode_image_hash(words, num_words));
+    printf("; code: %" PRIu32 " words in %" PRIu32 " ranges, "
+           "data: %" PRIu32 " words in %" PRIu32 " ranges\n",
+           code_words, code_ranges, data_words, data_ranges);
+    printf("; jump tables: %" PRIu32 ", unresolved jumps: %" PRIu32
+           ", program loads: %" PRIu32 "%s\n", num_tables, unresolved,
+           switches, trust_m0 ? "" : ", m[0] is self-modifying");
+
+    for (uint32_t t = 0; t < num_tables; t++) {
+        printf("; jump table at %08" PRIx32 ", %" PRIu32
+               " entries, used by %08" PRIx32 "\n",
+               tables[t].base, tables[t].count, tables[t].user);
+    }
+
+    if (!listing) {
+        return;
+    }
+
+    uint32_t i = 0;
+    while (i < num_words) {
+        if (CODEMAP_TEST(code_map, i)) {
+            print_instruction(i++);
+            continue;
+        }
+
+        uint32_t start = i;
+        while (i < num_words && !CODEMAP_TEST(code_map, i)) {
+            i++;
+        }
+        printf("; data %08" PRIx32 "..%08" PRIx32 " (%" PRIu32 " words)\n",
+               start, i - 1, i - start);
+        for (uint32_t j = start; j < i; j++) {
+            printf("%08" PRIx32 ":  .word 0x%08" PRIx32 "%s\n", j, words[j],
+                   CODEMAP_TEST(table_map, j) ? "    ; jump table" : "");
+        }
+    }
+}
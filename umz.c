@@ -0,0 +1,192 @@
+/**************************************************************
+ *
+ *                         umz.c
+ *
+ *     Assignment: UM
+ *     Authors:  Eli Intriligator (eintri01), Max Behrendt (mbehre01)
+ *     Date:     Nov 23, 2021
+ *
+ *     Summary
+ *     Converts UM programs to and from the compressed image format in
+ *     image.h, which um runs directly.
+ *
+ *     Usage: umz [-d] [-o output] program
+ *         -d    expand a compressed image back into a .um file, checking
+ *               it against the hash in its header
+ *     The output defaults to a.umz, or a.um with -d.
+ *
+ **************************************************************/
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "image.h"
+#include "decode.h"
+
+static uint32_t *read_program(const char *path, uint32_t *num_words);
+static uint32_t *expand_image(const char *path, uint32_t *num_words);
+static void usage();
+
+int main(int argc, char *argv[])
+{
+    const char *output_path = NULL;
+    bool expanding = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "do:")) != -1) {
+        switch (opt) {
+            case 'd':
+                expanding = true;
+                break;
+            case 'o':
+                output_path = optarg;
+                break;
+            default:
+                usage();
+        }
+    }
+
+    if (argc - optind != 1) {
+        usage();
+    }
+    if (output_path == NULL) {
+        output_path = expanding ? "a.um" : "a.umz";
+    }
+
+    uint32_t num_words;
+    uint32_t *words = expanding ? expand_image(argv[optind], &num_words)
+                                : read_program(argv[optind], &num_words);
+
+    FILE *out = fopen(output_path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "umz: cannot write %s\n", output_path);
+        exit(EXIT_FAILURE);
+    }
+
+    bool written = true;
+
+    if (expanding) {
+        for (uint32_t i = 0; i < num_words; i++) {
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                putc((words[i] >> shift) & 0xff, out);
+            }
+        }
+        written = !ferror(out);
+    } else {
+        written = image_write(out, words, num_words);
+    }
+
+    if (fclose(out) != 0 || !written) {
+        fprintf(stderr, "umz: error writing %s\n", output_path);
+        exit(EXIT_FAILURE);
+    }
+
+    free(words);
+    return 0;
+}
+
+/* read_program
+ * Purpose: reads a raw .um file
+ * Parameters: a string and a uint32_t pointer
+ * Returns: the program's words
+ *
+ * Expected input: the path of a .um file, and where to store its length
+ * Success output: a malloc'd array of the words, in host order
+ * Failure output: exits the program if the file cannot be read
+ */
+static uint32_t *read_program(const char *path, uint32_t *num_words)
+{
+    FILE *fp = fopen(path, "rb");
+    struct stat buf;
+
+    if (fp == NULL || fstat(fileno(fp), &buf) < 0) {
+        fprintf(stderr, "umz: cannot read %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    *num_words = buf.st_size / 4;
+
+    uint32_t *words = malloc(((size_t)*num_words + 1) * sizeof(uint32_t));
+    if (words == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < *num_words; i++) {
+        uint32_t word = 0;
+
+        for (int j = 0; j < 4; j++) {
+            word = word << 8 | (getc(fp) & 0xff);
+        }
+        words[i] = word;
+    }
+
+    fclose(fp);
+    return words;
+}
+
+/* expand_image
+ * Purpose: reads a compressed image in full
+ * Parameters: a string and a uint32_t pointer
+ * Returns: the program's words
+ *
+ * Expected input: the path of a compressed image, and where to store
+                   the program's length
+ * Success output: a malloc'd array of the words, in host order
+ * Failure output: exits the program if the file is not a compressed
+                   image, a chunk is damaged, or the words do not match
+                   the image's hash
+ */
+static uint32_t *expand_image(const char *path, uint32_t *num_words)
+{
+    Image image = image_open(path);
+
+    if (image == NULL) {
+        fprintf(stderr, "umz: %s is not a compressed image\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t chunk_words = image_chunk_words(image);
+
+    *num_words = image_length(image);
+
+    /* Room for a whole last chunk, since image_unpack may assume it */
+    uint32_t *words = malloc(((size_t)*num_words + chunk_words)
+                             * sizeof(uint32_t));
+    if (words == NULL) {
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t first = 0, i = 0; first < *num_words;
+         first += chunk_words, i++) {
+        if (!image_unpack(image, i, words + first)) {
+            fprintf(stderr, "umz: %s: chunk %u is damaged\n", path, i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (decode_image_hash(words, *num_words) != image_hash(image)) {
+        fprintf(stderr, "umz: %s does not match its hash\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    image_close(&image);
+    return words;
+}
+
+/* usage
+ * Purpose: reports a malformed command line and exits
+ * Parameters: none
+ * Returns: Nothing
+ *
+ * Expected input: none
+ * Success output: none
+ * Failure output: always exits the program with EXIT_FAILURE
+ */
+static void usage()
+{
+    fprintf(stderr, "Usage: umz [-d] [-o output] program\n");
+    exit(EXIT_FAILURE);
+}